@@ -0,0 +1,585 @@
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *	@Project: TaaR_Coding_Style
+ *	@File	: TRBenchmark.cpp
+ *
+ *	Created	: 10/16/2026 4:05:37 PM
+ *	Author	: Nghia-Taarabt
+ *	Link repository: https://github.com/nghia12a1-t-ara/Embedded_MyTools/tree/master/TaaR_Coding_Style
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ */
+// Benchmarks for the formatter, built and run by "make bench".
+// The micro benchmarks time the formatter classes on each corpus and the
+// corpus benchmarks time the complete formatting with AStyleMain.
+// The corpora are generated so the results can be compared between builds,
+// other source files may be added on the command line.
+// The results are written as JSON for regression tracking.
+#include "main.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+using namespace TaaRRule;
+
+//----------------------------------------------------------------------------
+// benchmark structures
+//----------------------------------------------------------------------------
+
+// a source text to be formatted
+struct BenchCorpus
+{
+	string name;            // the generator or file name
+	string text;            // the source text
+	vector<string> lines;   // the source lines, without line ends
+	vector<string> formattedLines;  // the formatted lines, input to the enhancer
+	size_t bytes;           // size of the source text
+};
+
+// the timing of one benchmark on one corpus
+struct BenchResult
+{
+	string benchmark;       // the benchmark name
+	string corpus;          // the corpus name
+	size_t lines;           // lines processed by one iteration
+	size_t bytes;           // bytes processed by one iteration
+	int iterations;         // number of timed iterations
+	double bestSeconds;     // fastest iteration
+	double meanSeconds;     // mean of the iterations
+};
+
+// the options used for the benchmarks, in options file format
+struct BenchOptions
+{
+	const char* name;
+	const char* options;
+};
+
+static const BenchOptions benchOptions[] =
+{
+	{ "precommit", "style=kr\nindent=spaces=4\npad-oper\nadd-brackets\n" },
+	{ "allman", "style=allman\nindent=tab\nbreak-blocks\nalign-pointer=name\nmax-code-length=100\n" },
+};
+
+static double minSeconds = 0.3;     // minimum time for each benchmark
+static const int minIterations = 3; // minimum iterations for each benchmark
+static volatile size_t benchSink;   // keeps the results from being optimized away
+
+//----------------------------------------------------------------------------
+// a beautifier with the header and operator lookups available for timing
+//----------------------------------------------------------------------------
+
+class BenchBeautifier : public ASBeautifier
+{
+	public:
+		BenchBeautifier()
+		{
+			buildHeaders(&benchHeaders);
+			buildOperators(&benchOperators);
+		}
+		// the lookups are done only where the beautifier does them
+		size_t findKeywords(const string &line) const
+		{
+			size_t found = 0;
+			for (size_t i = 0; i < line.length(); i++)
+			{
+				if (isWhiteSpace(line[i]))
+					continue;
+				if (isCharPotentialHeader(line, i))
+				{
+					if (findHeader(line, i, &benchHeaders) != NULL)
+						found++;
+				}
+				else if (isCharPotentialOperator(line[i]))
+				{
+					if (findOperator(line, i, &benchOperators) != NULL)
+						found++;
+				}
+			}
+			return found;
+		}
+
+	private:
+		TRKeywordList benchHeaders;
+		TRKeywordList benchOperators;
+};
+
+//----------------------------------------------------------------------------
+// corpus generators
+//----------------------------------------------------------------------------
+
+/**
+ * Generate MCAL style configuration source like MCAL_MPU_GUI/Generate/Src/MPU_Config.c.
+ * It has section banners, large initializer tables with mixed tabs and
+ * spaces, and init functions that are not formatted.
+ *
+ * @param modules       The number of configuration modules.
+ * @return              The generated source.
+ */
+static string generateMcalConfig(int modules)
+{
+	static const char* banner =
+	    "/*==================================================================================================\n"
+	    "                                       %s\n"
+	    "==================================================================================================*/\n";
+	static const char* sections[] = { "LOCAL MACROS", "LOCAL CONSTANTS", "GLOBAL VARIABLES", "GLOBAL FUNCTIONS" };
+	char buf[1024];
+	string out;
+	out.append("/**\n*   @file MPU_Config.c\n*/\n#include \"MPU_Config.h\"\n\n");
+	for (int module = 0; module < modules; module++)
+	{
+		snprintf(buf, sizeof(buf), banner, sections[module % 4]);
+		out.append(buf);
+		snprintf(buf, sizeof(buf),
+		         "static const MPU_RegionConfigType MPU_ModuleConfig_%d_RegionConfig[16] =\n{\n", module);
+		out.append(buf);
+		for (int region = 0; region < 16; region++)
+		{
+			snprintf(buf, sizeof(buf),
+			         "\t/* Region Configuration %d */\n"
+			         "    {\n"
+			         "        %dU,\n"
+			         "        %luUL,\n"
+			         "        %luUL,\n"
+			         "        MPU_MEM_%s,\n"
+			         "        MPU_PRIV_UNPRIV_%s,\n"
+			         "    },\n"
+			         "\t\n",
+			         region, region, (unsigned long) region * 0x10000000UL,
+			         (unsigned long) (region + 1) * 0x10000000UL - 1,
+			         (region % 3) ? "NORMAL_IN_WB_OUT_WB" : "STRONG_ORDER",
+			         (region % 2) ? "RW_RW" : "NONE");
+			out.append(buf);
+		}
+		out.append("};\n\n");
+		snprintf(buf, sizeof(buf),
+		         "void Mpu_Init_%d(const MPU_ConfigType *pConfig){\n"
+		         "uint32 u32Region;\n"
+		         "for(u32Region=0U;u32Region<pConfig->u8RegionCount;u32Region++){\n"
+		         "if(pConfig->pRegionConfig[u32Region].eMemType==MPU_MEM_STRONG_ORDER)\n"
+		         "{ MPU->RNR=u32Region; MPU->RBAR=pConfig->pRegionConfig[u32Region].u32StartAddr; }\n"
+		         "else {\n"
+		         "    MPU->RASR = (pConfig->pRegionConfig[u32Region].u32EndAddr-pConfig->pRegionConfig[u32Region].u32StartAddr)|MPU_RASR_ENABLE_MASK;\n"
+		         "    }\n"
+		         "switch(pConfig->pRegionConfig[u32Region].ePriv){\n"
+		         "case MPU_PRIV_UNPRIV_NONE: MPU->CTRL|=1U; break;\n"
+		         "default: break;\n"
+		         "}\n"
+		         "}\n"
+		         "}\n\n",
+		         module);
+		out.append(buf);
+	}
+	return out;
+}
+
+/**
+ * Generate a header with deeply nested preprocessor conditionals.
+ *
+ * @param blocks        The number of nested blocks.
+ * @param depth         The nesting depth of each block.
+ * @return              The generated source.
+ */
+static string generateNestedIf(int blocks, int depth)
+{
+	char buf[1024];
+	string out;
+	out.append("#ifndef NESTED_CFG_H\n#define NESTED_CFG_H\n\n#ifdef __cplusplus\nextern \"C\" {\n#endif\n\n");
+	for (int block = 0; block < blocks; block++)
+	{
+		for (int level = 0; level < depth; level++)
+		{
+			snprintf(buf, sizeof(buf), "#if defined(CFG_%d_LEVEL_%d) && (CFG_%d_LEVEL_%d == STD_ON)\n",
+			         block, level, block, level);
+			out.append(buf);
+			snprintf(buf, sizeof(buf),
+			         "typedef struct{\nuint8 u8Id;\nuint32 au32Value[%d];\n} Cfg_%d_%dType;\n"
+			         "extern Std_ReturnType Cfg_%d_%d_Init(const Cfg_%d_%dType *pCfg);\n",
+			         level + 1, block, level, block, level, block, level);
+			out.append(buf);
+		}
+		for (int level = depth - 1; level >= 0; level--)
+		{
+			snprintf(buf, sizeof(buf), "#else\n#define CFG_%d_%d_INIT(x) ((void)(x))\n#endif /* CFG_%d_LEVEL_%d */\n",
+			         block, level, block, level);
+			out.append(buf);
+		}
+		out.append("\n");
+	}
+	out.append("#ifdef __cplusplus\n}\n#endif\n\n#endif /* NESTED_CFG_H */\n");
+	return out;
+}
+
+/**
+ * Generate long macro and register tables.
+ *
+ * @param entries       The number of table entries.
+ * @return              The generated source.
+ */
+static string generateMacroTable(int entries)
+{
+	char buf[1024];
+	string out;
+	out.append("#define PERIPH_BASE (0x40000000UL)\n\n");
+	for (int entry = 0; entry < entries; entry++)
+	{
+		snprintf(buf, sizeof(buf), "#define REG_%d_ADDR32                          ((volatile uint32 *)(PERIPH_BASE+0x%04XUL))\n",
+		         entry, entry * 4);
+		out.append(buf);
+	}
+	out.append("\n#define REG_TABLE(X) \\\n");
+	for (int entry = 0; entry < entries; entry++)
+	{
+		snprintf(buf, sizeof(buf), "    X(REG_%d, 0x%04XU, %s) \\\n", entry, entry * 4, (entry % 2) ? "RW" : "RO");
+		out.append(buf);
+	}
+	out.append("\n\nstatic const Reg_EntryType Reg_Table[] =\n{\n");
+	for (int entry = 0; entry < entries; entry++)
+	{
+		snprintf(buf, sizeof(buf), "{REG_%d_ADDR32,0x%04XU,   REG_ACCESS_%s,(uint8)%d},\n",
+		         entry, entry * 4, (entry % 2) ? "RW" : "RO", entry % 256);
+		out.append(buf);
+	}
+	out.append("};\n");
+	return out;
+}
+
+/**
+ * Generate one huge generated configuration table with a row on each line.
+ * The formatting time should grow linearly with the number of rows.
+ *
+ * @param rows          The number of table rows.
+ * @return              The generated source.
+ */
+static string generateArrayTable(int rows)
+{
+	char buf[1024];
+	string out;
+	snprintf(buf, sizeof(buf), "static const Mpu_RegionConfigType MPU_ModuleConfig_0_RegionConfig[%d] =\n{\n", rows);
+	out.append(buf);
+	for (int row = 0; row < rows; row++)
+	{
+		snprintf(buf, sizeof(buf), "    {0x%08XU,0x%08XU, (uint32)MPU_ATTR_%s|MPU_ATTR_X, %dU, {%dU, %dU}},\n",
+		         row * 0x1000U, row * 0x1000U + 0xFFFU, (row % 2) ? "RW" : "RO", row % 16, row % 2, row % 3);
+		out.append(buf);
+	}
+	out.append("};\n");
+	return out;
+}
+
+//----------------------------------------------------------------------------
+// corpus functions
+//----------------------------------------------------------------------------
+
+// the allocation function for AStyleMain
+static char* STDCALL benchMemoryAlloc(unsigned long memoryNeeded)
+{
+	return new(nothrow) char[memoryNeeded];
+}
+
+// the error handler for AStyleMain
+static void STDCALL benchErrorHandler(int errorNumber, const char* errorMessage)
+{
+	fprintf(stderr, "AStyleMain error %d: %s\n", errorNumber, errorMessage);
+	exit(EXIT_FAILURE);
+}
+
+// split a text into lines, a CR+LF, LF, or CR ends a line
+static void splitLines(const string &text, vector<string> &lines)
+{
+	lines.clear();
+	size_t start = 0;
+	while (start < text.length())
+	{
+		size_t end = text.find_first_of("\r\n", start);
+		if (end == string::npos)
+			end = text.length();
+		lines.push_back(text.substr(start, end - start));
+		if (end < text.length() && text[end] == '\r' && end + 1 < text.length() && text[end + 1] == '\n')
+			end++;
+		start = end + 1;
+	}
+}
+
+// build a corpus from the source text
+static BenchCorpus makeCorpus(const string &name, const string &text)
+{
+	BenchCorpus corpus;
+	corpus.name = name;
+	corpus.text = text;
+	corpus.bytes = text.length();
+	splitLines(text, corpus.lines);
+	char* formatted = AStyleMain(text.c_str(), benchOptions[0].options, benchErrorHandler, benchMemoryAlloc);
+	splitLines(formatted, corpus.formattedLines);
+	delete [] formatted;
+	return corpus;
+}
+
+// read a corpus file, return false if it cannot be read
+static bool readCorpus(const string &fileName, BenchCorpus &corpus)
+{
+	ifstream fin(fileName.c_str(), ios::binary);
+	if (!fin)
+		return false;
+	stringstream text;
+	text << fin.rdbuf();
+	corpus = makeCorpus(fileName, text.str());
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// benchmark functions
+// each function processes the complete corpus once
+//----------------------------------------------------------------------------
+
+static void benchBeautify(const BenchCorpus &corpus)
+{
+	ASBeautifier beautifier;
+	TRBufferIterator sourceIterator(corpus.text.c_str(), corpus.bytes);
+	beautifier.init(&sourceIterator);
+	size_t sum = 0;
+	for (size_t i = 0; i < corpus.lines.size(); i++)
+		sum += beautifier.beautify(corpus.lines[i]).length();
+	benchSink = sum;
+}
+
+static void benchFormatterNextLine(const BenchCorpus &corpus)
+{
+	TRFormatter formatter;
+	ASOptions options(formatter);
+	vector<string> optionsVector;
+	istringstream opt(benchOptions[0].options);
+	options.importOptions(opt, optionsVector);
+	options.parseOptions(optionsVector, "Invalid benchmark options:");
+
+	TRBufferIterator sourceIterator(corpus.text.c_str(), corpus.bytes);
+	formatter.init(&sourceIterator);
+	size_t sum = 0;
+	while (formatter.hasMoreLines())
+		sum += formatter.nextLine().length();
+	formatter.releaseFileStacks();
+	benchSink = sum;
+}
+
+static void benchFindKeywords(const BenchCorpus &corpus)
+{
+	static BenchBeautifier beautifier;
+	size_t sum = 0;
+	for (size_t i = 0; i < corpus.lines.size(); i++)
+		sum += beautifier.findKeywords(corpus.lines[i]);
+	benchSink = sum;
+}
+
+static void benchStreamNextLine(const BenchCorpus &corpus)
+{
+	istringstream in(corpus.text);
+	TRStreamIterator<istream> streamIterator(&in);
+	size_t sum = 0;
+	while (streamIterator.hasMoreLines())
+		sum += streamIterator.nextLine(false).length();
+	benchSink = sum;
+}
+
+static void benchEnhance(const BenchCorpus &corpus)
+{
+	ASEnhancer enhancer;
+	enhancer.init(C_TYPE, 4, 4, false, false, false, false, false);
+	size_t sum = 0;
+	string line;
+	for (size_t i = 0; i < corpus.formattedLines.size(); i++)
+	{
+		line = corpus.formattedLines[i];
+		enhancer.enhance(line, false, false);
+		sum += line.length();
+	}
+	benchSink = sum;
+}
+
+/**
+ * Time a benchmark until it has run for the minimum time and iterations.
+ *
+ * @param benchmark     The benchmark name.
+ * @param corpus        The corpus to be processed.
+ * @param lines         The number of lines processed by one iteration.
+ * @param run           The function that does one iteration.
+ * @param options       The options for AStyleMain, or NULL.
+ * @return              The benchmark result.
+ */
+static BenchResult timeBenchmark(const string &benchmark, const BenchCorpus &corpus, size_t lines,
+                                 void (*run)(const BenchCorpus &), const char* options)
+{
+	typedef chrono::steady_clock Clock;
+	BenchResult result;
+	result.benchmark = benchmark;
+	result.corpus = corpus.name;
+	result.lines = lines;
+	result.bytes = corpus.bytes;
+	result.iterations = 0;
+	result.bestSeconds = 0;
+	result.meanSeconds = 0;
+
+	double totalSeconds = 0;
+	while (result.iterations < minIterations || totalSeconds < minSeconds)
+	{
+		Clock::time_point start = Clock::now();
+		if (run != NULL)
+			run(corpus);
+		else
+		{
+			char* formatted = AStyleMain(corpus.text.c_str(), options, benchErrorHandler, benchMemoryAlloc);
+			benchSink = strlen(formatted);
+			delete [] formatted;
+		}
+		double seconds = chrono::duration<double>(Clock::now() - start).count();
+		if (result.iterations == 0 || seconds < result.bestSeconds)
+			result.bestSeconds = seconds;
+		totalSeconds += seconds;
+		result.iterations++;
+	}
+	result.meanSeconds = totalSeconds / result.iterations;
+	return result;
+}
+
+//----------------------------------------------------------------------------
+// output functions
+//----------------------------------------------------------------------------
+
+// escape a string for JSON output
+static string jsonString(const string &text)
+{
+	string out = "\"";
+	for (size_t i = 0; i < text.length(); i++)
+	{
+		unsigned char ch = text[i];
+		if (ch == '"' || ch == '\\')
+			out.append(1, '\\').append(1, ch);
+		else if (ch < 0x20)
+		{
+			char buf[8];
+			snprintf(buf, sizeof(buf), "\\u%04x", ch);
+			out.append(buf);
+		}
+		else
+			out.append(1, ch);
+	}
+	out.append("\"");
+	return out;
+}
+
+// write the results as a JSON object
+static void writeJson(ostream &out, const vector<BenchResult> &results)
+{
+	char buf[256];
+	out << "{\n";
+	out << "  \"format\": \"taarbench-1\",\n";
+	out << "  \"compiler\": " << jsonString(__VERSION__) << ",\n";
+	out << "  \"build\": " << jsonString(__DATE__ " " __TIME__) << ",\n";
+	out << "  \"results\": [\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchResult &result = results[i];
+		out << "    {\"benchmark\": " << jsonString(result.benchmark)
+		    << ", \"corpus\": " << jsonString(result.corpus);
+		snprintf(buf, sizeof(buf),
+		         ", \"lines\": %zu, \"bytes\": %zu, \"iterations\": %d"
+		         ", \"best_seconds\": %.6f, \"mean_seconds\": %.6f"
+		         ", \"lines_per_second\": %.0f, \"bytes_per_second\": %.0f}",
+		         result.lines, result.bytes, result.iterations,
+		         result.bestSeconds, result.meanSeconds,
+		         result.lines / result.bestSeconds, result.bytes / result.bestSeconds);
+		out << buf << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	out << "  ]\n}\n";
+}
+
+// write a summary table
+static void writeSummary(FILE* out, const vector<BenchResult> &results)
+{
+	fprintf(out, "%-28s %-34s %12s %14s %10s\n", "benchmark", "corpus", "lines/s", "bytes/s", "best ms");
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchResult &result = results[i];
+		string corpus = result.corpus;
+		if (corpus.length() > 34)
+			corpus = "..." + corpus.substr(corpus.length() - 31);
+		fprintf(out, "%-28s %-34s %12.0f %14.0f %10.3f\n",
+		        result.benchmark.c_str(), corpus.c_str(),
+		        result.lines / result.bestSeconds, result.bytes / result.bestSeconds,
+		        result.bestSeconds * 1000);
+	}
+}
+
+//----------------------------------------------------------------------------
+// main function for the benchmark program
+//----------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+	string outputName;
+	vector<string> fileNames;
+	for (int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if (arg.compare(0, 11, "--min-time=") == 0)
+			minSeconds = atof(arg.c_str() + 11);
+		else if (arg.compare(0, 9, "--output=") == 0)
+			outputName = arg.substr(9);
+		else if (arg.compare(0, 2, "--") == 0)
+		{
+			fprintf(stderr, "usage: taarbench [--min-time=SECONDS] [--output=FILE] [file ...]\n");
+			return EXIT_FAILURE;
+		}
+		else
+			fileNames.push_back(arg);
+	}
+
+	vector<BenchCorpus> corpora;
+	corpora.push_back(makeCorpus("generated:mcal_config", generateMcalConfig(60)));
+	corpora.push_back(makeCorpus("generated:nested_if", generateNestedIf(120, 8)));
+	corpora.push_back(makeCorpus("generated:macro_table", generateMacroTable(3000)));
+	corpora.push_back(makeCorpus("generated:array_table_25k", generateArrayTable(25000)));
+	corpora.push_back(makeCorpus("generated:array_table_100k", generateArrayTable(100000)));
+	for (size_t i = 0; i < fileNames.size(); i++)
+	{
+		BenchCorpus corpus;
+		if (!readCorpus(fileNames[i], corpus))
+		{
+			fprintf(stderr, "Cannot open corpus file %s\n", fileNames[i].c_str());
+			return EXIT_FAILURE;
+		}
+		corpora.push_back(corpus);
+	}
+
+	vector<BenchResult> results;
+	for (size_t i = 0; i < corpora.size(); i++)
+	{
+		const BenchCorpus &corpus = corpora[i];
+		size_t lines = corpus.lines.size();
+		results.push_back(timeBenchmark("ASBeautifier::beautify", corpus, lines, benchBeautify, NULL));
+		results.push_back(timeBenchmark("TRFormatter::nextLine", corpus, lines, benchFormatterNextLine, NULL));
+		results.push_back(timeBenchmark("findHeader+findOperator", corpus, lines, benchFindKeywords, NULL));
+		results.push_back(timeBenchmark("TRStreamIterator::nextLine", corpus, lines, benchStreamNextLine, NULL));
+		results.push_back(timeBenchmark("ASEnhancer::enhance", corpus, corpus.formattedLines.size(),
+		                                benchEnhance, NULL));
+		for (size_t j = 0; j < sizeof(benchOptions) / sizeof(benchOptions[0]); j++)
+			results.push_back(timeBenchmark(string("corpus:") + benchOptions[j].name, corpus, lines,
+			                                NULL, benchOptions[j].options));
+	}
+
+	if (outputName.empty())
+	{
+		writeJson(cout, results);
+		return EXIT_SUCCESS;
+	}
+	ofstream fout(outputName.c_str());
+	if (!fout)
+	{
+		fprintf(stderr, "Cannot open output file %s\n", outputName.c_str());
+		return EXIT_FAILURE;
+	}
+	writeJson(fout, results);
+	writeSummary(stdout, results);
+	printf("Results written to %s\n", outputName.c_str());
+	return EXIT_SUCCESS;
+}
@@ -1,23 +1,17 @@
 #!/bin/bash
 
 # Định nghĩa các tùy chọn AStyle
-ASTYLE_OPTIONS="--style=kr --indent=spaces=4 --pad-oper --add-braces --suffix=none"
+ASTYLE_OPTIONS="--style=kr --indent=spaces=4 --pad-oper --add-brackets --suffix=none"
 
-# Lấy danh sách các file mã nguồn C/C++ được thêm vào commit
-files=$(git diff --cached --name-only --diff-filter=ACM | grep -E '\.(c|cpp|h|hpp)$')
-
-# Kiểm tra nếu có file nào cần định dạng
-if [ -n "$files" ]; then
+# Kiểm tra nếu có file mã nguồn C/C++ nào được thêm vào commit
+if [ -n "$(git diff --cached --name-only --diff-filter=ACM -- '*.c' '*.cpp' '*.h' '*.hpp')" ]; then
     echo "Running AStyle on staged files..."
 
-    # Chạy AStyle cho từng file
-    for file in $files; do
-        # Định dạng file
-        astyle $ASTYLE_OPTIONS "$file"
-
-        # Thêm lại file đã định dạng vào commit
-        git add "$file"
-    done
+    # Định dạng tất cả các file trong một lần chạy (--staged), AStyle chỉ in
+    # tên các file đã thay đổi và các file này được thêm lại vào commit
+    git diff --cached --name-only -z --diff-filter=ACM -- '*.c' '*.cpp' '*.h' '*.hpp' \
+        | taarrule $ASTYLE_OPTIONS --staged \
+        | xargs -0 -r git add --
 
     echo "AStyle formatting applied."
 fi
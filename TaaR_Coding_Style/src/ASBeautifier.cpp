@@ -12,9 +12,6 @@
 
 namespace TaaRRule {
 
-// this must be global
-int  g_preprocessorCppExternCBracket;
-
 /**
  * ASBeautifier's constructor
  * This constructor is called only once for each source file.
@@ -22,23 +19,15 @@ int  g_preprocessorCppExternCBracket;
  */
 ASBeautifier::ASBeautifier()
 {
-	g_preprocessorCppExternCBracket = 0;
+	externCBracketState = 0;
+	preprocessorCppExternCBracket = &externCBracketState;
 
+	fileMemory = pmr::new_delete_resource();
 	waitingBeautifierStack = NULL;
 	activeBeautifierStack = NULL;
 	waitingBeautifierStackLengthStack = NULL;
 	activeBeautifierStackLengthStack = NULL;
 
-	headerStack  = NULL;
-	tempStacks = NULL;
-	blockParenDepthStack = NULL;
-	blockStatementStack = NULL;
-	parenStatementStack = NULL;
-	bracketBlockStateStack = NULL;
-	inStatementIndentStack = NULL;
-	inStatementIndentStackSizeStack = NULL;
-	parenIndentStack = NULL;
-	preprocIndentStack = NULL;
 	sourceIterator = NULL;
 	isModeManuallySet = false;
 	shouldForceTabIndentation = false;
@@ -63,13 +52,13 @@ ASBeautifier::ASBeautifier()
 
 	// initialize ASBeautifier member vectors
 	beautifierFileType = 9;		// reset to an invalid type
-	headers = new vector<const string*>;
-	nonParenHeaders = new vector<const string*>;
-	assignmentOperators = new vector<const string*>;
-	nonAssignmentOperators = new vector<const string*>;
-	preBlockStatements = new vector<const string*>;
-	preCommandHeaders = new vector<const string*>;
-	indentableHeaders = new vector<const string*>;
+	headers = new TRKeywordList;
+	nonParenHeaders = new TRKeywordList;
+	assignmentOperators = new TRKeywordList;
+	nonAssignmentOperators = new TRKeywordList;
+	preBlockStatements = new TRKeywordList;
+	preCommandHeaders = new TRKeywordList;
+	indentableHeaders = new TRKeywordList;
 }
 
 /**
@@ -81,44 +70,29 @@ ASBeautifier::ASBeautifier()
  *
  * Must explicitly call the base class copy constructor.
  */
-ASBeautifier::ASBeautifier(const ASBeautifier &other) : TRBase(other)
-{
+ASBeautifier::ASBeautifier(const ASBeautifier &other) : TRBase(other),
+	headerStack(other.headerStack),
+	tempStacks(other.tempStacks),
+	blockParenDepthStack(other.blockParenDepthStack),
+	blockStatementStack(other.blockStatementStack),
+	parenStatementStack(other.parenStatementStack),
+	bracketBlockStateStack(other.bracketBlockStateStack),
+	inStatementIndentStack(other.inStatementIndentStack),
+	inStatementIndentStackSizeStack(other.inStatementIndentStackSizeStack),
+	parenIndentStack(other.parenIndentStack),
+	preprocIndentStack(other.preprocIndentStack)
+{
+	// the clones are made by processPreprocessor
+	TRProfile::countClone();
+
 	// these don't need to copy the stack
+	fileMemory = other.fileMemory;
 	waitingBeautifierStack = NULL;
 	activeBeautifierStack = NULL;
 	waitingBeautifierStackLengthStack = NULL;
 	activeBeautifierStackLengthStack = NULL;
 
-	// vector '=' operator performs a DEEP copy of all elements in the vector
-
-	headerStack  = new vector<const string*>;
-	*headerStack = *other.headerStack;
-
-	tempStacks = copyTempStacks(other);
-
-	blockParenDepthStack = new vector<int>;
-	*blockParenDepthStack = *other.blockParenDepthStack;
-
-	blockStatementStack = new vector<bool>;
-	*blockStatementStack = *other.blockStatementStack;
-
-	parenStatementStack =  new vector<bool>;
-	*parenStatementStack = *other.parenStatementStack;
-
-	bracketBlockStateStack = new vector<bool>;
-	*bracketBlockStateStack = *other.bracketBlockStateStack;
-
-	inStatementIndentStack = new vector<int>;
-	*inStatementIndentStack = *other.inStatementIndentStack;
-
-	inStatementIndentStackSizeStack = new vector<int>;
-	*inStatementIndentStackSizeStack = *other.inStatementIndentStackSizeStack;
-
-	parenIndentStack = new vector<int>;
-	*parenIndentStack = *other.parenIndentStack;
-
-	preprocIndentStack = new vector<pair<int, int> >;
-	*preprocIndentStack = *other.preprocIndentStack;
+	// the stacks are shared with the original and copied when they are changed
 
 	// Copy the pointers to vectors.
 	// This is ok because the original ASBeautifier object
@@ -221,6 +195,8 @@ ASBeautifier::ASBeautifier(const ASBeautifier &other) : TRBase(other)
 	maxInStatementIndent = other.maxInStatementIndent;
 	classInitializerIndents = other.classInitializerIndents;
 	templateDepth = other.templateDepth;
+	externCBracketState = 0;
+	preprocessorCppExternCBracket = other.preprocessorCppExternCBracket;
 	squareBracketCount = other.squareBracketCount;
 	prevFinalLineSpaceIndentCount = other.prevFinalLineSpaceIndentCount;
 	prevFinalLineIndentCount = other.prevFinalLineIndentCount;
@@ -237,20 +213,7 @@ ASBeautifier::ASBeautifier(const ASBeautifier &other) : TRBase(other)
  */
 ASBeautifier::~ASBeautifier()
 {
-	deleteBeautifierContainer(waitingBeautifierStack);
-	deleteBeautifierContainer(activeBeautifierStack);
-	deleteContainer(waitingBeautifierStackLengthStack);
-	deleteContainer(activeBeautifierStackLengthStack);
-	deleteContainer(headerStack);
-	deleteTempStacksContainer(tempStacks);
-	deleteContainer(blockParenDepthStack);
-	deleteContainer(blockStatementStack);
-	deleteContainer(parenStatementStack);
-	deleteContainer(bracketBlockStateStack);
-	deleteContainer(inStatementIndentStack);
-	deleteContainer(inStatementIndentStackSizeStack);
-	deleteContainer(parenIndentStack);
-	deleteContainer(preprocIndentStack);
+	releaseStacks();
 }
 
 /**
@@ -270,27 +233,27 @@ void ASBeautifier::init(TRSourceIterator* iter)
 	initVectors();
 	TRBase::init(getFileType());
 
-	initContainer(waitingBeautifierStack, new vector<ASBeautifier*>);
-	initContainer(activeBeautifierStack, new vector<ASBeautifier*>);
+	initContainer(waitingBeautifierStack);
+	initContainer(activeBeautifierStack);
 
-	initContainer(waitingBeautifierStackLengthStack, new vector<int>);
-	initContainer(activeBeautifierStackLengthStack, new vector<int>);
+	initContainer(waitingBeautifierStackLengthStack);
+	initContainer(activeBeautifierStackLengthStack);
 
-	initContainer(headerStack,  new vector<const string*>);
+	headerStack.init(fileMemory);
 
-	initTempStacksContainer(tempStacks, new vector<vector<const string*>*>);
-	tempStacks->push_back(new vector<const string*>);
+	tempStacks.init(fileMemory);
+	tempStacks.modify()->emplace_back();
 
-	initContainer(blockParenDepthStack, new vector<int>);
-	initContainer(blockStatementStack, new vector<bool>);
-	initContainer(parenStatementStack, new vector<bool>);
-	initContainer(bracketBlockStateStack, new vector<bool>);
-	bracketBlockStateStack->push_back(true);
-	initContainer(inStatementIndentStack, new vector<int>);
-	initContainer(inStatementIndentStackSizeStack, new vector<int>);
-	inStatementIndentStackSizeStack->push_back(0);
-	initContainer(parenIndentStack, new vector<int>);
-	initContainer(preprocIndentStack, new vector<pair<int, int> >);
+	blockParenDepthStack.init(fileMemory);
+	blockStatementStack.init(fileMemory);
+	parenStatementStack.init(fileMemory);
+	bracketBlockStateStack.init(fileMemory);
+	bracketBlockStateStack.modify()->push_back(true);
+	inStatementIndentStack.init(fileMemory);
+	inStatementIndentStackSizeStack.init(fileMemory);
+	inStatementIndentStackSizeStack.modify()->push_back(0);
+	parenIndentStack.init(fileMemory);
+	preprocIndentStack.init(fileMemory);
 
 	previousLastLineHeader = NULL;
 	currentHeader = NULL;
@@ -324,6 +287,7 @@ void ASBeautifier::init(TRSourceIterator* iter)
 	lineOpeningBlocksNum = 0;
 	lineClosingBlocksNum = 0;
 	templateDepth = 0;
+	*preprocessorCppExternCBracket = 0;
 	squareBracketCount = 0;
 	parenDepth = 0;
 	blockTabCount = 0;
@@ -511,6 +475,18 @@ void ASBeautifier::setBlockIndent(bool state)
 	blockIndent = state;
 }
 
+/**
+ * set the memory used for the stacks of the file.
+ * the stacks must be released before the memory is changed.
+ *
+ * @param   memory            the memory resource for the stacks.
+ */
+void ASBeautifier::setFileMemory(pmr::memory_resource* memory)
+{
+	assert(waitingBeautifierStack == NULL);
+	fileMemory = memory;
+}
+
 /**
  * set the state of the class indentation option. If true, C++ class
  * definitions will be indented one additional indent.
@@ -759,6 +735,7 @@ int ASBeautifier::getTabLength(void) const
  */
 string ASBeautifier::beautify(const string &originalLine)
 {
+	TRProfileTimer profileTimer(PROFILE_BEAUTIFY);
 	string line;
 	bool isInQuoteContinuation = isInVerbatimQuote | haveLineContinuationChar;
 
@@ -867,7 +844,7 @@ string ASBeautifier::beautify(const string &originalLine)
 						entry = activeBeautifierStack->back()->computePreprocessorIndent();
 					else
 						entry = computePreprocessorIndent();
-					preprocIndentStack->push_back(entry);
+					preprocIndentStack.modify()->push_back(entry);
 					return preLineWS(preprocIndentStack->back().first,
 					                 preprocIndentStack->back().second) + line;
 				}
@@ -883,7 +860,7 @@ string ASBeautifier::beautify(const string &originalLine)
 					{
 						string indentedLine = preLineWS(preprocIndentStack->back().first,
 						                                preprocIndentStack->back().second) + line;
-						preprocIndentStack->pop_back();
+						preprocIndentStack.modify()->pop_back();
 						return indentedLine;
 					}
 				}
@@ -972,7 +949,7 @@ string ASBeautifier::beautify(const string &originalLine)
 			else if (inStatementIndentStack->empty()
 			         || inStatementIndentStack->back() == 0)
 			{
-				inStatementIndentStack->push_back(indentLength);
+				inStatementIndentStack.modify()->push_back(indentLength);
 				isInStatement = true;
 			}
 		}
@@ -1077,14 +1054,14 @@ void ASBeautifier::registerInStatementIndent(const string &line, int i, int spac
 		if (currIndent > maxInStatementIndent
 		        && line[i] != '{')
 			currIndent = indentLength * 2 + spaceTabCount_;
-		inStatementIndentStack->push_back(currIndent);
+		inStatementIndentStack.modify()->push_back(currIndent);
 		if (updateParenStack)
-			parenIndentStack->push_back(previousIndent);
+			parenIndentStack.modify()->push_back(previousIndent);
 		return;
 	}
 
 	if (updateParenStack)
-		parenIndentStack->push_back(i + spaceTabCount_ - horstmannIndentInStatement);
+		parenIndentStack.modify()->push_back(i + spaceTabCount_ - horstmannIndentInStatement);
 
 	int tabIncrement = tabIncrementIn;
 
@@ -1117,7 +1094,7 @@ void ASBeautifier::registerInStatementIndent(const string &line, int i, int spac
 	if (isNonInStatementArray && !isInEnum && !bracketBlockStateStack->empty() && bracketBlockStateStack->back())
 		inStatementIndent = 0;
 
-	inStatementIndentStack->push_back(inStatementIndent);
+	inStatementIndentStack.modify()->push_back(inStatementIndent);
 }
 
 /**
@@ -1183,12 +1160,12 @@ int ASBeautifier::getNextProgramCharDistance(const string &line, int i) const
 
 // check if a specific line position contains a header.
 const string* ASBeautifier::findHeader(const string &line, int i,
-                                       const vector<const string*>* possibleHeaders) const
+                                       const TRKeywordList* possibleHeaders) const
 {
 	assert(isCharPotentialHeader(line, i));
-	// check the word
-	size_t maxHeaders = possibleHeaders->size();
-	for (size_t p = 0; p < maxHeaders; p++)
+	// check the words beginning with the current character
+	size_t maxHeaders = possibleHeaders->getIndexEnd(line[i]);
+	for (size_t p = possibleHeaders->getIndexStart(line[i]); p < maxHeaders; p++)
 	{
 		const string* header = (*possibleHeaders)[p];
 		const size_t wordEnd = i + header->length();
@@ -1219,16 +1196,53 @@ const string* ASBeautifier::findHeader(const string &line, int i,
 	return NULL;
 }
 
+// check if a specific line position contains a header.
+// same as findHeader above using the tokens of the line. the headers
+// contain only name characters, so a header of a different length
+// than the word cannot match.
+const string* ASBeautifier::findHeader(const TRLineTokens &tokens, size_t i,
+                                       const TRKeywordList* possibleHeaders) const
+{
+	assert(tokens.isCharPotentialHeader(i));
+	const string &line = tokens.getLine();
+	const size_t wordLength = tokens.getWordLength(i);
+	// check the words beginning with the current character
+	size_t maxHeaders = possibleHeaders->getIndexEnd(line[i]);
+	for (size_t p = possibleHeaders->getIndexStart(line[i]); p < maxHeaders; p++)
+	{
+		const string* header = (*possibleHeaders)[p];
+		if (header->length() != wordLength)
+			continue;
+		int result = (line.compare(i, wordLength, *header));
+		if (result > 0)
+			continue;
+		if (result < 0)
+			break;
+		const char peekChar = tokens.peekNextChar(i + wordLength - 1);
+		// is not a header if part of a definition
+		if (peekChar == ',' || peekChar == ')')
+			break;
+		// the following accessor definitions are NOT headers
+		// goto default; is NOT a header
+		// default(int) keyword in C# is NOT a header
+		else if ((header == &AS_GET || header == &AS_SET || header == &AS_DEFAULT)
+		         && (peekChar == ';' ||  peekChar == '(' || peekChar == '='))
+			break;
+		return header;
+	}
+	return NULL;
+}
+
 // check if a specific line position contains an operator.
 const string* ASBeautifier::findOperator(const string &line, int i,
-                                         const vector<const string*>* possibleOperators) const
+                                         const TRKeywordList* possibleOperators) const
 {
 	assert(isCharPotentialOperator(line[i]));
 	// find the operator in the vector
-	// the vector contains the LONGEST operators first
-	// must loop thru the entire vector
-	size_t maxOperators = possibleOperators->size();
-	for (size_t p = 0; p < maxOperators; p++)
+	// the operators for a character are LONGEST first
+	// must loop thru all operators beginning with the current character
+	size_t maxOperators = possibleOperators->getIndexEnd(line[i]);
+	for (size_t p = possibleOperators->getIndexStart(line[i]); p < maxOperators; p++)
 	{
 		const size_t wordEnd = i + (*(*possibleOperators)[p]).length();
 		if (wordEnd > line.length())
@@ -1246,9 +1260,10 @@ const string* ASBeautifier::findOperator(const string &line, int i,
  * @param container     a vector of strings.
  * @param element       the element to find .
  */
-int ASBeautifier::indexOf(vector<const string*> &container, const string* element) const
+template<typename T>
+int ASBeautifier::indexOf(const T &container, const string* element) const
 {
-	vector<const string*>::const_iterator where;
+	typename T::const_iterator where;
 
 	where = find(container.begin(), container.end(), element);
 	if (where == container.end())
@@ -1312,25 +1327,6 @@ string ASBeautifier::rtrim(const string &str) const
 	return returnStr;
 }
 
-/**
- * Copy tempStacks for the copy constructor.
- * The value of the vectors must also be copied.
- */
-vector<vector<const string*>*>* ASBeautifier::copyTempStacks(const ASBeautifier &other) const
-{
-	vector<vector<const string*>*>* tempStacksNew = new vector<vector<const string*>*>;
-	vector<vector<const string*>*>::iterator iter;
-	for (iter = other.tempStacks->begin();
-	        iter != other.tempStacks->end();
-	        ++iter)
-	{
-		vector<const string*>* newVec = new vector<const string*>;
-		*newVec = **iter;
-		tempStacksNew->push_back(newVec);
-	}
-	return tempStacksNew;
-}
-
 /**
  * delete a member vectors to eliminate memory leak reporting
  */
@@ -1347,17 +1343,16 @@ void ASBeautifier::deleteBeautifierVectors()
 }
 
 /**
- * delete a vector object
+ * delete a vector object created in the file memory
  * T is the type of vector
- * used for all vectors except tempStacks
+ * used for the beautifier stack length vectors
  */
 template<typename T>
-void ASBeautifier::deleteContainer(T &container)
+void ASBeautifier::deleteContainer(T* &container)
 {
 	if (container != NULL)
 	{
-		container->clear();
-		delete (container);
+		TRFileArena::deleteStack(container, fileMemory);
 		container = NULL;
 	}
 }
@@ -1368,68 +1363,55 @@ void ASBeautifier::deleteContainer(T &container)
  * Therefore the ASBeautifier objects have to be deleted in addition to the
  * ASBeautifier pointer entries.
  */
-void ASBeautifier::deleteBeautifierContainer(vector<ASBeautifier*>* &container)
+void ASBeautifier::deleteBeautifierContainer(pmr::vector<ASBeautifier*>* &container)
 {
 	if (container != NULL)
 	{
-		vector<ASBeautifier*>::iterator iter = container->begin();
+		pmr::vector<ASBeautifier*>::iterator iter = container->begin();
 		while (iter < container->end())
 		{
 			delete *iter;
 			++iter;
 		}
-		container->clear();
-		delete (container);
-		container = NULL;
+		deleteContainer(container);
 	}
 }
 
 /**
- * Delete the tempStacks vector object.
- * The tempStacks is a vector of pointers to strings allocated with the 'new' operator.
- * Therefore the strings have to be deleted in addition to the tempStacks entries.
+ * Delete the preprocessor beautifiers and release the stacks.
+ * Must be done before the memory used by the stacks is released.
  */
-void ASBeautifier::deleteTempStacksContainer(vector<vector<const string*>*>* &container)
+void ASBeautifier::releaseStacks()
 {
-	if (container != NULL)
-	{
-		vector<vector<const string*>*>::iterator iter = container->begin();
-		while (iter < container->end())
-		{
-			delete *iter;
-			++iter;
-		}
-		container->clear();
-		delete (container);
-		container = NULL;
-	}
+	deleteBeautifierContainer(waitingBeautifierStack);
+	deleteBeautifierContainer(activeBeautifierStack);
+	deleteContainer(waitingBeautifierStackLengthStack);
+	deleteContainer(activeBeautifierStackLengthStack);
+
+	headerStack.release();
+	tempStacks.release();
+	blockParenDepthStack.release();
+	blockStatementStack.release();
+	parenStatementStack.release();
+	bracketBlockStateStack.release();
+	inStatementIndentStack.release();
+	inStatementIndentStackSizeStack.release();
+	parenIndentStack.release();
+	preprocIndentStack.release();
 }
 
 /**
- * initialize a vector object
+ * initialize a vector object in the file memory
  * T is the type of vector used for all vectors
  */
 template<typename T>
-void ASBeautifier::initContainer(T &container, T value)
+void ASBeautifier::initContainer(T* &container)
 {
 	// since the TRFormatter object is never deleted,
 	// the existing vectors must be deleted before creating new ones
 	if (container != NULL )
 		deleteContainer(container);
-	container = value;
-}
-
-/**
- * Initialize the tempStacks vector object.
- * The tempStacks is a vector of pointers to strings allocated with the 'new' operator.
- * Any residual entries are deleted before the vector is initialized.
- */
-void ASBeautifier::initTempStacksContainer(vector<vector<const string*>*>* &container,
-                                           vector<vector<const string*>*>* value)
-{
-	if (container != NULL)
-		deleteTempStacksContainer(container);
-	container = value;
+	container = TRFileArena::newStack<T>(fileMemory);
 }
 
 /**
@@ -1732,9 +1714,9 @@ void ASBeautifier::popLastInStatementIndent()
 	assert(!inStatementIndentStackSizeStack->empty());
 	int previousIndentStackSize = inStatementIndentStackSizeStack->back();
 	if (inStatementIndentStackSizeStack->size() > 1)
-		inStatementIndentStackSizeStack->pop_back();
+		inStatementIndentStackSizeStack.modify()->pop_back();
 	while (previousIndentStackSize < (int) inStatementIndentStack->size())
-		inStatementIndentStack->pop_back();
+		inStatementIndentStack.modify()->pop_back();
 }
 
 // for unit testing
@@ -1775,8 +1757,8 @@ void ASBeautifier::processPreprocessor(const string &preproc, const string &line
 	}
 	else if (preproc.length() >= 2 && preproc.substr(0, 2) == "if")
 	{
-		if (isPreprocessorConditionalCplusplus(line) && !g_preprocessorCppExternCBracket)
-			g_preprocessorCppExternCBracket = 1;
+		if (isPreprocessorConditionalCplusplus(line) && !*preprocessorCppExternCBracket)
+			*preprocessorCppExternCBracket = 1;
 		// push a new beautifier into the stack
 		waitingBeautifierStackLengthStack->push_back(waitingBeautifierStack->size());
 		activeBeautifierStackLengthStack->push_back(activeBeautifierStack->size());
@@ -1950,7 +1932,7 @@ void ASBeautifier::computePreliminaryIndentation()
 
 	if (isInConditional)
 		--indentCount;
-	if (g_preprocessorCppExternCBracket >= 4)
+	if (*preprocessorCppExternCBracket >= 4)
 		--indentCount;
 }
 
@@ -2029,14 +2011,11 @@ int ASBeautifier::adjustIndentCountForBreakElseIfComments() const
 {
 	assert(isElseHeaderIndent && !tempStacks->empty());
 	int indentCountIncrement = 0;
-	vector<const string*>* lastTempStack = tempStacks->back();
-	if (lastTempStack != NULL)
+	const pmr::vector<const string*> &lastTempStack = tempStacks->back();
+	for (size_t i = 0; i < lastTempStack.size(); i++)
 	{
-		for (size_t i = 0; i < lastTempStack->size(); i++)
-		{
-			if (*lastTempStack->at(i) == AS_ELSE)
-				indentCountIncrement++;
-		}
+		if (*lastTempStack[i] == AS_ELSE)
+			indentCountIncrement++;
 	}
 	return indentCountIncrement;
 }
@@ -2070,7 +2049,7 @@ void ASBeautifier::clearObjCMethodDefinitionAlignment()
 	isInObjCMethodDefinition = false;
 	isImmediatelyPostObjCMethodDefinition = false;
 	if (!inStatementIndentStack->empty())
-		inStatementIndentStack->pop_back();
+		inStatementIndentStack.modify()->pop_back();
 }
 
 /**
@@ -2102,6 +2081,9 @@ void ASBeautifier::parseCurrentLine(const string &line)
 	char ch = ' ';
 	int tabIncrementIn = 0;
 
+	// the headers and the next characters are found from the tokens
+	tokenizeLine(line, lineTokens);
+
 	for (size_t i = 0; i < line.length(); i++)
 	{
 		ch = line[i];
@@ -2132,7 +2114,7 @@ void ASBeautifier::parseCurrentLine(const string &line)
 			}
 			if (ch == '\\')
 			{
-				if (peekNextChar(line, i) == ' ')   // is this '\' at end of line
+				if (lineTokens.peekNextChar(i) == ' ')   // is this '\' at end of line
 					haveLineContinuationChar = true;
 				else
 					isSpecialChar = true;
@@ -2160,8 +2142,8 @@ void ASBeautifier::parseCurrentLine(const string &line)
 					}
 				}
 				// check for "C" following "extern"
-				else if (g_preprocessorCppExternCBracket == 2 && line.compare(i, 3, "\"C\"") == 0)
-					++g_preprocessorCppExternCBracket;
+				else if (*preprocessorCppExternCBracket == 2 && line.compare(i, 3, "\"C\"") == 0)
+					++*preprocessorCppExternCBracket;
 			}
 			else if (isInVerbatimQuote && ch == '"')
 			{
@@ -2273,7 +2255,7 @@ void ASBeautifier::parseCurrentLine(const string &line)
 			{
 				// insert the probation header as a new header
 				isInHeader = true;
-				headerStack->push_back(probationHeader);
+				headerStack.modify()->push_back(probationHeader);
 
 				// handle the specific probation header
 				isInConditional = (probationHeader == &AS_SYNCHRONIZED);
@@ -2317,7 +2299,7 @@ void ASBeautifier::parseCurrentLine(const string &line)
 			if (ch == '<')
 			{
 				++templateDepth;
-				inStatementIndentStackSizeStack->push_back(inStatementIndentStack->size());
+				inStatementIndentStackSizeStack.modify()->push_back(inStatementIndentStack->size());
 				registerInStatementIndent(line, i, spaceIndentCount, tabIncrementIn, 0, true);
 			}
 			else if (ch == '>')
@@ -2344,7 +2326,7 @@ void ASBeautifier::parseCurrentLine(const string &line)
 				        && !headerStack->empty()
 				        && headerStack->back() == &AS_STRUCT)
 				{
-					headerStack->pop_back();
+					headerStack.modify()->pop_back();
 					isInClassInitializer = false;
 					// -1 for isInClassInitializer, -2 for isInClassHeaderTab
 					if (isInClassHeaderTab)
@@ -2358,14 +2340,14 @@ void ASBeautifier::parseCurrentLine(const string &line)
 
 				if (parenDepth == 0)
 				{
-					parenStatementStack->push_back(isInStatement);
+					parenStatementStack.modify()->push_back(isInStatement);
 					isInStatement = true;
 				}
 				parenDepth++;
 				if (ch == '[')
 					++squareBracketCount;
 
-				inStatementIndentStackSizeStack->push_back(inStatementIndentStack->size());
+				inStatementIndentStackSizeStack.modify()->push_back(inStatementIndentStack->size());
 
 				if (currentHeader != NULL)
 					registerInStatementIndent(line, i, spaceIndentCount, tabIncrementIn, minConditionalIndent/*indentLength*2*/, true);
@@ -2385,7 +2367,7 @@ void ASBeautifier::parseCurrentLine(const string &line)
 					if (!parenStatementStack->empty())      // in case of unmatched closing parens
 					{
 						isInStatement = parenStatementStack->back();
-						parenStatementStack->pop_back();
+						parenStatementStack.modify()->pop_back();
 					}
 					ch = ' ';
 					isInAsm = false;
@@ -2399,7 +2381,7 @@ void ASBeautifier::parseCurrentLine(const string &line)
 					if (!parenIndentStack->empty())
 					{
 						int poppedIndent = parenIndentStack->back();
-						parenIndentStack->pop_back();
+						parenIndentStack.modify()->pop_back();
 
 						if (i == 0)
 							spaceIndentCount = poppedIndent;
@@ -2417,7 +2399,7 @@ void ASBeautifier::parseCurrentLine(const string &line)
 			                      || prevNonSpaceCh == '}'
 			                      || prevNonSpaceCh == ')'
 			                      || prevNonSpaceCh == ';'
-			                      || peekNextChar(line, i) == '{'
+			                      || lineTokens.peekNextChar(i) == '{'
 			                      || foundPreCommandHeader
 			                      || foundPreCommandMacro
 			                      || isInClassInitializer
@@ -2434,7 +2416,7 @@ void ASBeautifier::parseCurrentLine(const string &line)
 			if (isInClassInitializer)
 			{
 				if (!inStatementIndentStack->empty())
-					inStatementIndentStack->pop_back();
+					inStatementIndentStack.modify()->pop_back();
 				isInStatement = false;
 				if (lineBeginsWithOpenBracket)
 					spaceIndentCount = 0;
@@ -2464,11 +2446,11 @@ void ASBeautifier::parseCurrentLine(const string &line)
 					}
 			}
 
-			bracketBlockStateStack->push_back(isBlockOpener);
+			bracketBlockStateStack.modify()->push_back(isBlockOpener);
 
 			if (!isBlockOpener)
 			{
-				inStatementIndentStackSizeStack->push_back(inStatementIndentStack->size());
+				inStatementIndentStackSizeStack.modify()->push_back(inStatementIndentStack->size());
 				registerInStatementIndent(line, i, spaceIndentCount, tabIncrementIn, 0, true);
 				parenDepth++;
 				if (i == 0)
@@ -2520,10 +2502,10 @@ void ASBeautifier::parseCurrentLine(const string &line)
 			if (!headerStack->empty()
 			        && (*headerStack).back() == &AS_STRUCT
 			        && isInIndentableStruct)
-				(*headerStack).back() = &AS_CLASS;
+				headerStack.modify()->back() = &AS_CLASS;
 
-			blockParenDepthStack->push_back(parenDepth);
-			blockStatementStack->push_back(isInStatement);
+			blockParenDepthStack.modify()->push_back(parenDepth);
+			blockStatementStack.modify()->push_back(isInStatement);
 
 			if (!inStatementIndentStack->empty())
 			{
@@ -2534,8 +2516,8 @@ void ASBeautifier::parseCurrentLine(const string &line)
 			}
 
 			blockTabCount += (isInStatement ? 1 : 0);
-			if (g_preprocessorCppExternCBracket == 3)
-				++g_preprocessorCppExternCBracket;
+			if (*preprocessorCppExternCBracket == 3)
+				++*preprocessorCppExternCBracket;
 			parenDepth = 0;
 			isInStatement = false;
 			isInQuestion = false;
@@ -2543,19 +2525,29 @@ void ASBeautifier::parseCurrentLine(const string &line)
 			foundPreCommandMacro = false;
 			isInExternC = false;
 
-			tempStacks->push_back(new vector<const string*>);
-			headerStack->push_back(&AS_OPEN_BRACKET);
+			tempStacks.modify()->emplace_back();
+			headerStack.modify()->push_back(&AS_OPEN_BRACKET);
 			lastLineHeader = &AS_OPEN_BRACKET;
 
 			continue;
 		}	// end '{'
 
 		//check if a header has been reached
-		bool isPotentialHeader = isCharPotentialHeader(line, i);
+		bool isPotentialHeader = lineTokens.isCharPotentialHeader(i);
+
+		// a number literal is not a header or a keyword, bypass it without
+		// the lookups. the rows of generated array initializers are mostly numbers.
+		if (isPotentialHeader && isDigit(ch))
+		{
+			if (*preprocessorCppExternCBracket == 3)	// extern "C" is not followed by a '{'
+				*preprocessorCppExternCBracket = 0;
+			i += lineTokens.getWordLength(i) - 1;
+			continue;
+		}
 
 		if (isPotentialHeader && !squareBracketCount)
 		{
-			const string* newHeader = findHeader(line, i, headers);
+			const string* newHeader = findHeader(lineTokens, i, headers);
 
 			if (newHeader != NULL)
 			{
@@ -2564,11 +2556,12 @@ void ASBeautifier::parseCurrentLine(const string &line)
 
 				isInHeader = true;
 
-				vector<const string*>* lastTempStack;
-				if (tempStacks->empty())
-					lastTempStack = NULL;
-				else
-					lastTempStack = tempStacks->back();
+				// the last temp stack is used only by the headers that close a previous header
+				pmr::vector<const string*>* lastTempStack = NULL;
+				if (!tempStacks->empty()
+				        && (newHeader == &AS_ELSE || newHeader == &AS_WHILE
+				            || newHeader == &AS_CATCH || newHeader == &AS_FINALLY))
+					lastTempStack = &tempStacks.modify()->back();
 
 				// if a new block is opened, push a new stack into tempStacks to hold the
 				// future list of headers in the new block.
@@ -2576,7 +2569,7 @@ void ASBeautifier::parseCurrentLine(const string &line)
 				// take care of the special case: 'else if (...)'
 				if (newHeader == &AS_IF && lastLineHeader == &AS_ELSE)
 				{
-					headerStack->pop_back();
+					headerStack.modify()->pop_back();
 				}
 
 				// take care of 'else'
@@ -2592,7 +2585,7 @@ void ASBeautifier::parseCurrentLine(const string &line)
 							int restackSize = lastTempStack->size() - indexOfIf - 1;
 							for (int r = 0; r < restackSize; r++)
 							{
-								headerStack->push_back(lastTempStack->back());
+								headerStack.modify()->push_back(lastTempStack->back());
 								lastTempStack->pop_back();
 							}
 							if (!closingBracketReached)
@@ -2619,7 +2612,7 @@ void ASBeautifier::parseCurrentLine(const string &line)
 							int restackSize = lastTempStack->size() - indexOfDo - 1;
 							for (int r = 0; r < restackSize; r++)
 							{
-								headerStack->push_back(lastTempStack->back());
+								headerStack.modify()->push_back(lastTempStack->back());
 								lastTempStack->pop_back();
 							}
 							if (!closingBracketReached)
@@ -2642,7 +2635,7 @@ void ASBeautifier::parseCurrentLine(const string &line)
 							int restackSize = lastTempStack->size() - indexOfTry - 1;
 							for (int r = 0; r < restackSize; r++)
 							{
-								headerStack->push_back(lastTempStack->back());
+								headerStack.modify()->push_back(lastTempStack->back());
 								lastTempStack->pop_back();
 							}
 
@@ -2689,7 +2682,7 @@ void ASBeautifier::parseCurrentLine(const string &line)
 
 				if (isIndentableHeader)
 				{
-					headerStack->push_back(newHeader);
+					headerStack.modify()->push_back(newHeader);
 					isInStatement = false;
 					if (indexOf(*nonParenHeaders, newHeader) == -1)
 					{
@@ -2705,17 +2698,17 @@ void ASBeautifier::parseCurrentLine(const string &line)
 				continue;
 			}  // newHeader != NULL
 
-			if (findHeader(line, i, preCommandHeaders))
+			if (findHeader(lineTokens, i, preCommandHeaders))
 				foundPreCommandHeader = true;
 
 			// Objective-C NSException macros are preCommandHeaders
-			if (isCStyle() && findKeyword(line, i, AS_NS_DURING))
+			if (isCStyle() && findKeyword(lineTokens, i, AS_NS_DURING))
 				foundPreCommandMacro = true;
-			if (isCStyle() && findKeyword(line, i, AS_NS_HANDLER))
+			if (isCStyle() && findKeyword(lineTokens, i, AS_NS_HANDLER))
 				foundPreCommandMacro = true;
 
 			// this applies only to C enums
-			if (isCStyle() && parenDepth == 0 && findKeyword(line, i, AS_ENUM))
+			if (isCStyle() && parenDepth == 0 && findKeyword(lineTokens, i, AS_ENUM))
 				isInEnum = true;
 
 		}   // isPotentialHeader
@@ -2762,7 +2755,7 @@ void ASBeautifier::parseCurrentLine(const string &line)
 			{
 				// do nothing special
 			}
-			else if (isDigit(peekNextChar(line, i)))
+			else if (isDigit(lineTokens.peekNextChar(i)))
 			{
 				// found a bit field
 				// so do nothing special
@@ -2794,7 +2787,6 @@ void ASBeautifier::parseCurrentLine(const string &line)
 			else
 			{
 				currentNonSpaceCh = ';'; // so that brackets after the ':' will appear as block-openers
-				char peekedChar = peekNextChar(line, i);
 				if (isInCase)
 				{
 					isInCase = false;
@@ -2814,10 +2806,10 @@ void ASBeautifier::parseCurrentLine(const string &line)
 		if ((ch == ';'  || (parenDepth > 0 && ch == ','))  && !inStatementIndentStackSizeStack->empty())
 			while ((int) inStatementIndentStackSizeStack->back() + (parenDepth > 0 ? 1 : 0)
 			        < (int) inStatementIndentStack->size())
-				inStatementIndentStack->pop_back();
+				inStatementIndentStack.modify()->pop_back();
 
 		else if (ch == ',' && isInEnum && isNonInStatementArray && !inStatementIndentStack->empty())
-			inStatementIndentStack->pop_back();
+			inStatementIndentStack.modify()->pop_back();
 
 		// handle commas
 		// previous "isInStatement" will be from an assignment operator or class initializer
@@ -2844,7 +2836,7 @@ void ASBeautifier::parseCurrentLine(const string &line)
 						if (firstChar != string::npos)
 						{
 							int inStatementIndent = firstWord + spaceIndentCount + tabIncrementIn;
-							inStatementIndentStack->push_back(inStatementIndent);
+							inStatementIndentStack.modify()->push_back(inStatementIndent);
 							isInStatement = true;
 						}
 					}
@@ -2854,7 +2846,7 @@ void ASBeautifier::parseCurrentLine(const string &line)
 				{
 					int prevWord = getInStatementIndentComma(line, i);
 					int inStatementIndent = prevWord + spaceIndentCount + tabIncrementIn;
-					inStatementIndentStack->push_back(inStatementIndent);
+					inStatementIndentStack.modify()->push_back(inStatementIndent);
 					isInStatement = true;
 				}
 			}
@@ -2869,7 +2861,7 @@ void ASBeautifier::parseCurrentLine(const string &line)
 				if (bracketBlockStateStack->size() > 1)
 				{
 					bool bracketBlockState = bracketBlockStateStack->back();
-					bracketBlockStateStack->pop_back();
+					bracketBlockStateStack.modify()->pop_back();
 					if (!bracketBlockState)
 					{
 						if (!inStatementIndentStackSizeStack->empty())
@@ -2883,7 +2875,7 @@ void ASBeautifier::parseCurrentLine(const string &line)
 							if (!parenIndentStack->empty())
 							{
 								int poppedIndent = parenIndentStack->back();
-								parenIndentStack->pop_back();
+								parenIndentStack.modify()->pop_back();
 								if (i == 0)
 									spaceIndentCount = poppedIndent;
 							}
@@ -2902,9 +2894,9 @@ void ASBeautifier::parseCurrentLine(const string &line)
 				if (!blockParenDepthStack->empty())
 				{
 					parenDepth = blockParenDepthStack->back();
-					blockParenDepthStack->pop_back();
+					blockParenDepthStack.modify()->pop_back();
 					isInStatement = blockStatementStack->back();
-					blockStatementStack->pop_back();
+					blockStatementStack.modify()->pop_back();
 
 					if (isInStatement)
 						blockTabCount--;
@@ -2922,13 +2914,13 @@ void ASBeautifier::parseCurrentLine(const string &line)
 					const string* popped = headerStack->back();
 					while (popped != &AS_OPEN_BRACKET)
 					{
-						headerStack->pop_back();
+						headerStack.modify()->pop_back();
 						popped = headerStack->back();
 					}
-					headerStack->pop_back();
+					headerStack.modify()->pop_back();
 
 					if (headerStack->empty())
-						g_preprocessorCppExternCBracket = 0;
+						*preprocessorCppExternCBracket = 0;
 
 					// do not indent namespace bracket unless namespaces are indented
 					if (!namespaceIndent && !headerStack->empty()
@@ -2937,11 +2929,7 @@ void ASBeautifier::parseCurrentLine(const string &line)
 						shouldIndentBrackettedLine = false;
 
 					if (!tempStacks->empty())
-					{
-						vector<const string*>* temp =  tempStacks->back();
-						tempStacks->pop_back();
-						delete temp;
-					}
+						tempStacks.modify()->pop_back();
 				}
 
 				ch = ' '; // needed due to cases such as '}else{', so that headers ('else' tn tih case) will be identified...
@@ -2956,13 +2944,16 @@ void ASBeautifier::parseCurrentLine(const string &line)
 			 * (such as a previous 'if' for an 'else' header) within the tempStacks,
 			 * and recreates the temporary snapshot by manipulating the tempStacks.
 			 */
-			if (!tempStacks->back()->empty())
-				while (!tempStacks->back()->empty())
-					tempStacks->back()->pop_back();
-			while (!headerStack->empty() && headerStack->back() != &AS_OPEN_BRACKET)
+			if (!tempStacks->back().empty()
+			        || (!headerStack->empty() && headerStack->back() != &AS_OPEN_BRACKET))
 			{
-				tempStacks->back()->push_back(headerStack->back());
-				headerStack->pop_back();
+				pmr::vector<const string*>* lastTempStack = &tempStacks.modify()->back();
+				lastTempStack->clear();
+				while (!headerStack->empty() && headerStack->back() != &AS_OPEN_BRACKET)
+				{
+					lastTempStack->push_back(headerStack->back());
+					headerStack.modify()->pop_back();
+				}
 			}
 
 			if (parenDepth == 0 && ch == ';')
@@ -2988,12 +2979,12 @@ void ASBeautifier::parseCurrentLine(const string &line)
 			// (otherwise 'struct XXX' statements would be wrongly interpreted...)
 			if (!isInTemplate && !(isCStyle() && parenDepth > 0))
 			{
-				const string* newHeader = findHeader(line, i, preBlockStatements);
+				const string* newHeader = findHeader(lineTokens, i, preBlockStatements);
 				if (newHeader != NULL
 				        && !(isCStyle() && newHeader == &AS_CLASS && isInEnum))	// is it 'enum class'
 				{
 					isInClassInitializer = true;
-					headerStack->push_back(newHeader);
+					headerStack.modify()->push_back(newHeader);
 					// do not need 'where' in the headerStack
 					// do not need second 'class' statement in a row
 					if (!(newHeader == &AS_WHERE
@@ -3002,14 +2993,14 @@ void ASBeautifier::parseCurrentLine(const string &line)
 						&& headerStack->back() == &AS_CLASS))
 					)
 					{
-						headerStack->push_back(newHeader);
+						headerStack.modify()->push_back(newHeader);
 					}
 					
 					i += newHeader->length() - 1;
 					continue;
 				}
 			}
-			const string* foundIndentableHeader = findHeader(line, i, indentableHeaders);
+			const string* foundIndentableHeader = findHeader(lineTokens, i, indentableHeaders);
 
 			if (foundIndentableHeader != NULL)
 			{
@@ -3023,37 +3014,37 @@ void ASBeautifier::parseCurrentLine(const string &line)
 				continue;
 			}
 
-			if (isCStyle() && findKeyword(line, i, AS_OPERATOR))
+			if (isCStyle() && findKeyword(lineTokens, i, AS_OPERATOR))
 				isInOperator = true;
 
-			if (g_preprocessorCppExternCBracket == 1 && findKeyword(line, i, AS_EXTERN))
-				++g_preprocessorCppExternCBracket;
+			if (*preprocessorCppExternCBracket == 1 && findKeyword(lineTokens, i, AS_EXTERN))
+				++*preprocessorCppExternCBracket;
 
-			if (g_preprocessorCppExternCBracket == 3)	// extern "C" is not followed by a '{'
-				g_preprocessorCppExternCBracket = 0;
+			if (*preprocessorCppExternCBracket == 3)	// extern "C" is not followed by a '{'
+				*preprocessorCppExternCBracket = 0;
 
 			// "new" operator is a pointer, not a calculation
-			if (findKeyword(line, i, AS_NEW))
+			if (findKeyword(lineTokens, i, AS_NEW))
 			{
 				if (isInStatement && !inStatementIndentStack->empty() && prevNonSpaceCh == '=' )
-					inStatementIndentStack->back() = 0;
+					inStatementIndentStack.modify()->back() = 0;
 			}
 
 			if (isCStyle())
 			{
-				if (findKeyword(line, i, AS_ASM)
-				        || findKeyword(line, i, AS__ASM__))
+				if (findKeyword(lineTokens, i, AS_ASM)
+				        || findKeyword(lineTokens, i, AS__ASM__))
 				{
 					isInAsm = true;
 				}
-				else if (findKeyword(line, i, AS_MS_ASM)		// microsoft specific
-				         || findKeyword(line, i, AS_MS__ASM))
+				else if (findKeyword(lineTokens, i, AS_MS_ASM)		// microsoft specific
+				         || findKeyword(lineTokens, i, AS_MS__ASM))
 				{
 					int index = 4;
-					if (peekNextChar(line, i) == '_')		// check for __asm
+					if (lineTokens.peekNextChar(i) == '_')		// check for __asm
 						index = 5;
 
-					char peekedChar = TRBase::peekNextChar(line, i + index);
+					char peekedChar = lineTokens.peekNextChar(i + index);
 					if (peekedChar == '{' || peekedChar == ' ')
 						isInAsmBlock = true;
 					else
@@ -3062,15 +3053,14 @@ void ASBeautifier::parseCurrentLine(const string &line)
 			}
 
 			// bypass the entire name for all others
-			string name = getCurrentWord(line, i);
-			i += name.length() - 1;
+			i += lineTokens.getWordLength(i) - 1;
 			continue;
 		}
 
 		// Handle Objective-C statements
 
 		if (ch == '@'
-		        && isCharPotentialHeader(line, i + 1))
+		        && lineTokens.isCharPotentialHeader(i + 1))
 		{
 			string curWord = getCurrentWord(line, i + 1);
 			if (curWord == AS_INTERFACE	&& headerStack->empty())
@@ -3103,7 +3093,7 @@ void ASBeautifier::parseCurrentLine(const string &line)
 			}
 		}
 		else if ((ch == '-' || ch == '+')
-		         && peekNextChar(line, i) == '('
+		         && lineTokens.peekNextChar(i) == '('
 		         && headerStack->empty()
 		         && line.find_first_not_of(" \t") == i)
 		{
@@ -3185,7 +3175,7 @@ void ASBeautifier::parseCurrentLine(const string &line)
 							haveAssignmentThisLine = true;
 							int prevWordIndex = getInStatementIndentAssign(line, i);
 							int inStatementIndent = prevWordIndex + spaceIndentCount + tabIncrementIn;
-							inStatementIndentStack->push_back(inStatementIndent);
+							inStatementIndentStack.modify()->push_back(inStatementIndent);
 						}
 					}
 					else
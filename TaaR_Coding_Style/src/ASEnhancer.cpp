@@ -85,6 +85,7 @@ void ASEnhancer::init(int  _fileType,
  */
 void ASEnhancer::enhance(string &line, bool isInPreprocessor, bool isInSQL)
 {
+	TRProfileTimer profileTimer(PROFILE_ENHANCE);
 	shouldUnindentLine = true;
 	shouldUnindentComment = false;
 	lineNumber++;
@@ -439,6 +440,9 @@ void ASEnhancer::parseCurrentLine(string &line, bool isInPreprocessor, bool isIn
 {
 	bool isSpecialChar = false;			// is a backslash escape character
 
+	// the keywords are found from the tokens
+	tokenizeLine(line, lineTokens);
+
 	for (size_t i = 0; i < line.length(); i++)
 	{
 		char ch = line[i];
@@ -540,26 +544,26 @@ void ASEnhancer::parseCurrentLine(string &line, bool isInPreprocessor, bool isIn
 		if (line[i] == '}')
 			bracketCount--;
 
-		bool isPotentialKeyword = isCharPotentialHeader(line, i);
+		bool isPotentialKeyword = lineTokens.isCharPotentialHeader(i);
 
 		// ----------------  wxWidgets and MFC macros  ----------------------------------
 
-		if (isPotentialKeyword)
+		if (isPotentialKeyword && (line[i] == 'B' || line[i] == 'E'))
 		{
-			if (findKeyword(line, i, "BEGIN_EVENT_TABLE")
-			        || findKeyword(line, i, "BEGIN_DISPATCH_MAP")
-			        || findKeyword(line, i, "BEGIN_EVENT_MAP")
-			        || findKeyword(line, i, "BEGIN_MESSAGE_MAP")
-			        || findKeyword(line, i, "BEGIN_PROPPAGEIDS"))
+			if (findKeyword(lineTokens, i, "BEGIN_EVENT_TABLE")
+			        || findKeyword(lineTokens, i, "BEGIN_DISPATCH_MAP")
+			        || findKeyword(lineTokens, i, "BEGIN_EVENT_MAP")
+			        || findKeyword(lineTokens, i, "BEGIN_MESSAGE_MAP")
+			        || findKeyword(lineTokens, i, "BEGIN_PROPPAGEIDS"))
 			{
 				nextLineIsEventIndent = true;
 				break;
 			}
-			if (findKeyword(line, i, "END_EVENT_TABLE")
-			        || findKeyword(line, i, "END_DISPATCH_MAP")
-			        || findKeyword(line, i, "END_EVENT_MAP")
-			        || findKeyword(line, i, "END_MESSAGE_MAP")
-			        || findKeyword(line, i, "END_PROPPAGEIDS"))
+			if (findKeyword(lineTokens, i, "END_EVENT_TABLE")
+			        || findKeyword(lineTokens, i, "END_DISPATCH_MAP")
+			        || findKeyword(lineTokens, i, "END_EVENT_MAP")
+			        || findKeyword(lineTokens, i, "END_MESSAGE_MAP")
+			        || findKeyword(lineTokens, i, "END_PROPPAGEIDS"))
 			{
 				isInEventTable = false;
 				break;
@@ -579,7 +583,7 @@ void ASEnhancer::parseCurrentLine(string &line, bool isInPreprocessor, bool isIn
 
 		// ----------------  process switch statements  ---------------------------------
 
-		if (isPotentialKeyword && findKeyword(line, i, "switch"))
+		if (isPotentialKeyword && findKeyword(lineTokens, i, TRResource::AS_SWITCH))
 		{
 			switchDepth++;
 			switchStack.push_back(sw);                      // save current variables
@@ -597,10 +601,7 @@ void ASEnhancer::parseCurrentLine(string &line, bool isInPreprocessor, bool isIn
 		{
 			// bypass the entire word
 			if (isPotentialKeyword)
-			{
-				string name = getCurrentWord(line, i);
-				i += name.length() - 1;
-			}
+				i += lineTokens.getWordLength(i) - 1;
 			continue;
 		}
 
@@ -619,7 +620,7 @@ void ASEnhancer::parseCurrentLine(string &line, bool isInPreprocessor, bool isIn
 size_t ASEnhancer::processSwitchBlock(string &line, size_t index)
 {
 	size_t i = index;
-	bool isPotentialKeyword = isCharPotentialHeader(line, i);
+	bool isPotentialKeyword = lineTokens.isCharPotentialHeader(i);
 
 	if (line[i] == '{')
 	{
@@ -647,7 +648,10 @@ size_t ASEnhancer::processSwitchBlock(string &line, size_t index)
 			if (shouldUnindentLine)
 			{
 				if (lineUnindent > 0)
+				{
 					i -= unindentLine(line, lineUnindent);
+					tokenizeLine(line, lineTokens);     // the line has changed
+				}
 				shouldUnindentLine = false;
 			}
 			switchDepth--;
@@ -658,7 +662,8 @@ size_t ASEnhancer::processSwitchBlock(string &line, size_t index)
 	}
 
 	if (isPotentialKeyword
-	        && (findKeyword(line, i, "case") || findKeyword(line, i, "default")))
+	        && (findKeyword(lineTokens, i, TRResource::AS_CASE)
+	            || findKeyword(lineTokens, i, TRResource::AS_DEFAULT)))
 	{
 		if (sw.unindentCase)					// if unindented last case
 		{
@@ -691,8 +696,7 @@ size_t ASEnhancer::processSwitchBlock(string &line, size_t index)
 	}
 	if (isPotentialKeyword)
 	{
-		string name = getCurrentWord(line, i);          // bypass the entire name
-		i += name.length() - 1;
+		i += lineTokens.getWordLength(i) - 1;          // bypass the entire name
 	}
 	return i;
 }
@@ -11,6 +11,12 @@
 #include <algorithm>
 #include <fstream>
 
+// SSE2 is used to find the end of the text in comments and quotes
+#if defined(__SSE2__) || defined(_M_X64)
+	#define TR_USE_SSE2
+	#include <emmintrin.h>
+#endif
+
 namespace TaaRRule {
 /**
  * Constructor of TRFormatter
@@ -24,6 +30,7 @@ TRFormatter::TRFormatter()
 	parenStack = NULL;
 	structStack = NULL;
 	questionMarkStack = NULL;
+	setFileMemory(fileArena.getResource());
 	lineCommentNoIndent = false;
 	formattingStyle = STYLE_NONE;
 	bracketFormatMode = NONE_MODE;
@@ -64,13 +71,13 @@ TRFormatter::TRFormatter()
 
 	// initialize TRFormatter member vectors
 	formatterFileType = 9;		// reset to an invalid type
-	headers = new vector<const string*>;
-	nonParenHeaders = new vector<const string*>;
-	preDefinitionHeaders = new vector<const string*>;
-	preCommandHeaders = new vector<const string*>;
-	operators = new vector<const string*>;
-	assignmentOperators = new vector<const string*>;
-	castOperators = new vector<const string*>;
+	headers = new TRKeywordList;
+	nonParenHeaders = new TRKeywordList;
+	preDefinitionHeaders = new TRKeywordList;
+	preCommandHeaders = new TRKeywordList;
+	operators = new TRKeywordList;
+	assignmentOperators = new TRKeywordList;
+	castOperators = new TRKeywordList;
 }
 
 /**
@@ -78,12 +85,9 @@ TRFormatter::TRFormatter()
  */
 TRFormatter::~TRFormatter()
 {
-	// delete TRFormatter stack vectors
-	deleteContainer(preBracketHeaderStack);
-	deleteContainer(bracketTypeStack);
-	deleteContainer(parenStack);
-	deleteContainer(structStack);
-	deleteContainer(questionMarkStack);
+	// delete TRFormatter and ASBeautifier stack vectors
+	// must be done before the file arena is deleted
+	releaseFileStacks();
 
 	// delete TRFormatter member vectors
 	formatterFileType = 9;		// reset to an invalid type
@@ -117,6 +121,7 @@ void TRFormatter::init(TRSourceIterator* si)
 	buildLanguageVectors();
 	fixOptionVariableConflicts();
 
+	releaseFileStacks();
 	ASBeautifier::init(si);
 	enhancer->init(getFileType(),
 	               getIndentLength(),
@@ -127,13 +132,14 @@ void TRFormatter::init(TRSourceIterator* si)
 	               getPreprocDefineIndent(),
 	               getEmptyLineFill());
 	sourceIterator = si;
+	lookAhead.init(si);
 
-	initContainer(preBracketHeaderStack, new vector<const string*>);
-	initContainer(parenStack, new vector<int>);
-	initContainer(structStack, new vector<bool>);
-	initContainer(questionMarkStack, new vector<bool>);
+	initContainer(preBracketHeaderStack);
+	initContainer(parenStack);
+	initContainer(structStack);
+	initContainer(questionMarkStack);
 	parenStack->push_back(0);               // parenStack must contain this default entry
-	initContainer(bracketTypeStack, new vector<BracketType>);
+	initContainer(bracketTypeStack);
 	bracketTypeStack->push_back(NULL_TYPE); // bracketTypeStack must contain this default entry
 	clearFormattedLineSplitPoints();
 
@@ -249,6 +255,13 @@ void TRFormatter::init(TRSourceIterator* si)
 	isImmediatelyPostHeader = false;
 	isInHeader = false;
 	isInCase = false;
+	shouldTurnFormattingOff = false;
+	isFormattingModeOff = false;
+	isFormattingOffBalanced = true;
+	isImmediatelyPostFormattingOff = false;
+	hasFormattingOffFirstLine = false;
+	isLineUnformatted = false;
+	formattingOffLineCount = 0;
 }
 
 /**
@@ -393,6 +406,7 @@ void TRFormatter::fixOptionVariableConflicts()
  */
 string TRFormatter::nextLine()
 {
+	TRProfileTimer profileTimer(PROFILE_FORMAT);
 	const string* newHeader;
 	bool isInVirginLine = isVirgin;
 	isCharImmediatelyPostComment = false;
@@ -401,10 +415,24 @@ string TRFormatter::nextLine()
 	isCharImmediatelyPostOpenBlock = false;
 	isCharImmediatelyPostCloseBlock = false;
 	isCharImmediatelyPostTemplate = false;
+	isLineUnformatted = false;
 	traceLineNumber++;
 
+	if (isFormattingModeOff && !isLineReady)
+		return nextFormattingOffLine();
+
 	while (!isLineReady)
 	{
+		// the line with an INDENT-OFF marker is ended before the region is copied
+		if (shouldTurnFormattingOff
+		        && !isInComment
+		        && !isInLineComment
+		        && currentLine.find_first_not_of(" \t", charNum + 1) == string::npos)
+		{
+			turnFormattingOff();
+			continue;
+		}
+
 		if (shouldReparseCurrentChar)
 			shouldReparseCurrentChar = false;
 		else if (!getNextChar())
@@ -922,10 +950,16 @@ string TRFormatter::nextLine()
 		// reset block handling flags
 		isImmediatelyPostEmptyBlock = false;
 
-		// look for headers
+		// look for headers, a number literal is never one
 		bool isPotentialHeader = isCharPotentialHeader(currentLine, charNum);
+		bool isNumberLiteral = isPotentialHeader && isDigit(currentChar);
 
-		if (isPotentialHeader && !isInTemplate && !squareBracketCount)
+		if (isNumberLiteral && !isInTemplate && !squareBracketCount)
+		{
+			isNonParenHeader = false;
+			foundClosingHeader = false;
+		}
+		else if (isPotentialHeader && !isInTemplate && !squareBracketCount)
 		{
 			isNonParenHeader = false;
 			foundClosingHeader = false;
@@ -1175,6 +1209,16 @@ string TRFormatter::nextLine()
 		if (currentChar == '?')
 			foundQuestionMark = true;
 
+		// append a number literal without the keyword lookups,
+		// the rows of generated array initializers are mostly numbers
+		if (isNumberLiteral && !isInTemplate)
+		{
+			string number = getCurrentWord(currentLine, charNum);
+			appendSequence(number);
+			goForward(number.length() - 1);
+			continue;
+		}
+
 		if (isPotentialHeader && !isInTemplate)
 		{
 			if (findKeyword(currentLine, charNum, AS_NEW))
@@ -1456,6 +1500,283 @@ string TRFormatter::nextLine()
 	return beautifiedLine;
 }
 
+/**
+ * end the line with an INDENT-OFF marker and find the region
+ * of lines to be copied unchanged.
+ * the calling function should have a continue statement after calling this method
+ */
+void TRFormatter::turnFormattingOff()
+{
+	shouldTurnFormattingOff = false;
+	breakLine();
+	isFormattingOffBalanced = findFormattingOffRegion(formattingOffLineCount);
+	// the marker is on the last line
+	if (formattingOffLineCount == 0)
+	{
+		endOfCodeReached = true;
+		return;
+	}
+	isFormattingModeOff = true;
+	if (!isFormattingOffBalanced)
+	{
+		FormattingOffScan scan = { 0, 0, 0, false, false, false, false, previousCommandChar };
+		formattingOffScan = scan;
+	}
+	// the input is read one line ahead of the output, as for the formatted lines,
+	// so the file compare checks the marker line with its input line
+	formattingOffFirstLine = sourceIterator->nextLine();
+	lookAhead.nextLine();
+	hasFormattingOffFirstLine = true;
+}
+
+/**
+ * get the next line of a formatting-off region.
+ * the line is not formatted or indented.
+ * a balanced region leaves the formatter and the beautifier as they were before the region.
+ * the lines of an unbalanced region are parsed by the beautifier
+ * and update the formatter brackets, so the code after the region is indented correctly.
+ *
+ * @return    the unchanged line.
+ */
+string TRFormatter::nextFormattingOffLine()
+{
+	string line;
+	if (hasFormattingOffFirstLine)
+	{
+		line.swap(formattingOffFirstLine);
+		hasFormattingOffFirstLine = false;
+	}
+	else
+	{
+		line = sourceIterator->nextLine();
+		lookAhead.nextLine();
+	}
+	assert(computeChecksumIn(line));
+	inLineNumber++;
+	isLineUnformatted = true;
+
+	if (!isFormattingOffBalanced)
+	{
+		scanFormattingOffLine(line, formattingOffScan, true);
+		string beautifiedLine = beautify(line);
+		enhancer->enhance(beautifiedLine, isInPreprocessorBeautify, isInBeautifySQL);
+	}
+
+	// the line with the INDENT-ON marker ends the region
+	if (--formattingOffLineCount == 0 || !sourceIterator->hasMoreLines())
+	{
+		isFormattingModeOff = false;
+		isImmediatelyPostFormattingOff = true;
+		endOfCodeReached = !sourceIterator->hasMoreLines();
+		if (!isFormattingOffBalanced)
+		{
+			isInComment = formattingOffScan.isInComment;
+			if (formattingOffScan.lastCodeChar != ' ')
+				previousCommandChar = previousNonWSChar = formattingOffScan.lastCodeChar;
+		}
+	}
+
+	assert(computeChecksumOut(line));
+	return line;
+}
+
+/**
+ * find the lines of a formatting-off region following the current line.
+ * the region ends with the line containing an INDENT-ON marker, or the end of input.
+ * a region is balanced if it closes the brackets, parens, and preprocessor conditionals
+ * it opens, and it ends a statement if the code before it does. in an array the
+ * elements are statements. the lines of a balanced region are not parsed.
+ *
+ * @param lineCount     receives the number of lines in the region.
+ * @return              true if the region is balanced or ends the input.
+ */
+bool TRFormatter::findFormattingOffRegion(size_t &lineCount)
+{
+	const char* statementEnds = isBracketType(bracketTypeStack->back(), ARRAY_TYPE) ? " ;{}," : " ;{}";
+	bool isStatementEndBefore = (strchr(statementEnds, previousCommandChar) != NULL);
+	FormattingOffScan scan = { 0, 0, 0, false, false, false, false, ' ' };
+	for (lineCount = 0; lookAhead.hasLine(lineCount); )
+	{
+		const string &line = lookAhead.getLine(lineCount++);
+		scanFormattingOffLine(line, scan, false);
+		if (scan.isOnMarkerFound)
+			return (scan.bracketDepth == 0
+			        && scan.parenDepth == 0
+			        && scan.preprocDepth == 0
+			        && !scan.isOuterClosed
+			        && !scan.isInComment
+			        && !scan.isContinued
+			        && (scan.lastCodeChar == ' '
+			            || (strchr(statementEnds, scan.lastCodeChar) != NULL) == isStatementEndBefore));
+	}
+	return true;
+}
+
+/**
+ * scan a line of a formatting-off region for the brackets, parens, comments,
+ * and preprocessor conditionals. a quote ends at the end of the line.
+ * the brackets in preprocessor lines are not counted.
+ * an INDENT-ON marker is found only at the start of a comment, as the INDENT-OFF marker.
+ *
+ * @param line                  the unformatted line.
+ * @param scan                  the state of the scan.
+ * @param shouldUpdateBrackets  update the formatter brackets from the line.
+ */
+void TRFormatter::scanFormattingOffLine(const string &line, FormattingOffScan &scan,
+                                        bool shouldUpdateBrackets)
+{
+	bool isPreprocessorLine = scan.isContinued;
+	bool isLineStart = !scan.isContinued;
+	char quote = ' ';
+	size_t commentStart = 0;        // the start of the comment text on the line
+	scan.isOnMarkerFound = false;
+
+	for (size_t i = 0; i < line.length(); i++)
+	{
+		char ch = line[i];
+		if (scan.isInComment)
+		{
+			if (ch == '*' && i + 1 < line.length() && line[i + 1] == '/')
+			{
+				if (isFormattingOffMarker(line, "*INDENT-ON*", commentStart, i))
+					scan.isOnMarkerFound = true;
+				scan.isInComment = false;
+				i++;
+			}
+			continue;
+		}
+		if (quote != ' ')
+		{
+			if (ch == '\\')
+				i++;
+			else if (ch == quote)
+				quote = ' ';
+			continue;
+		}
+		if (ch == ' ' || ch == '\t')
+			continue;
+		if (ch == '/' && i + 1 < line.length() && line[i + 1] == '/')
+		{
+			if (isFormattingOffMarker(line, "*INDENT-ON*", i + 2, line.length()))
+				scan.isOnMarkerFound = true;
+			break;
+		}
+		if (ch == '/' && i + 1 < line.length() && line[i + 1] == '*')
+		{
+			scan.isInComment = true;
+			commentStart = i + 2;
+			i++;
+			continue;
+		}
+		if (ch == '"' || ch == '\'')
+		{
+			quote = ch;
+			continue;
+		}
+
+		if (ch == '#' && isLineStart)
+		{
+			isPreprocessorLine = true;
+			size_t word = line.find_first_not_of(" \t", i + 1);
+			if (word != string::npos && line.compare(word, 2, "if") == 0)
+				scan.preprocDepth++;
+			else if (word != string::npos && line.compare(word, 5, "endif") == 0)
+			{
+				if (--scan.preprocDepth < 0)
+					scan.isOuterClosed = true;
+			}
+		}
+		isLineStart = false;
+		if (isPreprocessorLine)
+			continue;
+		char prevCodeChar = scan.lastCodeChar;
+		scan.lastCodeChar = ch;
+
+		if (ch == '{')
+		{
+			scan.bracketDepth++;
+			if (!shouldUpdateBrackets)
+				continue;
+			// the bracket type is estimated from the previous code
+			BracketType bracketType = DEFINITION_TYPE;
+			if (prevCodeChar == '='
+			        || (isBracketType(bracketTypeStack->back(), ARRAY_TYPE)
+			            && (prevCodeChar == ',' || prevCodeChar == '{')))
+				bracketType = ARRAY_TYPE;
+			else if (prevCodeChar == ')'
+			         || isBracketType(bracketTypeStack->back(), COMMAND_TYPE))
+				bracketType = COMMAND_TYPE;
+			bracketTypeStack->push_back(bracketType);
+			preBracketHeaderStack->push_back(currentHeader);
+			currentHeader = NULL;
+			structStack->push_back(isInIndentableStruct);
+			isInIndentableStruct = false;
+			if (bracketType != ARRAY_TYPE)
+				parenStack->push_back(0);
+		}
+		else if (ch == '}')
+		{
+			if (--scan.bracketDepth < 0)
+				scan.isOuterClosed = true;
+			if (!shouldUpdateBrackets || bracketTypeStack->size() <= 1)
+				continue;
+			previousBracketType = bracketTypeStack->back();
+			bracketTypeStack->pop_back();
+			if (!isBracketType(previousBracketType, ARRAY_TYPE) && parenStack->size() > 1)
+				parenStack->pop_back();
+			if (!preBracketHeaderStack->empty())
+			{
+				currentHeader = preBracketHeaderStack->back();
+				preBracketHeaderStack->pop_back();
+			}
+			if (!structStack->empty())
+			{
+				isInIndentableStruct = structStack->back();
+				structStack->pop_back();
+			}
+		}
+		else if (ch == '(' || ch == '[')
+		{
+			scan.parenDepth++;
+			if (shouldUpdateBrackets)
+				parenStack->back()++;
+		}
+		else if (ch == ')' || ch == ']')
+		{
+			if (--scan.parenDepth < 0)
+				scan.isOuterClosed = true;
+			if (shouldUpdateBrackets && parenStack->back() > 0)
+				parenStack->back()--;
+		}
+	}
+
+	if (scan.isInComment && isFormattingOffMarker(line, "*INDENT-ON*", commentStart, line.length()))
+		scan.isOnMarkerFound = true;
+	scan.isContinued = (isPreprocessorLine
+	                    && !line.empty()
+	                    && line[line.length() - 1] == '\\');
+}
+
+/**
+ * check for a formatting-off marker at the start of the comment text of a line.
+ * the marker must be the first text, so a comment that mentions a marker is not used.
+ *
+ * @param line          the line.
+ * @param marker        the INDENT-OFF or INDENT-ON marker, with the asterisks.
+ * @param start         the start of the comment text.
+ * @param end           the end of the comment text.
+ * @return              true if the comment text begins with the marker.
+ */
+bool TRFormatter::isFormattingOffMarker(const string &line, const char* marker,
+                                        size_t start, size_t end) const
+{
+	size_t found = line.find_first_not_of(" \t", start);
+	size_t markerLength = strlen(marker);
+	return (found != string::npos
+	        && found + markerLength <= end
+	        && line.compare(found, markerLength, marker) == 0);
+}
+
 
 /**
  * check if there are any indented lines ready to be read by nextLine()
@@ -2039,6 +2360,7 @@ bool TRFormatter::getNextLine(bool emptyLineWasDeleted /*false*/)
 		else
 		{
 			currentLine = sourceIterator->nextLine(emptyLineWasDeleted);
+			lookAhead.nextLine();
 			assert(computeChecksumIn(currentLine));
 		}
 		// reset variables for new line
@@ -2068,7 +2390,8 @@ bool TRFormatter::getNextLine(bool emptyLineWasDeleted /*false*/)
 		// REMOVE AT AN APPROPRIATE TIME
 		if ((currentHeader == &AS_CASE || currentHeader == &AS_DEFAULT)
 		        && isInLineBreak
-		        && !isImmediatelyPostLineComment)
+		        && !isImmediatelyPostLineComment
+		        && !isImmediatelyPostFormattingOff)
 		{
 			// check for split line
 			if ((formattedLine.length() >= 4
@@ -2276,6 +2599,60 @@ void TRFormatter::appendChar(char ch, bool canBreakLine)
 	}
 }
 
+/**
+ * Append the text of the current line from charNum to spanEnd in one operation.
+ * Used for the text in comments and quotes when the lines are not split.
+ * charNum and currentChar are set to the last character appended.
+ *
+ * @param spanEnd          the position following the last character to append.
+ */
+void TRFormatter::appendSpan(size_t spanEnd)
+{
+	assert(maxCodeLength == string::npos);
+	assert(spanEnd > (size_t) charNum && spanEnd <= currentLine.length());
+
+	if (isInLineBreak)
+		breakLine();
+
+	formattedLine.append(currentLine, charNum, spanEnd - charNum);
+	isImmediatelyPostCommentOnly = false;
+	charNum = spanEnd - 1;
+	currentChar = currentLine[charNum];
+}
+
+/**
+ * Find the end of the text on the current line that can be appended by appendSpan.
+ * The line is checked 16 characters at a time if SSE2 is available.
+ *
+ * @param start            the position to begin the search.
+ * @param ch1              a character that ends the text.
+ * @param ch2              another character that ends the text.
+ * @return                 the position of the first ch1 or ch2, or the line length.
+ */
+size_t TRFormatter::findSpanEnd(size_t start, char ch1, char ch2) const
+{
+	const char* line = currentLine.data();
+	const size_t lineLength = currentLine.length();
+	size_t i = start;
+#ifdef TR_USE_SSE2
+	const __m128i match1 = _mm_set1_epi8(ch1);
+	const __m128i match2 = _mm_set1_epi8(ch2);
+	for (; i + 16 <= lineLength; i += 16)
+	{
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line + i));
+		__m128i found = _mm_or_si128(_mm_cmpeq_epi8(block, match1), _mm_cmpeq_epi8(block, match2));
+		if (_mm_movemask_epi8(found) != 0)
+			break;
+	}
+#endif
+	for (; i < lineLength; i++)
+	{
+		if (line[i] == ch1 || line[i] == ch2)
+			break;
+	}
+	return i;
+}
+
 /**
  * Append a string sequence to the current formatted line.
  * The formattedLine split points are NOT updated.
@@ -2364,6 +2741,17 @@ void TRFormatter::appendSpaceAfter()
  */
 void TRFormatter::breakLine(bool isSplitLine /*false*/)
 {
+	// the lines before the text following a formatting-off region have been output
+	if (isImmediatelyPostFormattingOff)
+	{
+		if (formattedLine.empty() && !endOfCodeReached)
+		{
+			isInLineBreak = false;
+			return;
+		}
+		isImmediatelyPostFormattingOff = false;
+	}
+
 	isLineReady = true;
 	isInLineBreak = false;
 	spacePadNum = nextLineSpacePadNum;
@@ -2936,69 +3324,16 @@ int TRFormatter::isOneLineBlockReached(string &line, int startChar) const
 
 /**
  * get the next non-whitespace substring on following lines, bypassing all comments.
+ * the following lines are taken from the look-ahead window.
  *
  * @param   the first line to check
+ * @param   true if an empty line ends the search
+ * @param   the index in the look-ahead window of the line following the first line
  * @return  the next non-whitespace substring.
  */
-string TRFormatter::peekNextText(const string &firstLine, bool endOnEmptyLine /*false*/, bool shouldReset /*false*/) const
+string TRFormatter::peekNextText(const string &firstLine, bool endOnEmptyLine /*false*/, size_t lookAheadIndex /*0*/) const
 {
-	bool isFirstLine = true;
-	bool needReset = shouldReset;
-	string nextLine_ = firstLine;
-	size_t firstChar = string::npos;
-
-	// find the first non-blank text, bypassing all comments.
-	bool isInComment_ = false;
-	while (sourceIterator->hasMoreLines() || isFirstLine)
-	{
-		if (isFirstLine)
-			isFirstLine = false;
-		else
-		{
-			nextLine_ = sourceIterator->peekNextLine();
-			needReset = true;
-		}
-
-		firstChar = nextLine_.find_first_not_of(" \t");
-		if (firstChar == string::npos)
-		{
-			if (endOnEmptyLine && !isInComment_)
-				break;
-			continue;
-		}
-
-		if (nextLine_.compare(firstChar, 2, "/*") == 0)
-		{
-			firstChar += 2;
-			isInComment_ = true;
-		}
-
-		if (isInComment_)
-		{
-			firstChar = nextLine_.find("*/", firstChar);
-			if (firstChar == string::npos)
-				continue;
-			firstChar += 2;
-			isInComment_ = false;
-			firstChar = nextLine_.find_first_not_of(" \t", firstChar);
-			if (firstChar == string::npos)
-				continue;
-		}
-
-		if (nextLine_.compare(firstChar, 2, "//") == 0)
-			continue;
-
-		// found the next text
-		break;
-	}
-
-	if (firstChar == string::npos)
-		nextLine_ = "";
-	else
-		nextLine_ = nextLine_.substr(firstChar);
-	if (needReset)
-		sourceIterator->peekReset();
-	return nextLine_;
+	return lookAhead.findNextText(firstLine, lookAheadIndex, endOnEmptyLine);
 }
 
 /**
@@ -4333,59 +4668,48 @@ void TRFormatter::formatArrayRunIn()
 }
 
 /**
- * delete a bracketTypeStack vector object
- * BracketTypeStack did not work with the DeleteContainer template
- */
-void TRFormatter::deleteContainer(vector<BracketType>* &container)
-{
-	if (container != NULL)
-	{
-		container->clear();
-		delete (container);
-		container = NULL;
-	}
-}
-
-/**
- * delete a vector object
+ * delete a vector object created in the file arena
  * T is the type of vector
- * used for all vectors except bracketTypeStack
  */
 template<typename T>
-void TRFormatter::deleteContainer(T &container)
+void TRFormatter::deleteContainer(T* &container)
 {
 	if (container != NULL)
 	{
-		container->clear();
-		delete (container);
+		TRFileArena::deleteStack(container, fileArena.getResource());
 		container = NULL;
 	}
 }
 
 /**
- * initialize a BracketType vector object
- * BracketType did not work with the DeleteContainer template
+ * initialize a vector object in the file arena
+ * T is the type of vector
  */
-void TRFormatter::initContainer(vector<BracketType>* &container, vector<BracketType>* value)
+template<typename T>
+void TRFormatter::initContainer(T* &container)
 {
+	// since the TRFormatter object is never deleted,
+	// the existing vectors must be deleted before creating new ones
 	if (container != NULL)
 		deleteContainer(container);
-	container = value;
+	container = TRFileArena::newStack<T>(fileArena.getResource());
 }
 
 /**
- * initialize a vector object
- * T is the type of vector
- * used for all vectors except bracketTypeStack
+ * delete the stacks of the formatted file and reset the file arena.
+ * the memory used by the stacks is released in one step instead of
+ * deleting each element. Called when the file is done. It is also
+ * called by init() in case the previous file was not released.
  */
-template<typename T>
-void TRFormatter::initContainer(T &container, T value)
+void TRFormatter::releaseFileStacks()
 {
-	// since the TRFormatter object is never deleted,
-	// the existing vectors must be deleted before creating new ones
-	if (container != NULL)
-		deleteContainer(container);
-	container = value;
+	deleteContainer(preBracketHeaderStack);
+	deleteContainer(bracketTypeStack);
+	deleteContainer(parenStack);
+	deleteContainer(structStack);
+	deleteContainer(questionMarkStack);
+	ASBeautifier::releaseStacks();
+	fileArena.reset();
 }
 
 /**
@@ -4492,20 +4816,17 @@ bool TRFormatter::commentAndHeaderFollows()
 	assert(shouldDeleteEmptyLines && shouldBreakBlocks);
 
 	// is the next line a comment
-	if (!sourceIterator->hasMoreLines())
+	if (!lookAhead.hasLine(0))
 		return false;
-	string nextLine_ = sourceIterator->peekNextLine();
+	const string &nextLine_ = lookAhead.getLine(0);
 	size_t firstChar = nextLine_.find_first_not_of(" \t");
 	if (firstChar == string::npos
 	        || !(nextLine_.compare(firstChar, 2, "//") == 0
 	             || nextLine_.compare(firstChar, 2, "/*") == 0))
-	{
-		sourceIterator->peekReset();
 		return false;
-	}
 
-	// find the next non-comment text, and reset
-	string nextText = peekNextText(nextLine_, false, true);
+	// find the next non-comment text
+	string nextText = peekNextText(nextLine_, false, 1);
 	if (nextText.length() == 0 || !isCharPotentialHeader(nextText, 0))
 		return false;
 
@@ -4636,7 +4957,11 @@ void TRFormatter::formatCommentBody()
 		}
 		if (currentChar == '\t' && shouldConvertTabs)
 			convertTabToSpaces();
-		appendCurrentChar();
+		// append the text to the next '*' or tab in one operation
+		if (maxCodeLength == string::npos)
+			appendSpan(findSpanEnd(charNum + 1, '*', shouldConvertTabs ? '\t' : '*'));
+		else
+			appendCurrentChar();
 		++charNum;
 	}
 	if (shouldStripCommentPrefix)
@@ -4657,6 +4982,16 @@ void TRFormatter::formatCommentOpener()
 	if (previousNonWSChar == '}')
 		resetEndOfStatement();
 
+	// a formatting-off marker is used if nothing follows the comment on the line
+	size_t commentEnd = currentLine.find("*/", charNum + 2);
+	if (commentEnd != string::npos
+	        && !appendOpeningBracket
+	        && currentLine.find_first_not_of(" \t", commentEnd + 2) == string::npos)
+	{
+		if (isFormattingOffMarker(currentLine, "*INDENT-OFF*", charNum + 2, commentEnd))
+			shouldTurnFormattingOff = true;
+	}
+
 	// Check for a following header.
 	// For speed do not check multiple comment lines more than once.
 	// For speed do not check shouldBreakBlocks if previous line is empty, a comment, or a '{'.
@@ -4776,7 +5111,16 @@ void TRFormatter::formatLineCommentBody()
 		currentChar = currentLine[charNum];
 		if (currentChar == '\t' && shouldConvertTabs)
 			convertTabToSpaces();
-		appendCurrentChar();
+		// append the text to the next tab or the end of line in one operation
+		if (maxCodeLength == string::npos)
+		{
+			if (shouldConvertTabs)
+				appendSpan(findSpanEnd(charNum + 1, '\t', '\t'));
+			else
+				appendSpan(currentLine.length());
+		}
+		else
+			appendCurrentChar();
 		++charNum;
 	}
 
@@ -4807,6 +5151,9 @@ void TRFormatter::formatLineCommentOpener()
 	isCharImmediatelyPostComment = false;
 	if (previousNonWSChar == '}')
 		resetEndOfStatement();
+	if (!appendOpeningBracket
+	        && isFormattingOffMarker(currentLine, "*INDENT-OFF*", charNum + 2, currentLine.length()))
+		shouldTurnFormattingOff = true;
 
 	// Check for a following header.
 	// For speed do not check multiple comment lines more than once.
@@ -4962,6 +5309,16 @@ void TRFormatter::formatQuoteBody()
 	// tabs in quotes are NOT changed by convert-tabs
 	if (isInQuote && currentChar != '\\')
 	{
+		if (maxCodeLength == string::npos)
+		{
+			size_t spanEnd = findSpanEnd(charNum + 1, quoteChar, '\\');
+			if (spanEnd > (size_t) charNum + 1)
+			{
+				++charNum;
+				appendSpan(spanEnd);
+			}
+			return;
+		}
 		while (charNum + 1 < (int) currentLine.length()
 		        && currentLine[charNum + 1] != quoteChar
 		        && currentLine[charNum + 1] != '\\')
@@ -5223,7 +5580,7 @@ bool TRFormatter::removeBracketsFromStatement()
 		return false;
 
 	bool isFirstLine = true;
-	bool needReset = false;
+	size_t lookAheadIndex = 0;
 	string nextLine_;
 	// leave nextLine_ empty if end of line comment follows
 	if (!isBeforeAnyLineEndComment(charNum) || currentLineBeginsWithBracket)
@@ -5231,15 +5588,14 @@ bool TRFormatter::removeBracketsFromStatement()
 	size_t nextChar = 0;
 
 	// find the first non-blank text
-	while (sourceIterator->hasMoreLines() || isFirstLine)
+	while (lookAhead.hasLine(lookAheadIndex) || isFirstLine)
 	{
 		if (isFirstLine)
 			isFirstLine = false;
 		else
 		{
-			nextLine_ = sourceIterator->peekNextLine();
+			nextLine_ = lookAhead.getLine(lookAheadIndex++);
 			nextChar = 0;
-			needReset = true;
 		}
 
 		nextChar = nextLine_.find_first_not_of(" \t", nextChar);
@@ -5252,52 +5608,37 @@ bool TRFormatter::removeBracketsFromStatement()
 	        || (nextLine_.compare(nextChar, 2, "//") == 0)
 	        || (isCharPotentialHeader(nextLine_, nextChar)
 	            && ASBeautifier::findHeader(nextLine_, nextChar, headers) != NULL))
-	{
-		if (needReset)
-			sourceIterator->peekReset();
 		return false;
-	}
 
 	// find the next semi-colon
 	size_t nextSemiColon = nextChar;
 	if (nextLine_[nextChar] != ';')
 		nextSemiColon = findNextChar(nextLine_, ';', nextChar + 1);
 	if (nextSemiColon == string::npos)
-	{
-		if (needReset)
-			sourceIterator->peekReset();
 		return false;
-	}
 
 	// find the closing bracket
 	isFirstLine = true;
 	nextChar = nextSemiColon + 1;
-	while (sourceIterator->hasMoreLines() || isFirstLine)
+	while (lookAhead.hasLine(lookAheadIndex) || isFirstLine)
 	{
 		if (isFirstLine)
 			isFirstLine = false;
 		else
 		{
-			nextLine_ = sourceIterator->peekNextLine();
+			nextLine_ = lookAhead.getLine(lookAheadIndex++);
 			nextChar = 0;
-			needReset = true;
 		}
 		nextChar = nextLine_.find_first_not_of(" \t", nextChar);
 		if (nextChar != string::npos)
 			break;
 	}
 	if (nextLine_.length() == 0 || nextLine_[nextChar] != '}')
-	{
-		if (needReset)
-			sourceIterator->peekReset();
 		return false;
-	}
 
 	// remove opening bracket
 	currentLine[charNum] = currentChar = ' ';
 	assert(adjustChecksumIn(-'{'));
-	if (needReset)
-		sourceIterator->peekReset();
 	return true;
 }
 
@@ -5369,7 +5710,7 @@ bool TRFormatter::isStructAccessModified(string  &firstLine, size_t index) const
 	assert(isCStyle());
 
 	bool isFirstLine = true;
-	bool needReset = false;
+	size_t lookAheadIndex = 0;
 	size_t bracketCount = 1;
 	string nextLine_ = firstLine.substr(index + 1);
 
@@ -5377,15 +5718,12 @@ bool TRFormatter::isStructAccessModified(string  &firstLine, size_t index) const
 	bool isInComment_ = false;
 	bool isInQuote_ = false;
 	char quoteChar_ = ' ';
-	while (sourceIterator->hasMoreLines() || isFirstLine)
+	while (lookAhead.hasLine(lookAheadIndex) || isFirstLine)
 	{
 		if (isFirstLine)
 			isFirstLine = false;
 		else
-		{
-			nextLine_ = sourceIterator->peekNextLine();
-			needReset = true;
-		}
+			nextLine_ = lookAhead.getLine(lookAheadIndex++);
 		// parse the line
 		for (size_t i = 0; i < nextLine_.length(); i++)
 		{
@@ -5432,30 +5770,20 @@ bool TRFormatter::isStructAccessModified(string  &firstLine, size_t index) const
 			if (nextLine_[i] == '}')
 				--bracketCount;
 			if (bracketCount == 0)
-			{
-				if (needReset)
-					sourceIterator->peekReset();
 				return false;
-			}
 			// check for access modifiers
 			if (isCharPotentialHeader(nextLine_, i))
 			{
 				if (findKeyword(nextLine_, i, AS_PUBLIC)
 				        || findKeyword(nextLine_, i, AS_PRIVATE)
 				        || findKeyword(nextLine_, i, AS_PROTECTED))
-				{
-					if (needReset)
-						sourceIterator->peekReset();
 					return true;
-				}
 				string name = getCurrentWord(nextLine_, i);
 				i += name.length() - 1;
 			}
 		}	// end of for loop
 	}	// end of while loop
 
-	if (needReset)
-		sourceIterator->peekReset();
 	return false;
 }
 
@@ -5607,7 +5935,7 @@ void TRFormatter::checkIfTemplateOpener()
 	}
 
 	bool isFirstLine = true;
-	bool needReset = false;
+	size_t lookAheadIndex = 0;
 	int parenDepth_ = 0;
 	int maxTemplateDepth = 0;
 	templateDepth = 0;
@@ -5617,15 +5945,12 @@ void TRFormatter::checkIfTemplateOpener()
 	bool isInComment_ = false;
 	bool isInQuote_ = false;
 	char quoteChar_ = ' ';
-	while (sourceIterator->hasMoreLines() || isFirstLine)
+	while (lookAhead.hasLine(lookAheadIndex) || isFirstLine)
 	{
 		if (isFirstLine)
 			isFirstLine = false;
 		else
-		{
-			nextLine_ = sourceIterator->peekNextLine();
-			needReset = true;
-		}
+			nextLine_ = lookAhead.getLine(lookAheadIndex++);
 		// parse the line
 		for (size_t i = 0; i < nextLine_.length(); i++)
 		{
@@ -5686,7 +6011,7 @@ void TRFormatter::checkIfTemplateOpener()
 						isInTemplate = true;
 						templateDepth = maxTemplateDepth;
 					}
-					goto exitFromSearch;
+					return;
 				}
 				continue;
 			}
@@ -5700,14 +6025,14 @@ void TRFormatter::checkIfTemplateOpener()
 					continue;
 				// this is not a template -> leave...
 				isInTemplate = false;
-				goto exitFromSearch;
+				return;
 			}
 			else if (nextLine_.compare(i, 2, AS_AND) == 0
 			         || nextLine_.compare(i, 2, AS_OR) == 0)
 			{
 				// this is not a template -> leave...
 				isInTemplate = false;
-				goto exitFromSearch;
+				return;
 			}
 			else if (currentChar_ == ','  // comma,     e.g. A<int, char>
 			         || currentChar_ == '&'    // reference, e.g. A<int&>
@@ -5727,17 +6052,12 @@ void TRFormatter::checkIfTemplateOpener()
 			{
 				// this is not a template -> leave...
 				isInTemplate = false;
-				goto exitFromSearch;
+				return;
 			}
 			string name = getCurrentWord(nextLine_, i);
 			i += name.length() - 1;
 		}	// end of for loop
 	}	// end of while loop
-
-	// goto needed to exit from two loops
-exitFromSearch:
-	if (needReset)
-		sourceIterator->peekReset();
 }
 
 void TRFormatter::updateFormattedLineSplitPoints(char appendedChar)
@@ -6212,6 +6532,15 @@ bool TRFormatter::getIsLineReady() const
 	return isLineReady;
 }
 
+/**
+ * check if the last line from nextLine() was copied unchanged from a formatting-off region.
+ * the input is not read one line ahead in a region, so the line is not compared to the input.
+ */
+bool TRFormatter::getIsLineUnformatted() const
+{
+	return isLineUnformatted;
+}
+
 /**
  * get the value of checksumOut for unit testing
  *
@@ -6465,4 +6794,198 @@ void TRFormatter::stripCommentPrefix()
 	}
 }
 
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+ *                           TRLookAhead Functions
+ * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/**
+ * initialize the look-ahead window for a new file.
+ *
+ * @param si        a pointer to the source iterator of the formatter.
+ */
+void TRLookAhead::init(TRSourceIterator* si)
+{
+	sourceIterator = si;
+	lines.clear();
+	firstLineNumber = 0;
+	isEndOfInput = false;
+}
+
+/**
+ * the formatter has read the next line from the source iterator.
+ * the line is removed from the look-ahead window.
+ */
+void TRLookAhead::nextLine()
+{
+	if (!lines.empty())
+		lines.pop_front();
+	firstLineNumber++;
+}
+
+/**
+ * check if a line following the current line exists.
+ *
+ * @param index     the index of the line, 0 is the line following the current line.
+ * @return          true if the line exists.
+ */
+bool TRLookAhead::hasLine(size_t index)
+{
+	peekLines(index + 1);
+	return (index < lines.size());
+}
+
+/**
+ * get a line following the current line.
+ * hasLine() must be checked before this is called.
+ *
+ * @param index     the index of the line, 0 is the line following the current line.
+ * @return          a reference to the line.
+ */
+const string &TRLookAhead::getLine(size_t index)
+{
+	peekLines(index + 1);
+	assert(index < lines.size());
+	return lines[index].text;
+}
+
+/**
+ * peek the lines from the source iterator until the window has a number of lines.
+ * the window is at least doubled, so the source iterator peeks
+ * each line a limited number of times.
+ *
+ * @param lineCount     the number of lines needed in the window.
+ */
+void TRLookAhead::peekLines(size_t lineCount)
+{
+	if (lines.size() >= lineCount || isEndOfInput)
+		return;
+	if (!sourceIterator->hasMoreLines())
+	{
+		isEndOfInput = true;
+		return;
+	}
+	size_t peekCount = max(lineCount, lines.size() * 2);
+	// the source iterator peeks from the current line, bypass the lines in the window
+	for (size_t i = 0; i < lines.size(); i++)
+		sourceIterator->peekNextLine();
+	while (lines.size() < peekCount && sourceIterator->hasMoreLines())
+	{
+		lines.push_back(LookAheadLine());
+		LookAheadLine &line = lines.back();
+		line.text = sourceIterator->peekNextLine();
+		line.isNextTextFound[0] = line.isNextTextFound[1] = false;
+	}
+	if (!sourceIterator->hasMoreLines())
+		isEndOfInput = true;
+	sourceIterator->peekReset();
+}
+
+/**
+ * find the next non-whitespace text on a line, bypassing all comments.
+ *
+ * @param line          the line to search.
+ * @param textStart     set to the start of the text. if the text is not found
+ *                      this is the start of a line comment, or npos.
+ * @param isInComment   true if the search begins in a comment,
+ *                      set to true if the line ends in a comment.
+ * @return              true if the text is found.
+ */
+bool TRLookAhead::findTextOnLine(const string &line, size_t &textStart, bool &isInComment) const
+{
+	size_t firstChar = line.find_first_not_of(" \t");
+	textStart = string::npos;
+	if (firstChar == string::npos)
+		return false;
+
+	if (line.compare(firstChar, 2, "/*") == 0)
+	{
+		firstChar += 2;
+		isInComment = true;
+	}
+
+	if (isInComment)
+	{
+		firstChar = line.find("*/", firstChar);
+		if (firstChar == string::npos)
+			return false;
+		firstChar += 2;
+		isInComment = false;
+		firstChar = line.find_first_not_of(" \t", firstChar);
+		if (firstChar == string::npos)
+			return false;
+	}
+
+	textStart = firstChar;
+	if (line.compare(firstChar, 2, "//") == 0)
+		return false;
+	return true;
+}
+
+/**
+ * get the next non-whitespace text beginning with a line, bypassing all comments.
+ * the lines following the first line are searched thru the look-ahead window.
+ * the text found is saved for each line searched, so the lines are not
+ * searched again by a following call.
+ *
+ * @param firstLine         the first line to check.
+ * @param index             the index in the window of the line following firstLine.
+ * @param endOnEmptyLine    true if an empty line outside a comment ends the search.
+ * @return                  the next non-whitespace text, or an empty string.
+ */
+string TRLookAhead::findNextText(const string &firstLine, size_t index, bool endOnEmptyLine)
+{
+	bool isInComment = false;
+	size_t textStart;
+	bool isEmptyLine = (firstLine.find_first_not_of(" \t") == string::npos);
+	if (findTextOnLine(firstLine, textStart, isInComment))
+		return firstLine.substr(textStart);
+	if (isEmptyLine && endOnEmptyLine)
+		return string();
+	// a line comment is returned if it is at the end of the input
+	if (!hasLine(index))
+		return (textStart == string::npos) ? string() : firstLine.substr(textStart);
+
+	// search the lines until the text is found or a line has been searched before
+	searchPath.clear();
+	NextText nextText;
+	for (size_t i = index; ; i++)
+	{
+		LookAheadLine &line = lines[i];
+		if (line.isNextTextFound[isInComment])
+		{
+			nextText = line.nextText[isInComment];
+			break;
+		}
+		SearchedLine searched = { i, isInComment, false };
+		searched.isEmptyLine = (!isInComment
+		                        && line.text.find_first_not_of(" \t") == string::npos);
+		searchPath.push_back(searched);
+		bool isTextFound = findTextOnLine(line.text, textStart, isInComment);
+		if (isTextFound || !hasLine(i + 1))
+		{
+			nextText.lineNumber = firstLineNumber + i;
+			nextText.textStart = textStart;
+			nextText.isEmptyLineFirst = false;
+			break;
+		}
+	}
+
+	// save the text for the lines searched
+	for (size_t i = searchPath.size(); i-- > 0;)
+	{
+		const SearchedLine &searched = searchPath[i];
+		if (searched.isEmptyLine)
+			nextText.isEmptyLineFirst = true;
+		LookAheadLine &line = lines[searched.index];
+		line.nextText[searched.isInComment] = nextText;
+		line.isNextTextFound[searched.isInComment] = true;
+	}
+
+	if (endOnEmptyLine && nextText.isEmptyLineFirst)
+		return string();
+	if (nextText.textStart == string::npos)
+		return string();
+	return lines[nextText.lineNumber - firstLineNumber].text.substr(nextText.textStart);
+}
+
 }   // end namespace TaaRRule
@@ -8,8 +8,12 @@
  * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
  */
 #include "TRLanguage.h"
-#include <windows.h>
+#ifdef _WIN32
+	#include <windows.h>
+#endif
 #include <cassert>
+#include <cctype>
+#include <clocale>
 #include <cstdio>
 #include <iostream>
 #include <stdlib.h>
@@ -39,8 +43,12 @@ TRLanguage::TRLanguage()
 		setTranslationClass();
 		return;
 	}
+#ifdef _WIN32
 	size_t lcid = GetUserDefaultLCID();
 	setLanguageFromLCID(lcid);
+#else
+	setLanguageFromName(localeName);
+#endif
 }
 
 // Delete dynamically allocated memory.
@@ -49,6 +57,8 @@ TRLanguage::~TRLanguage()
 	delete m_translation;
 }
 
+#ifdef _WIN32
+
 struct WinLangCode
 {
 	size_t winLang;
@@ -83,6 +93,28 @@ void TRLanguage::setLanguageFromLCID(size_t lcid)
 	setTranslationClass();
 }
 
+#endif	// _WIN32
+
+// Linux set the language to use from the locale name.
+// The locale name has the form lang[_LANG][.encoding][@modifier]
+// (see environ(5) in the Open Group Base Specifications for UNIX).
+// The "C" and "POSIX" locales use english.
+void TRLanguage::setLanguageFromName(const char* localeName)
+{
+	m_lcid = 0;
+	m_localeName = localeName;
+	m_langID = "en";		// default to english
+
+	string langStr = localeName;
+	if (langStr.length() >= 2 && langStr != "C" && langStr != "POSIX")
+	{
+		m_langID = langStr.substr(0, 2);
+		for (size_t i = 0; i < m_langID.length(); i++)
+			m_langID[i] = (char) tolower((unsigned char) m_langID[i]);
+	}
+	setTranslationClass();
+}
+
 // Returns the language ID in m_langID.
 string TRLanguage::getLanguageID() const
 {
@@ -97,11 +129,12 @@ const Translation* TRLanguage::getTranslationClass() const
 }
 
 // Call the settext class and return the value.
+// The returned text is owned by the translation class or is textIn,
+// so it may be called from any thread.
 const char* TRLanguage::settext(const char* textIn) const
 {
 	assert(m_translation);
-	const string stringIn = textIn;
-	return m_translation->translate(stringIn).c_str();
+	return m_translation->translate(textIn);
 }
 
 void TRLanguage::setTranslationClass()
@@ -128,10 +161,12 @@ void TRLanguage::setTranslationClass()
 //----------------------------------------------------------------------------
 
 // Add a string pair to the translation vector.
+// The multi-byte translation is converted once when the pair is added.
 void Translation::addPair(const string &english, const wstring &translated)
 {
 	pair<string, wstring> entry (english, translated);
 	m_translation.push_back(entry);
+	m_mbTranslation.push_back(convertToMultiByte(translated));
 }
 
 // Convert wchar_t to a multibyte string using the currently assigned locale.
@@ -191,24 +226,22 @@ bool Translation::getWideTranslation(const string &stringIn, wstring &wideOut) c
 }
 
 // Translate a string.
-// Return a static string instead of a member variable so the method can have a "const" designation.
-// This allows "settext" to be called from a "const" method.
-string &Translation::translate(const string &stringIn) const
+// Return the multi-byte translation converted by addPair.
+// Nothing is changed so the method can be called from "const" methods and threads.
+const char* Translation::translate(const char* textIn) const
 {
-	static string mbTranslation;
-	mbTranslation.clear();
 	for (size_t i = 0; i < m_translation.size(); i++)
 	{
-		if (m_translation[i].first == stringIn)
+		if (m_translation[i].first == textIn)
 		{
-			mbTranslation = convertToMultiByte(m_translation[i].second);
-			break;
+			// not converted, return english
+			if (m_mbTranslation[i].empty())
+				break;
+			return m_mbTranslation[i].c_str();
 		}
 	}
 	// not found, return english
-	if (mbTranslation.empty())
-		mbTranslation = stringIn;
-	return mbTranslation;
+	return textIn;
 }
 
 //----------------------------------------------------------------------------
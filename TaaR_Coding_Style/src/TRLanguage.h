@@ -31,7 +31,10 @@ class TRLanguage
 		virtual ~TRLanguage();
 		string getLanguageID() const;
 		const Translation* getTranslationClass() const;
+#ifdef _WIN32
 		void setLanguageFromLCID(size_t lcid);
+#endif
+		void setLanguageFromName(const char* localeName);
 		const char* settext(const char* textIn) const;
 
 	private:	// functions
@@ -60,12 +63,13 @@ class Translation
 		string convertToMultiByte(const wstring &wideStr) const;
 		size_t getTranslationVectorSize() const;
 		bool getWideTranslation(const string &stringIn, wstring &wideOut) const;
-		string &translate(const string &stringIn) const;
+		const char* translate(const char* textIn) const;
 
 	protected:
 		void addPair(const string &english, const wstring &translated);
 		// variables
 		vector<pair<string, wstring> > m_translation;		// translation vector
+		vector<string> m_mbTranslation;						// multi-byte translations of the vector
 };
 
 //----------------------------------------------------------------------------
@@ -165,13 +165,43 @@ bool sortOnName(const string* a, const string* b)
 	return *a < *b;
 }
 
+/**
+ * Sort comparison function.
+ * Compares the first character of the strings. Used with
+ * stable_sort to group the entries without changing their order.
+ *
+ * @params the string pointers to be compared.
+ */
+bool sortOnFirstChar(const string* a, const string* b)
+{
+	return (unsigned char) (*a)[0] < (unsigned char) (*b)[0];
+}
+
+/**
+ * Build the first character index of a keyword list.
+ * Called by the build functions after the list is sorted.
+ */
+void TRKeywordList::buildIndex()
+{
+	assert(size() < 256);
+	stable_sort(begin(), end(), sortOnFirstChar);
+	clearIndex();
+	for (size_t i = size(); i-- > 0;)
+	{
+		unsigned char ch = (unsigned char) (*(*this)[i])[0];
+		if (indexEnd[ch] == 0)
+			indexEnd[ch] = (unsigned char) (i + 1);
+		indexStart[ch] = (unsigned char) i;
+	}
+}
+
 /**
  * Build the vector of assignment operators.
  * Used by BOTH TRFormatter.cpp and ASBeautifier.cpp
  *
  * @param assignmentOperators   a reference to the vector to be built.
  */
-void TRResource::buildAssignmentOperators(vector<const string*>* assignmentOperators)
+void TRResource::buildAssignmentOperators(TRKeywordList* assignmentOperators)
 {
 	assignmentOperators->push_back(&AS_ASSIGN);
 	assignmentOperators->push_back(&AS_PLUS_ASSIGN);
@@ -187,6 +217,7 @@ void TRResource::buildAssignmentOperators(vector<const string*>* assignmentOpera
 	assignmentOperators->push_back(&AS_LS_LS_LS_ASSIGN);
 
 	sort(assignmentOperators->begin(), assignmentOperators->end(), sortOnLength);
+	assignmentOperators->buildIndex();
 }
 
 /**
@@ -195,12 +226,13 @@ void TRResource::buildAssignmentOperators(vector<const string*>* assignmentOpera
  *
  * @param castOperators     a reference to the vector to be built.
  */
-void TRResource::buildCastOperators(vector<const string*>* castOperators)
+void TRResource::buildCastOperators(TRKeywordList* castOperators)
 {
 	castOperators->push_back(&AS_CONST_CAST);
 	castOperators->push_back(&AS_DYNAMIC_CAST);
 	castOperators->push_back(&AS_REINTERPRET_CAST);
 	castOperators->push_back(&AS_STATIC_CAST);
+	castOperators->buildIndex();
 }
 
 /**
@@ -209,7 +241,7 @@ void TRResource::buildCastOperators(vector<const string*>* castOperators)
  *
  * @param headers       a reference to the vector to be built.
  */
-void TRResource::buildHeaders(vector<const string*>* headers, bool beautifier)
+void TRResource::buildHeaders(TRKeywordList* headers, bool beautifier)
 {
 	headers->push_back(&AS_IF);
 	headers->push_back(&AS_ELSE);
@@ -231,6 +263,7 @@ void TRResource::buildHeaders(vector<const string*>* headers, bool beautifier)
 		headers->push_back(&AS_TEMPLATE);
 	}
 	sort(headers->begin(), headers->end(), sortOnName);
+	headers->buildIndex();
 }
 
 /**
@@ -239,11 +272,12 @@ void TRResource::buildHeaders(vector<const string*>* headers, bool beautifier)
  *
  * @param indentableHeaders     a reference to the vector to be built.
  */
-void TRResource::buildIndentableHeaders(vector<const string*>* indentableHeaders)
+void TRResource::buildIndentableHeaders(TRKeywordList* indentableHeaders)
 {
 	indentableHeaders->push_back(&AS_RETURN);
 
 	sort(indentableHeaders->begin(), indentableHeaders->end(), sortOnName);
+	indentableHeaders->buildIndex();
 }
 
 /**
@@ -252,7 +286,7 @@ void TRResource::buildIndentableHeaders(vector<const string*>* indentableHeaders
  *
  * @param nonAssignmentOperators       a reference to the vector to be built.
  */
-void TRResource::buildNonAssignmentOperators(vector<const string*>* nonAssignmentOperators)
+void TRResource::buildNonAssignmentOperators(TRKeywordList* nonAssignmentOperators)
 {
 	nonAssignmentOperators->push_back(&AS_EQUAL);
 	nonAssignmentOperators->push_back(&AS_PLUS_PLUS);
@@ -270,6 +304,7 @@ void TRResource::buildNonAssignmentOperators(vector<const string*>* nonAssignmen
 	nonAssignmentOperators->push_back(&AS_LAMBDA);
 
 	sort(nonAssignmentOperators->begin(), nonAssignmentOperators->end(), sortOnLength);
+	nonAssignmentOperators->buildIndex();
 }
 
 /**
@@ -279,7 +314,7 @@ void TRResource::buildNonAssignmentOperators(vector<const string*>* nonAssignmen
  *
  * @param nonParenHeaders       a reference to the vector to be built.
  */
-void TRResource::buildNonParenHeaders(vector<const string*>* nonParenHeaders, bool beautifier)
+void TRResource::buildNonParenHeaders(TRKeywordList* nonParenHeaders, bool beautifier)
 {
 	nonParenHeaders->push_back(&AS_ELSE);
 	nonParenHeaders->push_back(&AS_DO);
@@ -295,6 +330,7 @@ void TRResource::buildNonParenHeaders(vector<const string*>* nonParenHeaders, bo
 		nonParenHeaders->push_back(&AS_TEMPLATE);
 	}
 	sort(nonParenHeaders->begin(), nonParenHeaders->end(), sortOnName);
+	nonParenHeaders->buildIndex();
 }
 
 /**
@@ -303,7 +339,7 @@ void TRResource::buildNonParenHeaders(vector<const string*>* nonParenHeaders, bo
  *
  * @param operators             a reference to the vector to be built.
  */
-void TRResource::buildOperators(vector<const string*>* operators)
+void TRResource::buildOperators(TRKeywordList* operators)
 {
 	operators->push_back(&AS_PLUS_ASSIGN);
 	operators->push_back(&AS_MINUS_ASSIGN);
@@ -352,6 +388,7 @@ void TRResource::buildOperators(vector<const string*>* operators)
 	operators->push_back(&AS_GCC_MAX_ASSIGN);
 	
 	sort(operators->begin(), operators->end(), sortOnLength);
+	operators->buildIndex();
 }
 
 /**
@@ -361,7 +398,7 @@ void TRResource::buildOperators(vector<const string*>* operators)
  *
  * @param preBlockStatements        a reference to the vector to be built.
  */
-void TRResource::buildPreBlockStatements(vector<const string*>* preBlockStatements)
+void TRResource::buildPreBlockStatements(TRKeywordList* preBlockStatements)
 {
 	preBlockStatements->push_back(&AS_CLASS);
 	preBlockStatements->push_back(&AS_STRUCT);
@@ -369,6 +406,7 @@ void TRResource::buildPreBlockStatements(vector<const string*>* preBlockStatemen
 	preBlockStatements->push_back(&AS_NAMESPACE);
 		
 	sort(preBlockStatements->begin(), preBlockStatements->end(), sortOnName);
+	preBlockStatements->buildIndex();
 }
 
 /**
@@ -380,7 +418,7 @@ void TRResource::buildPreBlockStatements(vector<const string*>* preBlockStatemen
  * the closing paren and the opening bracket.
  * e.g. in "void foo() const {}", "const" is a preCommandHeader.
  */
-void TRResource::buildPreCommandHeaders(vector<const string*>* preCommandHeaders)
+void TRResource::buildPreCommandHeaders(TRKeywordList* preCommandHeaders)
 {
 	preCommandHeaders->push_back(&AS_CONST);
 	preCommandHeaders->push_back(&AS_VOLATILE);
@@ -388,6 +426,7 @@ void TRResource::buildPreCommandHeaders(vector<const string*>* preCommandHeaders
 	preCommandHeaders->push_back(&AS_OVERRIDE);		// Visual C only
 
 	sort(preCommandHeaders->begin(), preCommandHeaders->end(), sortOnName);
+	preCommandHeaders->buildIndex();
 }
 
 /**
@@ -398,7 +437,7 @@ void TRResource::buildPreCommandHeaders(vector<const string*>* preCommandHeaders
  *
  * @param preDefinitionHeaders      a reference to the vector to be built.
  */
-void TRResource::buildPreDefinitionHeaders(vector<const string*>* preDefinitionHeaders)
+void TRResource::buildPreDefinitionHeaders(TRKeywordList* preDefinitionHeaders)
 {
 	preDefinitionHeaders->push_back(&AS_CLASS);
 	preDefinitionHeaders->push_back(&AS_STRUCT);
@@ -406,6 +445,7 @@ void TRResource::buildPreDefinitionHeaders(vector<const string*>* preDefinitionH
 	preDefinitionHeaders->push_back(&AS_NAMESPACE);
 	
 	sort(preDefinitionHeaders->begin(), preDefinitionHeaders->end(), sortOnName);
+	preDefinitionHeaders->buildIndex();
 }
 
 /* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
@@ -421,6 +461,8 @@ bool TRBase::findKeyword(const string &line, int i, const string &keyword) const
 	const size_t wordEnd = i + keywordLength;
 	if (wordEnd > line.length())
 		return false;
+	if (line[i] != keyword[0])
+		return false;
 	if (line.compare(i, keywordLength, keyword) != 0)
 		return false;
 	// check that this is not part of a longer word
@@ -435,6 +477,25 @@ bool TRBase::findKeyword(const string &line, int i, const string &keyword) const
 	return true;
 }
 
+// check if a specific line position contains a keyword.
+// the keyword must contain only name characters, the tokens
+// are used instead of searching the line
+bool TRBase::findKeyword(const TRLineTokens &tokens, size_t i, const string &keyword) const
+{
+	assert(tokens.isCharPotentialHeader(i));
+	const string &line = tokens.getLine();
+	// the word must be the keyword, not part of a longer word
+	if (tokens.getWordLength(i) != keyword.length())
+		return false;
+	if (line.compare(i, keyword.length(), keyword) != 0)
+		return false;
+	// is not a keyword if part of a definition
+	const char peekChar = tokens.peekNextChar(i + keyword.length() - 1);
+	if (peekChar == ',' || peekChar == ')')
+		return false;
+	return true;
+}
+
 // get the current word on a line
 // index must point to the beginning of the word
 string TRBase::getCurrentWord(const string &line, size_t index) const
@@ -450,4 +511,28 @@ string TRBase::getCurrentWord(const string &line, size_t index) const
 	return line.substr(index, i - index);
 }
 
+// build the word and whitespace tables for a line
+// the tables are built from the end of the line in one pass
+void TRBase::tokenizeLine(const string &line, TRLineTokens &tokens) const
+{
+	const size_t lineLength = line.length();
+	tokens.tokenLine = &line;
+	tokens.wordLength.resize(lineLength);
+	tokens.nextCharIndex.resize(lineLength);
+	uint32_t wordLength = 0;
+	uint32_t nextCharIndex = (uint32_t) lineLength;
+	for (size_t i = lineLength; i-- > 0;)
+	{
+		const char ch = line[i];
+		if (isLegalNameChar(ch))
+			wordLength++;
+		else
+			wordLength = 0;
+		if (!isWhiteSpace(ch))
+			nextCharIndex = (uint32_t) i;
+		tokens.wordLength[i] = wordLength;
+		tokens.nextCharIndex[i] = nextCharIndex;
+	}
+}
+
 }   // end namespace TaaRRule
@@ -10,9 +10,14 @@
 #ifndef __TAARRULE_H__
 #define __TAARRULE_H__
 
+#include <atomic>
 #include <cassert>
 #include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <deque>
 #include <iostream>
+#include <memory_resource>
 #include <string>
 #include <vector>
 
@@ -23,8 +28,12 @@
 // define STDCALL and EXPORT for Windows
 // MINGW defines STDCALL in Windows.h (actually windef.h)
 // define STDCALL and EXPORT for non-Windows
-#ifndef STDCALL
-	#define STDCALL __stdcall
+#ifdef _WIN32
+	#ifndef STDCALL
+		#define STDCALL __stdcall
+	#endif
+#else
+	#define STDCALL
 #endif
 #define EXPORT
 
@@ -135,6 +144,17 @@ enum LineEndFormat
 	LINEEND_CR   = LINEEND_MACOLD
 };
 
+enum ProfilePhase
+{
+	PROFILE_DISCOVER,	// finding the files, getFilePaths
+	PROFILE_READ,		// reading and decoding the files, readFile
+	PROFILE_FORMAT,		// TRFormatter::nextLine, includes beautify and enhance
+	PROFILE_BEAUTIFY,	// ASBeautifier::beautify
+	PROFILE_ENHANCE,	// ASEnhancer::enhance
+	PROFILE_WRITE,		// writing the files, writeFile
+	PROFILE_PHASES		// number of phases
+};
+
 
 //-----------------------------------------------------------------------------
 // Class TRSourceIterator
@@ -155,6 +175,31 @@ class TRSourceIterator
 		virtual void peekReset() = 0;
 };
 
+//-----------------------------------------------------------------------------
+// Class TRKeywordList
+// a vector of header or operator pointers indexed by the first character
+// buildIndex() groups the entries by the first character and keeps the
+// order within each group, so the lookup functions check only the entries
+// that can match and the sort order of the vector is unchanged
+//-----------------------------------------------------------------------------
+
+class TRKeywordList : public vector<const string*>
+{
+	public:
+		TRKeywordList() { clearIndex(); }
+		void buildIndex();
+		void clear() { vector<const string*>::clear(); clearIndex(); }
+
+	private:
+		void clearIndex() { memset(indexStart, 0, sizeof(indexStart)); memset(indexEnd, 0, sizeof(indexEnd)); }
+		unsigned char indexStart[256];  // first entry for a character
+		unsigned char indexEnd[256];    // one past the last entry for a character
+
+	public:	// inline functions
+		size_t getIndexStart(char ch) const { return indexStart[(unsigned char) ch]; }
+		size_t getIndexEnd(char ch) const { return indexEnd[(unsigned char) ch]; }
+};
+
 //-----------------------------------------------------------------------------
 // Class TRResource
 //-----------------------------------------------------------------------------
@@ -164,16 +209,16 @@ class TRResource
 	public:
 		TRResource() {}
 		virtual ~TRResource() {}
-		void buildAssignmentOperators(vector<const string*>* assignmentOperators);
-		void buildCastOperators(vector<const string*>* castOperators);
-		void buildHeaders(vector<const string*>* headers, bool beautifier = false);
-		void buildIndentableHeaders(vector<const string*>* indentableHeaders);
-		void buildNonAssignmentOperators(vector<const string*>* nonAssignmentOperators);
-		void buildNonParenHeaders(vector<const string*>* nonParenHeaders, bool beautifier = false);
-		void buildOperators(vector<const string*>* operators);
-		void buildPreBlockStatements(vector<const string*>* preBlockStatements);
-		void buildPreCommandHeaders(vector<const string*>* preCommandHeaders);
-		void buildPreDefinitionHeaders(vector<const string*>* preDefinitionHeaders);
+		void buildAssignmentOperators(TRKeywordList* assignmentOperators);
+		void buildCastOperators(TRKeywordList* castOperators);
+		void buildHeaders(TRKeywordList* headers, bool beautifier = false);
+		void buildIndentableHeaders(TRKeywordList* indentableHeaders);
+		void buildNonAssignmentOperators(TRKeywordList* nonAssignmentOperators);
+		void buildNonParenHeaders(TRKeywordList* nonParenHeaders, bool beautifier = false);
+		void buildOperators(TRKeywordList* operators);
+		void buildPreBlockStatements(TRKeywordList* preBlockStatements);
+		void buildPreCommandHeaders(TRKeywordList* preCommandHeaders);
+		void buildPreDefinitionHeaders(TRKeywordList* preDefinitionHeaders);
 
 	public:
 		static const string AS_IF, AS_ELSE;
@@ -215,6 +260,43 @@ class TRResource
 		static const string AS_NS_DURING, AS_NS_HANDLER;
 };  // Class TRResource
 
+//-----------------------------------------------------------------------------
+// Class TRLineTokens
+// the word and whitespace tables of a line being parsed
+// TRBase::tokenizeLine() builds them in one pass over the line so the parse
+// loops can check the headers and peek the next character without scanning
+// the line again. The line must not be changed while the tables are used.
+//-----------------------------------------------------------------------------
+
+class TRLineTokens
+{
+	public:
+		TRLineTokens() : tokenLine(NULL) { }
+		const string &getLine() const { assert(tokenLine != NULL); return *tokenLine; }
+		// the length of the name characters beginning at index i
+		size_t getWordLength(size_t i) const { return (i < wordLength.size()) ? wordLength[i] : 0; }
+		// the index of the first non-whitespace character at or after index i
+		size_t getNextCharIndex(size_t i) const {
+			return (i < nextCharIndex.size()) ? nextCharIndex[i] : nextCharIndex.size();
+		}
+		// same as TRBase::peekNextChar() without the find_first_not_of
+		char peekNextChar(size_t i) const {
+			size_t peekNum = getNextCharIndex(i + 1);
+			if (peekNum >= nextCharIndex.size())
+				return ' ';
+			return (*tokenLine)[peekNum];
+		}
+		bool isCharPotentialHeader(size_t i) const {
+			return (getWordLength(i) > 0 && (i == 0 || wordLength[i - 1] == 0));
+		}
+
+	private:
+		friend class TRBase;
+		const string* tokenLine;
+		vector<uint32_t> wordLength;       // length of the name beginning at an index
+		vector<uint32_t> nextCharIndex;    // next non-whitespace index, line length if none
+};
+
 //-----------------------------------------------------------------------------
 // Class TRBase
 //-----------------------------------------------------------------------------
@@ -231,7 +313,9 @@ class TRBase
 
 		// functions definitions are at the end of TRResource.cpp
 		bool findKeyword(const string &line, int i, const string &keyword) const;
+		bool findKeyword(const TRLineTokens &tokens, size_t i, const string &keyword) const;
 		string getCurrentWord(const string &line, size_t index) const;
+		void tokenizeLine(const string &line, TRLineTokens &tokens) const;
 
 	protected:
 		void init(int fileTypeArg) { baseFileType = fileTypeArg; }
@@ -288,6 +372,200 @@ class TRBase
 		}
 };  // Class TRBase
 
+//-----------------------------------------------------------------------------
+// Class TRFileArena
+// the memory for the stacks of the file being formatted
+// the stacks are taken from a monotonic arena and the pool on top of it
+// reuses the stacks freed by the preprocessor beautifiers within the file
+// all of the memory is returned in one reset when the file is done
+// each formatter has its own arena so the threads do not share an allocator
+//-----------------------------------------------------------------------------
+
+class TRFileArena
+{
+	public:
+		TRFileArena() : arena(initialBuffer, sizeof(initialBuffer)), pool(&arena) {}
+
+		// return all of the memory to the arena
+		// the stacks using the arena must be deleted before this is called
+		void reset() {
+			pool.release();
+			arena.release();
+		}
+
+		// create a stack object in the memory, the stack uses the memory for its elements
+		template<typename T>
+		static T* newStack(pmr::memory_resource* memory) {
+			return new (memory->allocate(sizeof(T), alignof(T))) T(memory);
+		}
+
+		// delete a stack object created by newStack()
+		template<typename T>
+		static void deleteStack(T* stack, pmr::memory_resource* memory) {
+			stack->~T();
+			memory->deallocate(stack, sizeof(T), alignof(T));
+		}
+
+	private:
+		TRFileArena(const TRFileArena &);             // copy constructor not to be implemented
+		TRFileArena &operator=(const TRFileArena &);  // assignment operator not to be implemented
+
+		char initialBuffer[16384];                // used before the arena allocates from the heap
+		pmr::monotonic_buffer_resource arena;
+		pmr::unsynchronized_pool_resource pool;
+
+	public:	// inline functions
+		pmr::memory_resource* getResource() { return &pool; }
+};
+
+//-----------------------------------------------------------------------------
+// Class TRSharedStack
+// a copy-on-write pointer to an ASBeautifier stack
+// the beautifiers cloned for preprocessor statements share the stacks with
+// the original until one of them changes a stack, so a clone does not
+// copy a stack that is never changed
+// the stack is read thru -> and *, modify() must be called to change it
+//-----------------------------------------------------------------------------
+
+template<typename T>
+class TRSharedStack
+{
+	public:
+		TRSharedStack() : shared(NULL) {}
+		TRSharedStack(const TRSharedStack &other) : shared(other.shared) {
+			if (shared != NULL)
+				shared->refCount++;
+		}
+		~TRSharedStack() { release(); }
+
+		// create a new empty stack in the file memory
+		void init(pmr::memory_resource* memory) {
+			release();
+			shared = TRFileArena::newStack<SharedStack>(memory);
+		}
+
+		// get a stack that is not shared so it can be changed
+		T* modify() {
+			assert(shared != NULL);
+			if (shared->refCount > 1)
+			{
+				SharedStack* copy = TRFileArena::newStack<SharedStack>(shared->getMemory());
+				copy->stack = shared->stack;
+				shared->refCount--;
+				shared = copy;
+			}
+			return &shared->stack;
+		}
+
+		void release() {
+			if (shared != NULL && --shared->refCount == 0)
+				TRFileArena::deleteStack(shared, shared->getMemory());
+			shared = NULL;
+		}
+
+	private:
+		TRSharedStack &operator=(const TRSharedStack &);	// not to be implemented
+
+		struct SharedStack
+		{
+			SharedStack(pmr::memory_resource* memory) : stack(memory), refCount(1) {}
+			pmr::memory_resource* getMemory() const { return stack.get_allocator().resource(); }
+			T stack;
+			int refCount;	// number of beautifiers using the stack
+		};
+		SharedStack* shared;
+
+	public:	// inline functions
+		const T* operator->() const { assert(shared != NULL); return &shared->stack; }
+		const T &operator*() const { assert(shared != NULL); return shared->stack; }
+};
+
+//-----------------------------------------------------------------------------
+// Class TRProfile
+// counters for the time and calls of the formatting phases, the heap
+// allocations, and the beautifiers cloned for preprocessor statements
+// the counters are always compiled in but are updated only when profiling
+// is enabled, so the cost is an atomic load for each counted call
+// the worker threads add to the same counters, so the phase times are
+// the sum of the threads
+//-----------------------------------------------------------------------------
+
+class TRProfile
+{
+	public:
+		static void enable() { isEnabled.store(true, memory_order_relaxed); }
+		static bool getIsEnabled() { return isEnabled.load(memory_order_relaxed); }
+
+		static void addPhase(ProfilePhase phase, chrono::steady_clock::duration elapsed) {
+			phaseCalls[phase].fetch_add(1, memory_order_relaxed);
+			phaseTime[phase].fetch_add(chrono::duration_cast<chrono::nanoseconds>(elapsed).count(),
+			                           memory_order_relaxed);
+		}
+		static void countAllocation() {
+			if (getIsEnabled())
+				allocations.fetch_add(1, memory_order_relaxed);
+		}
+		static void countClone() {
+			if (getIsEnabled())
+				clones.fetch_add(1, memory_order_relaxed);
+		}
+
+		static unsigned long long getPhaseCalls(ProfilePhase phase) { return phaseCalls[phase].load(); }
+		static double getPhaseSeconds(ProfilePhase phase) { return phaseTime[phase].load() / 1e9; }
+		static unsigned long long getAllocations() { return allocations.load(); }
+		static unsigned long long getClones() { return clones.load(); }
+
+		static const char* getPhaseName(ProfilePhase phase) {
+			static const char* names[PROFILE_PHASES] =
+			{ "discover", "read", "format", "beautify", "enhance", "write" };
+			return names[phase];
+		}
+
+	private:
+		friend class TRProfileTimer;
+		static inline atomic<bool> isEnabled {false};
+		static inline atomic<unsigned long long> phaseCalls[PROFILE_PHASES] {};
+		static inline atomic<unsigned long long> phaseTime[PROFILE_PHASES] {};	// nanoseconds
+		static inline atomic<unsigned long long> allocations {0};
+		static inline atomic<unsigned long long> clones {0};
+		static inline thread_local bool isPhaseActive[PROFILE_PHASES] {};
+};
+
+//-----------------------------------------------------------------------------
+// Class TRProfileTimer
+// adds the time from construction to destruction to a TRProfile phase
+// a call made within the same phase is not timed, so the beautifiers
+// called by a beautifier are counted once
+//-----------------------------------------------------------------------------
+
+class TRProfileTimer
+{
+	public:
+		explicit TRProfileTimer(ProfilePhase phase_) : phase(phase_), isTiming(false) {
+			if (TRProfile::getIsEnabled() && !TRProfile::isPhaseActive[phase])
+			{
+				TRProfile::isPhaseActive[phase] = true;
+				isTiming = true;
+				startTime = chrono::steady_clock::now();
+			}
+		}
+		~TRProfileTimer() {
+			if (isTiming)
+			{
+				TRProfile::addPhase(phase, chrono::steady_clock::now() - startTime);
+				TRProfile::isPhaseActive[phase] = false;
+			}
+		}
+
+	private:
+		TRProfileTimer(const TRProfileTimer &);             // copy constructor not to be implemented
+		TRProfileTimer &operator=(const TRProfileTimer &);  // assignment operator not to be implemented
+
+		ProfilePhase phase;
+		bool isTiming;
+		chrono::steady_clock::time_point startTime;
+};
+
 //-----------------------------------------------------------------------------
 // Class ASBeautifier
 //-----------------------------------------------------------------------------
@@ -337,12 +615,16 @@ class ASBeautifier : protected TRResource, protected TRBase
 	protected:
 		void deleteBeautifierVectors();
 		const string* findHeader(const string &line, int i,
-		                         const vector<const string*>* possibleHeaders) const;
+		                         const TRKeywordList* possibleHeaders) const;
+		const string* findHeader(const TRLineTokens &tokens, size_t i,
+		                         const TRKeywordList* possibleHeaders) const;
 		const string* findOperator(const string &line, int i,
-		                           const vector<const string*>* possibleOperators) const;
+		                           const TRKeywordList* possibleOperators) const;
 		int getNextProgramCharDistance(const string &line, int i) const;
-		int  indexOf(vector<const string*> &container, const string* element) const;
+		template<typename T> int indexOf(const T &container, const string* element) const;
+		void releaseStacks();
 		void setBlockIndent(bool state);
+		void setFileMemory(pmr::memory_resource* memory);
 		void setBracketIndent(bool state);
 		string trim(const string &str) const;
 		string rtrim(const string &str) const;
@@ -371,11 +653,8 @@ class ASBeautifier : protected TRResource, protected TRBase
 		void registerInStatementIndent(const string &line, int i, int spaceIndentCount,
 		                               int tabIncrementIn, int minIndent, bool updateParenStack);
 		void initVectors();
-		void initTempStacksContainer(vector<vector<const string*>*>* &container,
-		                             vector<vector<const string*>*>* value);
 		void clearObjCMethodDefinitionAlignment();
-		void deleteBeautifierContainer(vector<ASBeautifier*>* &container);
-		void deleteTempStacksContainer(vector<vector<const string*>*>* &container);
+		void deleteBeautifierContainer(pmr::vector<ASBeautifier*>* &container);
 		int  adjustIndentCountForBreakElseIfComments() const;
 		int  computeObjCColonAlignment(string &line, int colonAlignPosition) const;
 		int  convertTabToSpaces(int i, int tabIncrementIn) const;
@@ -388,37 +667,38 @@ class ASBeautifier : protected TRResource, protected TRBase
 		bool statementEndsWithComma(const string &line, int index) const;
 		string extractPreprocessorStatement(const string &line) const;
 		string preLineWS(int lineIndentCount, int lineSpaceIndentCount) const;
-		template<typename T> void deleteContainer(T &container);
-		template<typename T> void initContainer(T &container, T value);
-		vector<vector<const string*>*>* copyTempStacks(const ASBeautifier &other) const;
+		template<typename T> void deleteContainer(T* &container);
+		template<typename T> void initContainer(T* &container);
 		pair<int, int> computePreprocessorIndent();
 
 	private:  // variables
 		int beautifierFileType;
-		vector<const string*>* headers;
-		vector<const string*>* nonParenHeaders;
-		vector<const string*>* preBlockStatements;
-		vector<const string*>* preCommandHeaders;
-		vector<const string*>* assignmentOperators;
-		vector<const string*>* nonAssignmentOperators;
-		vector<const string*>* indentableHeaders;
-
-		vector<ASBeautifier*>* waitingBeautifierStack;
-		vector<ASBeautifier*>* activeBeautifierStack;
-		vector<int>* waitingBeautifierStackLengthStack;
-		vector<int>* activeBeautifierStackLengthStack;
-		vector<const string*>* headerStack;
-		vector< vector<const string*>* >* tempStacks;
-		vector<int>* blockParenDepthStack;
-		vector<bool>* blockStatementStack;
-		vector<bool>* parenStatementStack;
-		vector<bool>* bracketBlockStateStack;
-		vector<int>* inStatementIndentStack;
-		vector<int>* inStatementIndentStackSizeStack;
-		vector<int>* parenIndentStack;
-		vector<pair<int, int> >* preprocIndentStack;
+		TRKeywordList* headers;
+		TRKeywordList* nonParenHeaders;
+		TRKeywordList* preBlockStatements;
+		TRKeywordList* preCommandHeaders;
+		TRKeywordList* assignmentOperators;
+		TRKeywordList* nonAssignmentOperators;
+		TRKeywordList* indentableHeaders;
+
+		pmr::memory_resource* fileMemory;	// the memory for the stacks of the file
+		pmr::vector<ASBeautifier*>* waitingBeautifierStack;
+		pmr::vector<ASBeautifier*>* activeBeautifierStack;
+		pmr::vector<int>* waitingBeautifierStackLengthStack;
+		pmr::vector<int>* activeBeautifierStackLengthStack;
+		TRSharedStack<pmr::vector<const string*> > headerStack;
+		TRSharedStack<pmr::vector<pmr::vector<const string*> > > tempStacks;
+		TRSharedStack<pmr::vector<int> > blockParenDepthStack;
+		TRSharedStack<pmr::vector<bool> > blockStatementStack;
+		TRSharedStack<pmr::vector<bool> > parenStatementStack;
+		TRSharedStack<pmr::vector<bool> > bracketBlockStateStack;
+		TRSharedStack<pmr::vector<int> > inStatementIndentStack;
+		TRSharedStack<pmr::vector<int> > inStatementIndentStackSizeStack;
+		TRSharedStack<pmr::vector<int> > parenIndentStack;
+		TRSharedStack<pmr::vector<pair<int, int> > > preprocIndentStack;
 
 		TRSourceIterator* sourceIterator;
+		TRLineTokens lineTokens;			// the tokens of the line in parseCurrentLine
 		const string* currentHeader;
 		const string* previousLastLineHeader;
 		const string* probationHeader;
@@ -492,6 +772,8 @@ class ASBeautifier : protected TRResource, protected TRBase
 		int  maxInStatementIndent;
 		int  classInitializerIndents;
 		int  templateDepth;
+		int  externCBracketState;			// owned by the beautifier that is not a clone
+		int* preprocessorCppExternCBracket;	// state of an #ifdef __cplusplus extern "C" {, shared with the clones
 		int  squareBracketCount;
 		int  prevFinalLineSpaceIndentCount;
 		int  prevFinalLineIndentCount;
@@ -538,6 +820,7 @@ class ASEnhancer : protected TRBase
 		bool emptyLineFill;
 
 		// parsing variables
+		TRLineTokens lineTokens;
 		int  lineNumber;
 		bool isInQuote;
 		bool isInComment;
@@ -573,6 +856,61 @@ class ASEnhancer : protected TRBase
 
 };  // Class ASEnhancer
 
+//-----------------------------------------------------------------------------
+// Class TRLookAhead
+// the input lines that follow the current line of the formatter
+// the lines are peeked from the source iterator once and kept until the
+// formatter reads them, so the formatter does not peek the same lines again
+// the next text found after a line is saved with the line, so a search that
+// reaches a line already searched does not continue to the following lines
+//-----------------------------------------------------------------------------
+
+class TRLookAhead
+{
+	public:
+		TRLookAhead() : sourceIterator(NULL), firstLineNumber(0), isEndOfInput(false) {}
+		void init(TRSourceIterator* si);
+		void nextLine();
+		bool hasLine(size_t index);
+		const string &getLine(size_t index);
+		string findNextText(const string &firstLine, size_t index, bool endOnEmptyLine);
+
+	private:
+		// the next text found from a line, for a search beginning outside or inside a comment
+		struct NextText
+		{
+			size_t lineNumber;      // the line containing the text
+			size_t textStart;       // start of the text, npos if no text was found
+			bool isEmptyLineFirst;  // an empty line outside a comment is before the text
+		};
+
+		// a line that has been peeked and not read by the formatter
+		struct LookAheadLine
+		{
+			string text;            // the input line
+			NextText nextText[2];   // indexed by a search beginning in a comment
+			bool isNextTextFound[2];
+		};
+
+		// a line searched by findNextText before the text was found
+		struct SearchedLine
+		{
+			size_t index;           // the index of the line in the window
+			bool isInComment;       // the search of the line began in a comment
+			bool isEmptyLine;       // the line is empty and not in a comment
+		};
+
+		TRLookAhead(const TRLookAhead &copy);       // copy constructor not to be implemented
+		TRLookAhead &operator=(TRLookAhead &);      // assignment operator not to be implemented
+		bool findTextOnLine(const string &line, size_t &textStart, bool &isInComment) const;
+		void peekLines(size_t lineCount);
+		TRSourceIterator* sourceIterator;
+		deque<LookAheadLine> lines;     // the lines following the current line
+		vector<SearchedLine> searchPath;    // used by findNextText
+		size_t firstLineNumber;         // the number of lines read before lines[0]
+		bool isEndOfInput;              // lines.back() is the last input line
+};
+
 //-----------------------------------------------------------------------------
 // Class TRFormatter
 //-----------------------------------------------------------------------------
@@ -585,8 +923,10 @@ class TRFormatter : public ASBeautifier
 		virtual void init(TRSourceIterator* iter);
 		virtual bool hasMoreLines() const;
 		virtual string nextLine();
+		void releaseFileStacks();
 		LineEndFormat getLineEndFormat() const;
 		bool getIsLineReady() const;
+		bool getIsLineUnformatted() const;
 		void setFormattingStyle(FormatStyle style);
 		void setAddBracketsMode(bool state);
 		void setAddOneLineBracketsMode(bool state);
@@ -626,11 +966,25 @@ class TRFormatter : public ASBeautifier
 		int  getChecksumDiff() const;
 		int  getFormatterFileType() const;
 
+	private:  // structs
+		// the state of a scan of the lines in a formatting-off region
+		struct FormattingOffScan
+		{
+			int  bracketDepth;      // the brackets opened in the region
+			int  parenDepth;        // the parens and square brackets opened in the region
+			int  preprocDepth;      // the preprocessor conditionals opened in the region
+			bool isOuterClosed;     // a bracket, paren, or conditional opened before the region is closed
+			bool isInComment;       // the scan is in a comment
+			bool isContinued;       // a preprocessor line ends with a backslash
+			bool isOnMarkerFound;   // a comment on the line begins with an INDENT-ON marker
+			char lastCodeChar;      // the last code character, a space if none
+		};
+
 	private:  // functions
 		TRFormatter(const TRFormatter &copy);       // copy constructor not to be implemented
 		TRFormatter &operator=(TRFormatter &);      // assignment operator not to be implemented
-		template<typename T> void deleteContainer(T &container);
-		template<typename T> void initContainer(T &container, T value);
+		template<typename T> void deleteContainer(T* &container);
+		template<typename T> void initContainer(T* &container);
 		char peekNextChar() const;
 		BracketType getBracketType();
 		bool addBracketsToStatement();
@@ -650,6 +1004,7 @@ class TRFormatter : public ASBeautifier
 		bool isExecSQL(string  &line, size_t index) const;
 		bool isEmptyLine(const string &line) const;
 		bool isExternC() const;
+		bool isFormattingOffMarker(const string &line, const char* marker, size_t start, size_t end) const;
 		bool isNonInStatementArrayBracket() const;
 		bool isOkToSplitFormattedLine();
 		bool isPointerOrReference() const;
@@ -661,6 +1016,7 @@ class TRFormatter : public ASBeautifier
 		bool isInExponent() const;
 		bool isInSwitchStatement() const;
 		bool isOkToBreakBlock(BracketType bracketType) const;
+		bool findFormattingOffRegion(size_t &lineCount);
 		bool pointerSymbolFollows() const;
 		int  getCurrentLineCommentAdjustment();
 		int  getNextLineCommentAdjustment();
@@ -672,6 +1028,7 @@ class TRFormatter : public ASBeautifier
 		void appendSequence(const string &sequence, bool canBreakLine = true);
 		void appendSpacePad();
 		void appendSpaceAfter();
+		void appendSpan(size_t spanEnd);
 		void breakLine(bool isSplitLine = false);
 		void buildLanguageVectors();
 		void updateFormattedLineSplitPoints(char appendedChar);
@@ -679,7 +1036,6 @@ class TRFormatter : public ASBeautifier
 		void checkIfTemplateOpener();
 		void clearFormattedLineSplitPoints();
 		void convertTabToSpaces();
-		void deleteContainer(vector<BracketType>* &container);
 		void formatArrayRunIn();
 		void formatRunIn();
 		void formatArrayBrackets(BracketType bracketType, bool isOpeningArrayBracket);
@@ -700,44 +1056,49 @@ class TRFormatter : public ASBeautifier
 		void fixOptionVariableConflicts();
 		void goForward(int i);
 		void isLineBreakBeforeClosingHeader();
-		void initContainer(vector<BracketType>* &container, vector<BracketType>* value);
 		void initNewLine();
 		void padObjCMethodColon();
 		void padOperators(const string* newOperator);
 		void padParens();
 		void processPreprocessor();
 		void resetEndOfStatement();
+		void scanFormattingOffLine(const string &line, FormattingOffScan &scan, bool shouldUpdateBrackets);
 		void setAttachClosingBracket(bool state);
 		void setBreakBlocksVariables();
 		void stripCommentPrefix();
 		void testForTimeToSplitFormattedLine();
 		void trimContinuationLine();
+		void turnFormattingOff();
 		void updateFormattedLineSplitPointsPointerOrReference(size_t index);
 		size_t findFormattedLineSplitPoint() const;
 		size_t findNextChar(string &line, char searchChar, int searchStart = 0);
+		size_t findSpanEnd(size_t start, char ch1, char ch2) const;
 		const string* checkForHeaderFollowingComment(const string &firstLine) const;
 		const string* getFollowingOperator() const;
 		string getPreviousWord(const string &line, int currPos) const;
-		string peekNextText(const string &firstLine, bool endOnEmptyLine = false, bool shouldReset = false) const;
+		string nextFormattingOffLine();
+		string peekNextText(const string &firstLine, bool endOnEmptyLine = false, size_t lookAheadIndex = 0) const;
 
 	private:  // variables
 		int formatterFileType;
-		vector<const string*>* headers;
-		vector<const string*>* nonParenHeaders;
-		vector<const string*>* preDefinitionHeaders;
-		vector<const string*>* preCommandHeaders;
-		vector<const string*>* operators;
-		vector<const string*>* assignmentOperators;
-		vector<const string*>* castOperators;
+		TRKeywordList* headers;
+		TRKeywordList* nonParenHeaders;
+		TRKeywordList* preDefinitionHeaders;
+		TRKeywordList* preCommandHeaders;
+		TRKeywordList* operators;
+		TRKeywordList* assignmentOperators;
+		TRKeywordList* castOperators;
 
 		TRSourceIterator* sourceIterator;
+		mutable TRLookAhead lookAhead;  // the lines following currentLine
 		ASEnhancer* enhancer;
 
-		vector<const string*>* preBracketHeaderStack;
-		vector<BracketType>* bracketTypeStack;
-		vector<int>* parenStack;
-		vector<bool>* structStack;
-		vector<bool>* questionMarkStack;
+		TRFileArena fileArena;
+		pmr::vector<const string*>* preBracketHeaderStack;
+		pmr::vector<BracketType>* bracketTypeStack;
+		pmr::vector<int>* parenStack;
+		pmr::vector<bool>* structStack;
+		pmr::vector<bool>* questionMarkStack;
 
 		string readyFormattedLine;
 		string currentLine;
@@ -778,6 +1139,9 @@ class TRFormatter : public ASBeautifier
 		size_t maxWhiteSpacePending;
 
 		size_t previousReadyFormattedLineLength;
+		size_t formattingOffLineCount;      // the lines remaining in the formatting-off region
+		FormattingOffScan formattingOffScan;    // used for an unbalanced formatting-off region
+		string formattingOffFirstLine;      // the first line of the region, read before the marker line is output
 		FormatStyle formattingStyle;
 		BracketMode bracketFormatMode;
 		BracketType previousBracketType;
@@ -903,6 +1267,12 @@ class TRFormatter : public ASBeautifier
 		bool isInHeader;
 		bool isImmediatelyPostHeader;
 		bool isInCase;
+		bool shouldTurnFormattingOff;           // a comment on the current line begins with an INDENT-OFF marker
+		bool isFormattingModeOff;               // the lines are copied unchanged to INDENT-ON
+		bool isFormattingOffBalanced;           // the region does not change the formatter state
+		bool isImmediatelyPostFormattingOff;    // no text is formatted after the region
+		bool hasFormattingOffFirstLine;         // formattingOffFirstLine has not been output
+		bool isLineUnformatted;                 // the last output line was copied from a region
 
 	private:  // inline functions
 		// append the CURRENT character (curentChar) to the current formatted line.
@@ -916,12 +1286,12 @@ class TRFormatter : public ASBeautifier
 		}
 
 		// call TRBase::findHeader for the current character
-		const string* findHeader(const vector<const string*>* headers_) {
+		const string* findHeader(const TRKeywordList* headers_) {
 			return ASBeautifier::findHeader(currentLine, charNum, headers_);
 		}
 
 		// call TRBase::findOperator for the current character
-		const string* findOperator(const vector<const string*>* headers_) {
+		const string* findOperator(const TRKeywordList* headers_) {
 			return ASBeautifier::findOperator(currentLine, charNum, headers_);
 		}
 };  // Class TRFormatter
@@ -942,6 +1312,7 @@ bool sortOnName(const string* a, const string* b);
 //-----------------------------------------------------------------------------
 // declarations for library build
 // global because they are called externally and are NOT part of the namespace
+// AStyleMain is reentrant and may be called from several threads at once
 //-----------------------------------------------------------------------------
 
 typedef void (STDCALL* fpError)(int, const char*);      // pointer to callback error handler
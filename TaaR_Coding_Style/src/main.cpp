@@ -12,17 +12,38 @@
 #include <cstdlib>
 #include <errno.h>
 #include <fstream>
+#include <iterator>
 #include <sstream>
-#include <windows.h>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <climits>
+	#include <clocale>
+	#include <dirent.h>
+	#include <fcntl.h>
+	#include <signal.h>
+	#include <sys/mman.h>
+	#include <sys/socket.h>
+	#include <sys/time.h>
+	#include <sys/un.h>
+	#include <unistd.h>
+#endif
 
-namespace TaaRRule {
+// SSE2 is used for the ascii blocks in the utf-16 conversions
+#if defined(__SSE2__) || defined(_M_X64)
+	#define TR_USE_SSE2
+	#include <emmintrin.h>
+#endif
 
-char g_fileSeparator = '\\';
-bool g_isCaseSensitive = false;
+namespace TaaRRule {
 
 // console build variables
-ostream* _err = &cerr;           // direct error messages to cerr
-ASConsole* g_console = NULL;     // class to encapsulate console variables
+ostream* _err = &cerr;           // direct error messages to cerr, set by the console only
 
 //-----------------------------------------------------------------------------
 // TRStreamIterator class
@@ -34,11 +55,13 @@ TRStreamIterator<T>::TRStreamIterator(T* in)
 {
 	inStream = in;
 	buffer.reserve(200);
+	peekIndex = 0;
 	eolWindows = 0;
 	eolLinux = 0;
 	eolMacOld = 0;
 	outputEOL[0] = '\0';
-	peekStart = 0;
+	isPeeking = false;
+	isEndOfInput = false;
 	prevLineDeleted = false;
 	checkForEmptyLine = false;
 }
@@ -49,8 +72,41 @@ TRStreamIterator<T>::~TRStreamIterator()
 }
 
 /**
- * read the input stream, delete any end of line characters,
+ * read a line from the stream buffer and the end of line characters that follow it.
+ * the stream is never positioned, so it may be a pipe.
+ * the end of line characters are the same as TRBufferIterator.
+ *
+ * @param line    the line read, eol is empty at the end of input
+ */
+template<typename T>
+void TRStreamIterator<T>::readLine(StreamLine &line)
+{
+	streambuf* inBuf = inStream->rdbuf();
+	line.text.clear();
+	line.eol.clear();
+	line.isLastEol = false;
+
+	int ch = inBuf->sbumpc();
+	while (ch != EOF && ch != '\n' && ch != '\r')
+	{
+		line.text.append(1, (char) ch);
+		ch = inBuf->sbumpc();
+	}
+	if (ch == EOF)
+		return;
+
+	line.eol.append(1, (char) ch);
+	int peekCh = inBuf->sgetc();
+	if (peekCh == EOF)
+		line.isLastEol = true;
+	else if ((peekCh == '\n' || peekCh == '\r') && peekCh != ch)
+		line.eol.append(1, (char) inBuf->sbumpc());
+}
+
+/**
+ * get the next input line, delete any end of line characters,
  *     and build a string that contains the input line.
+ * the line is taken from the look-ahead window if peekNextLine has read it.
  *
  * @return        string containing the next input line minus any end of line characters
  */
@@ -58,7 +114,7 @@ template<typename T>
 string TRStreamIterator<T>::nextLine(bool emptyLineWasDeleted)
 {
 	// verify that the current position is correct
-	assert (peekStart == 0);
+	assert (!isPeeking);
 
 	// a deleted line may be replaced if break-blocks is requested
 	// this sets up the compare to check for a replaced empty line
@@ -72,51 +128,35 @@ string TRStreamIterator<T>::nextLine(bool emptyLineWasDeleted)
 	else
 		prevLineDeleted = true;
 
-	// read the next record
-	buffer.clear();
-	char ch;
-	inStream->get(ch);
-
-	while (!inStream->eof() && ch != '\n' && ch != '\r')
+	// get the next record
+	StreamLine line;
+	if (peekWindow.empty())
+		readLine(line);
+	else
 	{
-		buffer.append(1, ch);
-		inStream->get(ch);
+		line.text.swap(peekWindow.front().text);
+		line.eol.swap(peekWindow.front().eol);
+		line.isLastEol = peekWindow.front().isLastEol;
+		peekWindow.pop_front();
 	}
+	buffer.swap(line.text);
 
-	if (inStream->eof())
+	if (line.eol.empty())
 	{
+		isEndOfInput = true;
 		return buffer;
 	}
 
-	int peekCh = inStream->peek();
-
 	// find input end-of-line characters
-	if (!inStream->eof())
-	{
-		if (ch == '\r')         // CR+LF is windows otherwise Mac OS 9
-		{
-			if (peekCh == '\n')
-			{
-				inStream->get();
-				eolWindows++;
-			}
-			else
-				eolMacOld++;
-		}
-		else                    // LF is Linux, allow for improbable LF/CR
-		{
-			if (peekCh == '\r')
-			{
-				inStream->get();
-				eolWindows++;
-			}
-			else
-				eolLinux++;
-		}
-	}
-	else
+	// an end-of-line at the end of the input is not counted
+	if (!line.isLastEol)
 	{
-		inStream->clear();
+		if (line.eol.length() == 2)
+			eolWindows++;           // CR+LF is windows, allow for improbable LF/CR
+		else if (line.eol[0] == '\r')
+			eolMacOld++;            // CR is Mac OS 9
+		else
+			eolLinux++;             // LF is Linux
 	}
 
 	// set output end of line characters
@@ -135,60 +175,47 @@ string TRStreamIterator<T>::nextLine(bool emptyLineWasDeleted)
 	return buffer;
 }
 
-// save the current position and get the next line
+// get the next line without changing the current position
 // this can be called for multiple reads
+// the lines read are kept in the look-ahead window for nextLine
+// the window holds only the lines the formatter peeks ahead
 // when finished peeking you MUST call peekReset()
 // call this function from TRFormatter ONLY
 template<typename T>
 string TRStreamIterator<T>::peekNextLine()
 {
 	assert (hasMoreLines());
-	string nextLine_;
-	char ch;
-
-	if (peekStart == 0)
-		peekStart = inStream->tellg();
-
-	// read the next record
-	inStream->get(ch);
-	while (!inStream->eof() && ch != '\n' && ch != '\r')
-	{
-		nextLine_.append(1, ch);
-		inStream->get(ch);
-	}
+	isPeeking = true;
 
-	if (inStream->eof())
+	if (peekIndex == peekWindow.size())
 	{
-		return nextLine_;
+		peekWindow.push_back(StreamLine());
+		readLine(peekWindow.back());
 	}
+	const StreamLine &line = peekWindow[peekIndex++];
 
-	int peekCh = inStream->peek();
-
-	// remove end-of-line characters
-	if (!inStream->eof())
-	{
-		if ((peekCh == '\n' || peekCh == '\r') && peekCh != ch)
-			inStream->get();
-	}
+	// the input ends with this line or its end of line
+	if (line.eol.empty() || line.isLastEol)
+		isEndOfInput = true;
 
-	return nextLine_;
+	return line.text;
 }
 
-// reset current position and EOF for peekNextLine()
+// reset current position and end of input for peekNextLine()
 template<typename T>
 void TRStreamIterator<T>::peekReset()
 {
-	assert(peekStart != 0);
-	inStream->clear();
-	inStream->seekg(peekStart);
-	peekStart = 0;
+	assert(isPeeking);
+	peekIndex = 0;
+	isPeeking = false;
+	isEndOfInput = false;
 }
 
 // save the last input line after input has reached EOF
 template<typename T>
 void TRStreamIterator<T>::saveLastInputLine()
 {
-	assert(inStream->eof());
+	assert(isEndOfInput);
 	prevBuffer = buffer;
 }
 
@@ -220,674 +247,2511 @@ bool TRStreamIterator<T>::getLineEndChange(int lineEndFormat) const
 	return lineEndChange;
 }
 
+// the stream iterator for cin, also used by the benchmark program
+template class TRStreamIterator<istream>;
+
 //-----------------------------------------------------------------------------
-// ASConsole class
-// main function will be included only in the console build
+// TRBufferIterator class
+// the input is a contiguous buffer that must remain valid while formatting
 //-----------------------------------------------------------------------------
 
-// rewrite a stringstream converting the line ends
-void ASConsole::convertLineEnds(ostringstream &out, int lineEnd)
-{
-	assert(lineEnd == LINEEND_WINDOWS || lineEnd == LINEEND_LINUX || lineEnd == LINEEND_MACOLD);
-	const string &inStr = out.str();	// avoids strange looking syntax
-	string outStr;						// the converted ouput
-	int inLength = inStr.length();
-	for (int pos = 0; pos < inLength; pos++)
-	{
-		if (inStr[pos] == '\r')
-		{
-			if (inStr[pos + 1] == '\n')
-			{
-				// CRLF
-				if (lineEnd == LINEEND_CR)
-				{
-					outStr += inStr[pos];		// Delete the LF
-					pos++;
-					continue;
-				}
-				else if (lineEnd == LINEEND_LF)
-				{
-					outStr += inStr[pos + 1];		// Delete the CR
-					pos++;
-					continue;
-				}
-				else
-				{
-					outStr += inStr[pos];		// Do not change
-					outStr += inStr[pos + 1];
-					pos++;
-					continue;
-				}
-			}
-			else
-			{
-				// CR
-				if (lineEnd == LINEEND_CRLF)
-				{
-					outStr += inStr[pos];		// Insert the CR
-					outStr += '\n';				// Insert the LF
-					continue;
-				}
-				else if (lineEnd == LINEEND_LF)
-				{
-					outStr += '\n';				// Insert the LF
-					continue;
-				}
-				else
-				{
-					outStr += inStr[pos];		// Do not change
-					continue;
-				}
-			}
-		}
-		else if (inStr[pos] == '\n')
-		{
-			// LF
-			if (lineEnd == LINEEND_CRLF)
-			{
-				outStr += '\r';				// Insert the CR
-				outStr += inStr[pos];		// Insert the LF
-				continue;
-			}
-			else if (lineEnd == LINEEND_CR)
-			{
-				outStr += '\r';				// Insert the CR
-				continue;
-			}
-			else
-			{
-				outStr += inStr[pos];		// Do not change
-				continue;
-			}
-		}
-		else
-		{
-			outStr += inStr[pos];		// Write the current char
-		}
-	}
-	// replace the stream
-	out.str(outStr);
-}
-
-void ASConsole::correctMixedLineEnds(ostringstream &out)
-{
-	LineEndFormat lineEndFormat = LINEEND_DEFAULT;
-	if (strcmp(outputEOL, "\r\n") == 0)
-		lineEndFormat = LINEEND_WINDOWS;
-	if (strcmp(outputEOL, "\n") == 0)
-		lineEndFormat = LINEEND_LINUX;
-	if (strcmp(outputEOL, "\r") == 0)
-		lineEndFormat = LINEEND_MACOLD;
-	convertLineEnds(out, lineEndFormat);
-}
-
-// check files for 16 or 32 bit encoding
-// the file must have a Byte Order Mark (BOM)
-// NOTE: some string functions don't work with NULLs (e.g. length())
-FileEncoding ASConsole::detectEncoding(const char* data, size_t dataSize) const
-{
-	FileEncoding encoding = ENCODING_8BIT;
-
-	if (dataSize >= 4 && memcmp(data, "\x00\x00\xFE\xFF", 4) == 0)
-		encoding = UTF_32BE;
-	else if (dataSize >= 4 && memcmp(data, "\xFF\xFE\x00\x00", 4) == 0)
-		encoding = UTF_32LE;
-	else if (dataSize >= 2 && memcmp(data, "\xFE\xFF", 2) == 0)
-		encoding = UTF_16BE;
-	else if (dataSize >= 2 && memcmp(data, "\xFF\xFE", 2) == 0)
-		encoding = UTF_16LE;
-
-	return encoding;
-}
-
-// error exit without a message
-void ASConsole::error() const
+TRBufferIterator::TRBufferIterator(const char* data, size_t dataSize)
 {
-	(*_err) << _("\nArtistic Style has terminated") << endl;
-	exit(EXIT_FAILURE);
+	inData = data;
+	inSize = dataSize;
+	inPos = 0;
+	lineStart = 0;
+	lineLength = 0;
+	prevStart = 0;
+	prevLength = 0;
+	const char* cr = static_cast<const char*>(memchr(inData, '\r', inSize));
+	const char* lf = static_cast<const char*>(memchr(inData, '\n', inSize));
+	nextCR = cr ? cr - inData : inSize;
+	nextLF = lf ? lf - inData : inSize;
+	peekPos = 0;
+	peekCR = nextCR;
+	peekLF = nextLF;
+	eolWindows = 0;
+	eolLinux = 0;
+	eolMacOld = 0;
+	outputEOL[0] = '\0';
+	isPeeking = false;
+	isEndOfInput = false;
+	prevLineDeleted = false;
+	checkForEmptyLine = false;
 }
 
-// error exit with a message
-void ASConsole::error(const char* why, const char* what) const
+TRBufferIterator::~TRBufferIterator()
 {
-	(*_err) << why << ' ' << what << endl;
-	error();
 }
 
 /**
- * If no files have been given, use cin for input and cout for output.
+ * find the end of the line starting at start.
+ * memchr is used to search for the CR and LF separately. The positions
+ * found are saved and searched again only after start has passed them,
+ * so the input is scanned only once for each character.
  *
- * This is used to format text for text editors like TextWrangler (Mac).
- * Do NOT display any console messages when this function is used.
+ * @return        position of the first CR or LF, or inSize if none
  */
-void ASConsole::formatCinToCout()
+size_t TRBufferIterator::findLineEnd(size_t start, size_t &nextCR_, size_t &nextLF_) const
 {
-	// Using cin.tellg() causes problems with both Windows and Linux.
-	// The Windows problem occurs when the input is not Windows line-ends.
-	// The tellg() will be out of sequence with the get() statements.
-	// The Linux cin.tellg() will return -1 (invalid).
-	// Copying the input sequentially to a stringstream before
-	// formatting solves the problem for both.
-	istream* inStream = &cin;
-	stringstream outStream;
-	char ch;
-	while (!inStream->eof())
+	if (nextCR_ < start)
 	{
-		inStream->get(ch);
-		outStream.put(ch);
+		const char* cr = static_cast<const char*>(memchr(inData + start, '\r', inSize - start));
+		nextCR_ = cr ? cr - inData : inSize;
 	}
-	TRStreamIterator<stringstream> streamIterator(&outStream);
-	// Windows pipe or redirection always outputs Windows line-ends.
-	// Linux pipe or redirection will output any line end.
-	LineEndFormat lineEndFormat = formatter.getLineEndFormat();
-	initializeOutputEOL(lineEndFormat);
-	formatter.init(&streamIterator);
-
-	while (formatter.hasMoreLines())
+	if (nextLF_ < start)
 	{
-		cout << formatter.nextLine();
-		if (formatter.hasMoreLines())
-		{
-			setOutputEOL(lineEndFormat, streamIterator.getOutputEOL());
-			cout << outputEOL;
-		}
-		else
-		{
-			// this can happen if the file if missing a closing bracket and break-blocks is requested
-			if (formatter.getIsLineReady())
-			{
-				setOutputEOL(lineEndFormat, streamIterator.getOutputEOL());
-				cout << outputEOL;
-				cout << formatter.nextLine();
-			}
-		}
+		const char* lf = static_cast<const char*>(memchr(inData + start, '\n', inSize - start));
+		nextLF_ = lf ? lf - inData : inSize;
 	}
-	cout.flush();
+	return min(nextCR_, nextLF_);
 }
 
 /**
- * Open input file, format it, and close the output.
+ * get the next line from the buffer minus any end of line characters.
+ * The end of line counts are the same as TRStreamIterator.
  *
- * @param fileName_     The path and name of the file to be processed.
+ * @return        string containing the next input line minus any end of line characters
  */
-void ASConsole::formatFile(const string &fileName_)
+string TRBufferIterator::nextLine(bool emptyLineWasDeleted)
 {
-	stringstream in;
-	ostringstream out;
-	FileEncoding encoding = readFile(fileName_, in);
+	// verify that the current position is correct
+	assert (!isPeeking);
 
-	// Unless a specific language mode has been set, set the language mode
-	// according to the file's suffix.
-	if (!formatter.getModeManuallySet())
+	// a deleted line may be replaced if break-blocks is requested
+	// this sets up the compare to check for a replaced empty line
+	if (prevLineDeleted)
 	{
-		formatter.setCStyle();
+		prevLineDeleted = false;
+		checkForEmptyLine = true;
+	}
+	if (!emptyLineWasDeleted)
+	{
+		prevStart = lineStart;
+		prevLength = lineLength;
 	}
+	else
+		prevLineDeleted = true;
 
-	// set line end format
-	string nextLine;				// next output line
-	filesAreIdentical = true;		// input and output files are identical
-	LineEndFormat lineEndFormat = formatter.getLineEndFormat();
-	initializeOutputEOL(lineEndFormat);
-	// do this AFTER setting the file mode
-	TRStreamIterator<stringstream> streamIterator(&in);
-	formatter.init(&streamIterator);
+	// get the next record
+	size_t lineEnd = findLineEnd(inPos, nextCR, nextLF);
+	lineStart = inPos;
+	lineLength = lineEnd - inPos;
 
-	// format the file
-	while (formatter.hasMoreLines())
+	if (lineEnd >= inSize)
 	{
-		nextLine = formatter.nextLine();
-		out << nextLine;
-		linesOut++;
-		if (formatter.hasMoreLines())
-		{
-			setOutputEOL(lineEndFormat, streamIterator.getOutputEOL());
-			out << outputEOL;
-		}
-		else
+		inPos = inSize;
+		isEndOfInput = true;
+		return string(inData + lineStart, lineLength);
+	}
+
+	char ch = inData[lineEnd];
+	inPos = lineEnd + 1;
+
+	// find input end-of-line characters
+	// an end-of-line at the end of the input is not counted
+	if (inPos < inSize)
+	{
+		if (ch == '\r')         // CR+LF is windows otherwise Mac OS 9
 		{
-			streamIterator.saveLastInputLine();     // to compare the last input line
-			// this can happen if the file if missing a closing bracket and break-blocks is requested
-			if (formatter.getIsLineReady())
+			if (inData[inPos] == '\n')
 			{
-				setOutputEOL(lineEndFormat, streamIterator.getOutputEOL());
-				out << outputEOL;
-				nextLine = formatter.nextLine();
-				out << nextLine;
-				linesOut++;
-				streamIterator.saveLastInputLine();
+				inPos++;
+				eolWindows++;
 			}
+			else
+				eolMacOld++;
 		}
-
-		if (filesAreIdentical)
+		else                    // LF is Linux, allow for improbable LF/CR
 		{
-			if (streamIterator.checkForEmptyLine)
+			if (inData[inPos] == '\r')
 			{
-				if (nextLine.find_first_not_of(" \t") != string::npos)
-					filesAreIdentical = false;
+				inPos++;
+				eolWindows++;
 			}
-			else if (!streamIterator.compareToInputBuffer(nextLine))
-				filesAreIdentical = false;
-			streamIterator.checkForEmptyLine = false;
+			else
+				eolLinux++;
 		}
 	}
-	// correct for mixed line ends
-	if (lineEndsMixed)
-	{
-		correctMixedLineEnds(out);
-		filesAreIdentical = false;
-	}
 
-	// remove targetDirectory from filename if required by print
-	string displayName;
-	if (hasWildcard)
-		displayName = fileName_.substr(targetDirectory.length() + 1);
-	else
-		displayName = fileName_;
-
-	// if file has changed, write the new file
-	if (!filesAreIdentical || streamIterator.getLineEndChange(lineEndFormat))
+	// set output end of line characters
+	if (eolWindows >= eolLinux)
 	{
-		writeFile(fileName_, encoding, out);
-		printMsg(_("Formatted  %s\n"), displayName);
-		filesFormatted++;
+		if (eolWindows >= eolMacOld)
+			strcpy(outputEOL, "\r\n");  // Windows (CR+LF)
+		else
+			strcpy(outputEOL, "\r");    // MacOld (CR)
 	}
+	else if (eolLinux >= eolMacOld)
+		strcpy(outputEOL, "\n");		// Linux (LF)
 	else
-	{
-		if (!isFormattedOnly)
-			printMsg(_("Unchanged  %s\n"), displayName);
-		filesUnchanged++;
-	}
+		strcpy(outputEOL, "\r");		// MacOld (CR)
 
-	assert(formatter.getChecksumDiff() == 0);
+	return string(inData + lineStart, lineLength);
 }
 
-// build a vector of argv options
-// the program path argv[0] is excluded
-vector<string> ASConsole::getArgvOptions(int argc, char** argv) const
+// save the current position and get the next line
+// this can be called for multiple reads
+// when finished peeking you MUST call peekReset()
+// call this function from TRFormatter ONLY
+string TRBufferIterator::peekNextLine()
 {
-	vector<string> argvOptions;
-	for (int i = 1; i < argc; i++)
+	assert (hasMoreLines());
+
+	if (!isPeeking)
 	{
-		argvOptions.push_back(string(argv[i]));
+		isPeeking = true;
+		peekPos = inPos;
+		peekCR = nextCR;
+		peekLF = nextLF;
 	}
-	return argvOptions;
-}
 
-// for unit testing
-vector<bool> ASConsole::getExcludeHitsVector()
-{ return excludeHitsVector; }
+	// get the next record
+	size_t lineEnd = findLineEnd(peekPos, peekCR, peekLF);
+	size_t start = peekPos;
 
-// for unit testing
-vector<string> ASConsole::getExcludeVector()
-{ return excludeVector; }
-
-// for unit testing
-vector<string> ASConsole::getFileName()
-{ return fileName; }
-
-// for unit testing
-vector<string> ASConsole::getFileNameVector()
-{ return fileNameVector; }
-
-// for unit testing
-vector<string> ASConsole::getFileOptionsVector()
-{ return fileOptionsVector; }
-
-// for unit testing
-int ASConsole::getFilesFormatted()
-{ return filesFormatted; }
-
-// for unit testing
-bool ASConsole::getIgnoreExcludeErrors()
-{ return ignoreExcludeErrors; }
-
-// for unit testing
-bool ASConsole::getIgnoreExcludeErrorsDisplay()
-{ return ignoreExcludeErrorsDisplay; }
-
-// for unit testing
-bool ASConsole::getIsFormattedOnly()
-{ return isFormattedOnly; }
-
-// for unit testing
-string ASConsole::getLanguageID() const
-{ return localizer.getLanguageID(); }
-
-// for unit testing
-bool ASConsole::getIsQuiet()
-{ return isQuiet; }
-
-// for unit testing
-bool ASConsole::getIsRecursive()
-{ return isRecursive; }
-
-// for unit testing
-bool ASConsole::getIsVerbose()
-{ return isVerbose; }
-
-// for unit testing
-bool ASConsole::getLineEndsMixed()
-{ return lineEndsMixed; }
-
-// for unit testing
-bool ASConsole::getNoBackup()
-{ return noBackup; }
+	if (lineEnd >= inSize)
+	{
+		peekPos = inSize;
+		isEndOfInput = true;
+		return string(inData + start, lineEnd - start);
+	}
 
-// for unit testing
-string ASConsole::getOptionsFileName()
-{ return optionsFileName; }
+	char ch = inData[lineEnd];
+	peekPos = lineEnd + 1;
 
-// for unit testing
-vector<string> ASConsole::getOptionsVector()
-{ return optionsVector; }
+	// remove end-of-line characters
+	if (peekPos < inSize)
+	{
+		char peekCh = inData[peekPos];
+		if ((peekCh == '\n' || peekCh == '\r') && peekCh != ch)
+			peekPos++;
+	}
+	else
+		isEndOfInput = true;
 
-// for unit testing
-string ASConsole::getOrigSuffix()
-{ return origSuffix; }
+	return string(inData + start, lineEnd - start);
+}
 
-// for unit testing
-bool ASConsole::getPreserveDate()
-{ return preserveDate; }
+// reset current position and end of input for peekNextLine()
+void TRBufferIterator::peekReset()
+{
+	assert(isPeeking);
+	isPeeking = false;
+	isEndOfInput = false;
+}
 
-string ASConsole::getParam(const string &arg, const char* op)
+// save the last input line after input has reached the end
+void TRBufferIterator::saveLastInputLine()
 {
-	return arg.substr(strlen(op));
+	assert(isEndOfInput);
+	prevStart = lineStart;
+	prevLength = lineLength;
 }
 
-// initialize output end of line
-void ASConsole::initializeOutputEOL(LineEndFormat lineEndFormat)
+// check for a change in line ends
+bool TRBufferIterator::getLineEndChange(int lineEndFormat) const
 {
 	assert(lineEndFormat == LINEEND_DEFAULT
 	       || lineEndFormat == LINEEND_WINDOWS
 	       || lineEndFormat == LINEEND_LINUX
 	       || lineEndFormat == LINEEND_MACOLD);
 
-	outputEOL[0] = '\0';		// current line end
-	prevEOL[0] = '\0';			// previous line end
-	lineEndsMixed = false;		// output has mixed line ends, LINEEND_DEFAULT only
-
+	bool lineEndChange = false;
 	if (lineEndFormat == LINEEND_WINDOWS)
-		strcpy(outputEOL, "\r\n");
+		lineEndChange = (eolLinux + eolMacOld != 0);
 	else if (lineEndFormat == LINEEND_LINUX)
-		strcpy(outputEOL, "\n");
+		lineEndChange = (eolWindows + eolMacOld != 0);
 	else if (lineEndFormat == LINEEND_MACOLD)
-		strcpy(outputEOL, "\r");
+		lineEndChange = (eolWindows + eolLinux != 0);
 	else
-		outputEOL[0] = '\0';
+	{
+		if (eolWindows > 0)
+			lineEndChange = (eolLinux + eolMacOld != 0);
+		else if (eolLinux > 0)
+			lineEndChange = (eolWindows + eolMacOld != 0);
+		else if (eolMacOld > 0)
+			lineEndChange = (eolWindows + eolLinux != 0);
+	}
+	return lineEndChange;
 }
 
+//-----------------------------------------------------------------------------
+// ASOutputBuffer class
+//-----------------------------------------------------------------------------
+
+/**
+ * Append a line end to the output.
+ * The position is saved in case the line ends must be converted.
+ *
+ * @param eol           The line end characters.
+ */
+void ASOutputBuffer::appendEOL(const char* eol)
+{
+	size_t eolLength = strlen(eol);
+	lineEnds.push_back(pair<size_t, size_t>(buffer.length(), eolLength));
+	buffer.append(eol, eolLength);
+}
 
-FileEncoding ASConsole::readFile(const string &fileName_, stringstream &in) const
+/**
+ * Convert all line ends in the output to a single line end.
+ * This is needed only if the output has mixed line ends. The saved
+ * line end positions are used and the buffer is changed in place.
+ * If the output grows the lines are moved from the end of the buffer.
+ *
+ * @param eol           The new line end characters.
+ */
+void ASOutputBuffer::convertLineEnds(const char* eol)
 {
-	const int blockSize = 65536;	// 64 KB
-	ifstream fin(fileName_.c_str(), ios::binary);
-	if (!fin)
-		error("Cannot open input file", fileName_.c_str());
-	char* data = new(nothrow) char[blockSize];
-	if (!data)
-		error("Cannot allocate memory for input file", fileName_.c_str());
-	fin.read(data, sizeof(data));
-	if (fin.bad())
-		error("Cannot read input file", fileName_.c_str());
-	size_t dataSize = static_cast<size_t>(fin.gcount());
-	FileEncoding encoding = detectEncoding(data, dataSize);
-	if (encoding ==  UTF_32BE || encoding ==  UTF_32LE)
-		error(_("Cannot process UTF-32 encoding"), fileName_.c_str());
-	bool firstBlock = true;
-	while (dataSize)
-	{
-		if (encoding == UTF_16LE || encoding == UTF_16BE)
-		{
-			// convert utf-16 to utf-8
-			size_t utf8Size = Utf8LengthFromUtf16(data, dataSize, encoding);
-			char* utf8Out = new(nothrow) char[utf8Size];
-			if (!utf8Out)
-				error("Cannot allocate memory for utf-8 conversion", fileName_.c_str());
-			size_t utf8Len = Utf16ToUtf8(data, dataSize, encoding, firstBlock, utf8Out);
-			assert(utf8Len == utf8Size);
-			in << string(utf8Out, utf8Len);
-			delete []utf8Out;
+	assert(strcmp(eol, "\r\n") == 0 || strcmp(eol, "\n") == 0 || strcmp(eol, "\r") == 0);
+	size_t eolLength = strlen(eol);
+	size_t oldSize = buffer.length();
+	size_t newSize = oldSize;
+	for (size_t i = 0; i < lineEnds.size(); i++)
+		newSize = newSize - lineEnds[i].second + eolLength;
+
+	if (newSize > oldSize)
+	{
+		buffer.resize(newSize);
+		char* data = &buffer[0];
+		size_t src = oldSize;		// end of the text to move
+		size_t dst = newSize;		// end of the moved text
+		for (size_t i = lineEnds.size(); i-- > 0;)
+		{
+			size_t textStart = lineEnds[i].first + lineEnds[i].second;
+			size_t textLength = src - textStart;
+			dst -= textLength;
+			memmove(data + dst, data + textStart, textLength);
+			dst -= eolLength;
+			memcpy(data + dst, eol, eolLength);
+			src = lineEnds[i].first;
+			lineEnds[i].first = dst;
+			lineEnds[i].second = eolLength;
 		}
-		else
-			in << string(data, dataSize);
-		fin.read(data, sizeof(data));
-		if (fin.bad())
-			error("Cannot read input file", fileName_.c_str());
-		dataSize = static_cast<size_t>(fin.gcount());
-		firstBlock = false;
+		assert(src == dst);
+	}
+	else
+	{
+		char* data = &buffer[0];
+		size_t src = 0;				// start of the text to move
+		size_t dst = 0;				// start of the moved text
+		for (size_t i = 0; i < lineEnds.size(); i++)
+		{
+			size_t textLength = lineEnds[i].first - src;
+			memmove(data + dst, data + src, textLength);
+			dst += textLength;
+			src = lineEnds[i].first + lineEnds[i].second;
+			memcpy(data + dst, eol, eolLength);
+			lineEnds[i].first = dst;
+			lineEnds[i].second = eolLength;
+			dst += eolLength;
+		}
+		memmove(data + dst, data + src, oldSize - src);
+		buffer.resize(newSize);
 	}
-	fin.close();
-	delete [] data;
-	return encoding;
 }
 
-void ASConsole::setIgnoreExcludeErrors(bool state)
-{ ignoreExcludeErrors = state; }
-
-void ASConsole::setIgnoreExcludeErrorsAndDisplay(bool state)
-{ ignoreExcludeErrors = state; ignoreExcludeErrorsDisplay = state; }
-
-void ASConsole::setIsFormattedOnly(bool state)
-{ isFormattedOnly = state; }
+/**
+ * Release the memory used by the output.
+ */
+void ASOutputBuffer::release()
+{
+	string().swap(buffer);
+	vector<pair<size_t, size_t> >().swap(lineEnds);
+}
 
-void ASConsole::setIsQuiet(bool state)
-{ isQuiet = state; }
+//-----------------------------------------------------------------------------
+// ASFileCache class
+//-----------------------------------------------------------------------------
 
-void ASConsole::setIsRecursive(bool state)
-{ isRecursive = state; }
+static const char cacheFileHeader[] = "TRCACHE1";	// 8 bytes, the NULL is not written
 
-void ASConsole::setIsVerbose(bool state)
-{ isVerbose = state; }
+/**
+ * Add the record of an unchanged file.
+ * The record is written to the cache file by save().
+ * This is called by the main thread only.
+ */
+void ASFileCache::addRecord(uint64_t contentHash, size_t fileSize, int linesOut)
+{
+	ASCacheRecord record;
+	record.contentHash = contentHash;
+	record.optionsHash = optionsHash;
+	record.fileSize = static_cast<uint32_t>(fileSize);
+	record.linesOut = static_cast<uint32_t>(linesOut);
+	if (records.insert(pair<uint64_t, ASCacheRecord>(contentHash, record)).second)
+		newRecords.push_back(record);
+}
 
-void ASConsole::setNoBackup(bool state)
-{ noBackup = state; }
+/**
+ * Find the record of an unchanged file.
+ * The records are not changed while files are formatted,
+ * so this may be called from a worker thread.
+ *
+ * @param contentHash   The hash of the file contents.
+ * @param fileSize      The size of the file.
+ * @param linesOut      Receives the number of output lines of the file.
+ * @return              true if the file is in the cache.
+ */
+bool ASFileCache::findRecord(uint64_t contentHash, size_t fileSize, int &linesOut) const
+{
+	unordered_map<uint64_t, ASCacheRecord>::const_iterator it = records.find(contentHash);
+	if (it == records.end() || it->second.fileSize != static_cast<uint32_t>(fileSize))
+		return false;
+	linesOut = static_cast<int>(it->second.linesOut);
+	return true;
+}
 
-void ASConsole::setOptionsFileName(string name)
-{ optionsFileName = name; }
+/**
+ * Hash a block of data using 64 bit FNV-1a.
+ * A hash may be continued by passing the previous result.
+ */
+uint64_t ASFileCache::hashData(const char* data, size_t dataSize, uint64_t hash /*FNV offset basis*/)
+{
+	const unsigned char* udata = reinterpret_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < dataSize; i++)
+	{
+		hash ^= udata[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
 
-void ASConsole::setOrigSuffix(string suffix)
-{ origSuffix = suffix; }
+/**
+ * Load the records for the current options from the cache file.
+ * A missing or invalid cache file is treated as empty.
+ *
+ * @param fileName      The path and name of the cache file.
+ * @param optionsHash_  The hash of the formatter options for this run.
+ */
+void ASFileCache::load(const string &fileName, uint64_t optionsHash_)
+{
+	cacheFileName = fileName;
+	optionsHash = optionsHash_;
+	records.clear();
+	newRecords.clear();
+	numFileRecords = 0;
 
-void ASConsole::setPreserveDate(bool state)
-{ preserveDate = state; }
+	ifstream fin(cacheFileName.c_str(), ios::binary);
+	if (!fin)
+		return;
+	char header[sizeof(cacheFileHeader) - 1];
+	fin.read(header, sizeof(header));
+	if (fin.gcount() != sizeof(header)
+	        || memcmp(header, cacheFileHeader, sizeof(header)) != 0)
+		return;
+	ASCacheRecord record;
+	while (fin.read(reinterpret_cast<char*>(&record), sizeof(record)))
+	{
+		numFileRecords++;
+		if (record.optionsHash == optionsHash)
+			records.insert(pair<uint64_t, ASCacheRecord>(record.contentHash, record));
+	}
+}
 
-// set outputEOL variable
-void ASConsole::setOutputEOL(LineEndFormat lineEndFormat, const char* currentEOL)
+/**
+ * Write the new records to the cache file.
+ * The records are appended unless the file must be created, or it
+ * has grown large with records that are not used by these options.
+ * Then the file is rewritten with only the records for these options.
+ *
+ * @return              false if the cache file could not be written.
+ */
+bool ASFileCache::save() const
 {
-	if (lineEndFormat == LINEEND_DEFAULT)
-	{
-		strcpy(outputEOL, currentEOL);
-		if (strlen(prevEOL) == 0)
-			strcpy(prevEOL, outputEOL);
-		if (strcmp(prevEOL, outputEOL) != 0)
-		{
-			lineEndsMixed = true;
-			filesAreIdentical = false;
-			strcpy(prevEOL, outputEOL);
-		}
+	if (newRecords.empty() && numFileRecords > 0)
+		return true;
+	bool rewrite = (numFileRecords == 0
+	                || (numFileRecords > 65536 && numFileRecords > records.size() * 2));
+	ofstream fout;
+	if (rewrite)
+	{
+		fout.open(cacheFileName.c_str(), ios::binary | ios::trunc);
+		if (!fout)
+			return false;
+		fout.write(cacheFileHeader, sizeof(cacheFileHeader) - 1);
+		unordered_map<uint64_t, ASCacheRecord>::const_iterator it;
+		for (it = records.begin(); it != records.end(); ++it)
+			fout.write(reinterpret_cast<const char*>(&it->second), sizeof(ASCacheRecord));
 	}
 	else
 	{
-		strcpy(prevEOL, currentEOL);
-		if (strcmp(prevEOL, outputEOL) != 0)
-			filesAreIdentical = false;
+		fout.open(cacheFileName.c_str(), ios::binary | ios::app);
+		if (!fout)
+			return false;
+		for (size_t i = 0; i < newRecords.size(); i++)
+			fout.write(reinterpret_cast<const char*>(&newRecords[i]), sizeof(ASCacheRecord));
 	}
+	fout.close();
+	return !fout.fail();
 }
 
+//-----------------------------------------------------------------------------
+// ASExcludeMatcher class
+//-----------------------------------------------------------------------------
+
 /**
- * WINDOWS function to display the last system error.
+ * Add an exclude to the trie.
+ * If the same exclude is added more than once the first index is kept.
+ *
+ * @param exclude       The exclude with standardized separators.
+ * @param excludeIndex  The index of the exclude in the excludeVector.
  */
-void ASConsole::displayLastError()
+void ASExcludeMatcher::addExclude(const string &exclude, size_t excludeIndex)
 {
-	LPSTR msgBuf;
-	DWORD lastError = GetLastError();
-	FormatMessage(
-	    FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM,
-	    NULL,
-	    lastError,
-	    MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),  // Default language
-	    (LPSTR) &msgBuf,
-	    0,
-	    NULL
-	);
-	// Display the string.
-	(*_err) << "Error (" << lastError << ") " << msgBuf << endl;
-	// Free the buffer.
-	LocalFree(msgBuf);
+	int node = 0;
+	for (size_t i = exclude.length(); i-- > 0;)
+	{
+		char ch = exclude[i];
+		if (!isCaseSensitive)
+			ch = static_cast<char>(tolower(static_cast<unsigned char>(ch)));
+		int next = -1;
+		for (size_t j = 0; j < nodes[node].children.size(); j++)
+		{
+			if (nodes[node].children[j].first == ch)
+			{
+				next = nodes[node].children[j].second;
+				break;
+			}
+		}
+		if (next < 0)
+		{
+			next = static_cast<int>(nodes.size());
+			nodes[node].children.push_back(pair<char, int>(ch, next));
+			nodes.resize(nodes.size() + 1);
+		}
+		node = next;
+	}
+	if (node > 0 && nodes[node].excludeIndex < 0)
+		nodes[node].excludeIndex = static_cast<int>(excludeIndex);
 }
 
 /**
- * WINDOWS function to get the current directory.
- * NOTE: getenv("CD") does not work for Windows Vista.
- *        	The Windows function GetCurrentDirectory is used instead.
+ * Find the exclude that matches the end of a path.
+ * The exclude must be the whole path or follow a directory separator.
+ * If more than one exclude matches, the one added first is returned.
  *
- * @return	The path of the current directory
+ * @param path          The path of the file or directory.
+ * @return              The index of the exclude, or -1 if none matches.
  */
-string ASConsole::getCurrentDirectory(const string &fileName_) const
+int ASExcludeMatcher::findExclude(const string &path) const
 {
-	char currdir[MAX_PATH];
-	currdir[0] = '\0';
-	if (!GetCurrentDirectory(sizeof(currdir), currdir))
-		error("Cannot find file", fileName_.c_str());
-	return string(currdir);
+	int excludeIndex = -1;
+	int node = 0;
+	for (size_t i = path.length(); i-- > 0;)
+	{
+		char ch = path[i];
+		if (!isCaseSensitive)
+			ch = static_cast<char>(tolower(static_cast<unsigned char>(ch)));
+		int next = -1;
+		for (size_t j = 0; j < nodes[node].children.size(); j++)
+		{
+			if (nodes[node].children[j].first == ch)
+			{
+				next = nodes[node].children[j].second;
+				break;
+			}
+		}
+		if (next < 0)
+			break;
+		node = next;
+		// the exclude matches if it starts a directory name
+		int nodeIndex = nodes[node].excludeIndex;
+		if (nodeIndex >= 0
+		        && (excludeIndex < 0 || nodeIndex < excludeIndex)
+		        && (i == 0 || path[i - 1] == fileSeparator))
+			excludeIndex = nodeIndex;
+	}
+	return excludeIndex;
+}
+
+void ASExcludeMatcher::setFileSystem(char fileSeparator_, bool isCaseSensitive_)
+{
+	fileSeparator = fileSeparator_;
+	isCaseSensitive = isCaseSensitive_;
 }
 
+//-----------------------------------------------------------------------------
+// ASWildcardMatcher class
+//-----------------------------------------------------------------------------
+
 /**
- * WINDOWS function to resolve wildcards and recurse into sub directories.
- * The fileName vector is filled with the path and names of files to process.
+ * Compile a wildcard with the characters '*' and '?'.
  *
- * @param directory     The path of the directory to be processed.
- * @param wildcard      The wildcard to be processed (e.g. *.cpp).
+ * @param wildcard          The file name wildcard.
+ * @param isCaseSensitive_  The file names are case sensitive on the platform.
  */
-void ASConsole::getFileNames(const string &directory, const string &wildcard)
+void ASWildcardMatcher::compile(const string &wildcard, bool isCaseSensitive_)
 {
-	vector<string> subDirectory;    // sub directories of directory
-	WIN32_FIND_DATA findFileData;   // for FindFirstFile and FindNextFile
+	isCaseSensitive = isCaseSensitive_;
+	parts.clear();
+	parts.push_back(string());
+	for (size_t i = 0; i < wildcard.length(); i++)
+	{
+		if (wildcard[i] == '*')
+			parts.push_back(string());
+		else if (!isCaseSensitive)
+			parts.back().append(1, static_cast<char>(tolower(static_cast<unsigned char>(wildcard[i]))));
+		else
+			parts.back().append(1, wildcard[i]);
+	}
+	hasStar = (parts.size() > 1);
+}
 
-	// Find the first file in the directory
-	// Find will get at least "." and "..".
-	string firstFile = directory + "\\*";
-	HANDLE hFind = FindFirstFile(firstFile.c_str(), &findFileData);
+/**
+ * Compare a file name to the compiled wildcard.
+ *
+ * @param name          The file name without a directory.
+ * @return              true if the name matches the wildcard.
+ */
+bool ASWildcardMatcher::isMatch(const char* name) const
+{
+	size_t nameLength = strlen(name);
+	const string &first = parts.front();
+	if (!hasStar)
+		return (nameLength == first.length() && isPartMatch(name, first));
+
+	const string &last = parts.back();
+	if (nameLength < first.length() + last.length()
+	        || !isPartMatch(name, first)
+	        || !isPartMatch(name + nameLength - last.length(), last))
+		return false;
 
-	if (hFind == INVALID_HANDLE_VALUE)
+	// the other parts are found in order between the first and the last
+	size_t namePos = first.length();
+	size_t nameEnd = nameLength - last.length();
+	for (size_t i = 1; i + 1 < parts.size(); i++)
 	{
-		// Error (3) The system cannot find the path specified.
-		// Error (123) The filename, directory name, or volume label syntax is incorrect.
-		// ::FindClose(hFind); before exiting
-		displayLastError();
+		const string &part = parts[i];
+		while (namePos + part.length() <= nameEnd && !isPartMatch(name + namePos, part))
+			namePos++;
+		if (namePos + part.length() > nameEnd)
+			return false;
+		namePos += part.length();
+	}
+	return true;
+}
+
+// compare the beginning of name to a part, a '?' matches any character
+bool ASWildcardMatcher::isPartMatch(const char* name, const string &part) const
+{
+	for (size_t i = 0; i < part.length(); i++)
+	{
+		char ch = name[i];
+		if (!isCaseSensitive)
+			ch = static_cast<char>(tolower(static_cast<unsigned char>(ch)));
+		if (ch != part[i] && part[i] != '?')
+			return false;
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// ASConsole class
+// main function will be included only in the console build
+//-----------------------------------------------------------------------------
+
+// set a worker formatter to the same options as the console formatter
+// the options have already been checked for errors by processOptions
+void ASConsole::configureFormatter(TRFormatter &fileFormatter)
+{
+	ASOptions options(fileFormatter);
+	options.parseOptions(fileOptionsVector, string());
+	options.parseOptions(optionsVector, string());
+}
+
+// check files for 16 or 32 bit encoding
+// the file must have a Byte Order Mark (BOM)
+// NOTE: some string functions don't work with NULLs (e.g. length())
+FileEncoding ASConsole::detectEncoding(const char* data, size_t dataSize) const
+{
+	FileEncoding encoding = ENCODING_8BIT;
+
+	if (dataSize >= 4 && memcmp(data, "\x00\x00\xFE\xFF", 4) == 0)
+		encoding = UTF_32BE;
+	else if (dataSize >= 4 && memcmp(data, "\xFF\xFE\x00\x00", 4) == 0)
+		encoding = UTF_32LE;
+	else if (dataSize >= 2 && memcmp(data, "\xFE\xFF", 2) == 0)
+		encoding = UTF_16BE;
+	else if (dataSize >= 2 && memcmp(data, "\xFF\xFE", 2) == 0)
+		encoding = UTF_16LE;
+
+	return encoding;
+}
+
+// error exit without a message
+void ASConsole::error() const
+{
+	(*_err) << _("\nArtistic Style has terminated") << endl;
+	exit(EXIT_FAILURE);
+}
+
+// error exit with a message
+void ASConsole::error(const char* why, const char* what) const
+{
+	(*_err) << why << ' ' << what << endl;
+	error();
+}
+
+/**
+ * Format a buffer to a string. This is used for the server requests and by
+ * a client that cannot reach the server. The line ends are output the same
+ * as formatCinToCout.
+ *
+ * @param bufferFormatter   The formatter to use, the server has one for each options.
+ * @param data              The text to be formatted.
+ * @param dataSize          The size of the text.
+ * @param out               Receives the formatted text.
+ */
+void ASConsole::formatBuffer(TRFormatter &bufferFormatter, const char* data, size_t dataSize,
+                             string &out) const
+{
+	TRBufferIterator streamIterator(data, dataSize);
+	ASFileResult result;
+	LineEndFormat lineEndFormat = bufferFormatter.getLineEndFormat();
+	initializeOutputEOL(lineEndFormat, result);
+	bufferFormatter.init(&streamIterator);
+	out.clear();
+	out.reserve(dataSize + dataSize / 8);
+
+	while (bufferFormatter.hasMoreLines())
+	{
+		out.append(bufferFormatter.nextLine());
+		if (bufferFormatter.hasMoreLines())
+		{
+			setOutputEOL(lineEndFormat, streamIterator.getOutputEOL(), result);
+			out.append(result.outputEOL);
+		}
+		else
+		{
+			// this can happen if the file if missing a closing bracket and break-blocks is requested
+			if (bufferFormatter.getIsLineReady())
+			{
+				setOutputEOL(lineEndFormat, streamIterator.getOutputEOL(), result);
+				out.append(result.outputEOL);
+				out.append(bufferFormatter.nextLine());
+			}
+		}
+	}
+	bufferFormatter.releaseFileStacks();
+}
+
+/**
+ * If no files have been given, use cin for input and cout for output.
+ *
+ * This is used to format text for text editors like TextWrangler (Mac).
+ * Do NOT display any console messages when this function is used.
+ */
+void ASConsole::formatCinToCout()
+{
+	// The input is read sequentially by the stream iterator, so the
+	// formatted lines are output while the rest of the input is read.
+	// The input is not positioned since cin.tellg() is not valid for pipes.
+	istream* inStream = &cin;
+	if (!lineRanges.empty())
+	{
+		// the line ranges need the complete input
+		string inData((istreambuf_iterator<char>(*inStream)), istreambuf_iterator<char>());
+		formatLineRanges(inData.c_str(), inData.length());
+		return;
+	}
+	if (!socketName.empty())
+	{
+		// the server does the formatting if it is running
+		string inData((istreambuf_iterator<char>(*inStream)), istreambuf_iterator<char>());
+		string outData;
+		if (!formatWithServer(inData, outData))
+			formatBuffer(formatter, inData.c_str(), inData.length(), outData);
+		cout << outData;
+		cout.flush();
+		return;
+	}
+	TRStreamIterator<istream> streamIterator(inStream);
+	ASFileResult result;
+	// Windows pipe or redirection always outputs Windows line-ends.
+	// Linux pipe or redirection will output any line end.
+	LineEndFormat lineEndFormat = formatter.getLineEndFormat();
+	initializeOutputEOL(lineEndFormat, result);
+	formatter.init(&streamIterator);
+
+	while (formatter.hasMoreLines())
+	{
+		cout << formatter.nextLine();
+		if (formatter.hasMoreLines())
+		{
+			setOutputEOL(lineEndFormat, streamIterator.getOutputEOL(), result);
+			cout << result.outputEOL;
+		}
+		else
+		{
+			// this can happen if the file if missing a closing bracket and break-blocks is requested
+			if (formatter.getIsLineReady())
+			{
+				setOutputEOL(lineEndFormat, streamIterator.getOutputEOL(), result);
+				cout << result.outputEOL;
+				cout << formatter.nextLine();
+			}
+		}
+	}
+	cout.flush();
+	lineEndsMixed = result.lineEndsMixed;
+}
+
+/**
+ * Format only the lines in the lines= ranges and copy the other lines to
+ * cout unchanged. This is used by editors to format the changed lines.
+ * Each range is formatted from the nearest sync line above it, so the time
+ * is about proportional to the range instead of the file. If the formatter
+ * joins a line above the range to the range, that line is also replaced.
+ *
+ * @param data          The input buffer.
+ * @param dataSize      The size of the input buffer.
+ */
+void ASConsole::formatLineRanges(const char* data, size_t dataSize)
+{
+	// sort and merge the ranges
+	vector<pair<size_t, size_t> > ranges = lineRanges;
+	sort(ranges.begin(), ranges.end());
+	size_t merged = 0;
+	for (size_t i = 1; i < ranges.size(); i++)
+	{
+		if (ranges[i].first <= ranges[merged].second + 1)
+			ranges[merged].second = max(ranges[merged].second, ranges[i].second);
+		else
+			ranges[++merged] = ranges[i];
+	}
+	ranges.resize(merged + 1);
+
+	vector<size_t> lineStart;
+	vector<bool> isSyncLine;
+	findSyncLines(data, dataSize, ranges.back().second, lineStart, isSyncLine);
+	size_t lineCount = lineStart.size() - 1;
+
+	ASFileResult result;
+	initializeOutputEOL(formatter.getLineEndFormat(), result);
+
+	// A range does not include the line end of its last line, so the formatter
+	// has not seen a line end when a one line range is split. The line ends
+	// of the document are used until the range has its own.
+	size_t eolWindows = 0;
+	size_t eolLinux = 0;
+	size_t eolMacOld = 0;
+	for (size_t i = 0; i < lineCount; i++)
+	{
+		size_t lineEnd = getLineEnd(data, lineStart, i);
+		size_t eolLength = lineStart[i + 1] - lineEnd;
+		if (eolLength == 2)
+			eolWindows++;
+		else if (eolLength == 1 && data[lineEnd] == '\n')
+			eolLinux++;
+		else if (eolLength == 1)
+			eolMacOld++;
+	}
+	const char* documentEOL = "\n";		// used if the input has no line ends
+	if (eolWindows + eolLinux + eolMacOld > 0)
+	{
+		if (eolWindows >= eolLinux)
+			documentEOL = (eolWindows >= eolMacOld) ? "\r\n" : "\r";
+		else if (eolLinux < eolMacOld)
+			documentEOL = "\r";
+	}
+
+	// the formatted text replaces the input from replaceStart thru lastLine
+	struct FormattedRange
+	{
+		size_t firstLine;
+		size_t lastLine;
+		size_t replaceStart;
+		string text;
+	};
+	vector<FormattedRange> formattedRanges;
+	for (size_t i = 0; i < ranges.size(); i++)
+	{
+		if (ranges[i].first >= lineCount)
+			break;
+		FormattedRange range;
+		range.firstLine = ranges[i].first;
+		range.lastLine = min(ranges[i].second, lineCount - 1);
+		while (true)
+		{
+			range.replaceStart = formatLineRange(data, lineStart, isSyncLine, range.firstLine,
+			                                     range.lastLine, documentEOL, range.text, result);
+			// a joined line may reach back into the previous range
+			if (formattedRanges.empty()
+			        || range.replaceStart >= lineStart[formattedRanges.back().lastLine + 1])
+				break;
+			range.firstLine = formattedRanges.back().firstLine;
+			formattedRanges.pop_back();
+		}
+		// the lines outside of the range should not be changed, so tell the editor
+		if (range.replaceStart < lineStart[range.firstLine])
+		{
+			size_t replaceLine = upper_bound(lineStart.begin(), lineStart.end(),
+			                                 range.replaceStart) - lineStart.begin() - 1;
+			(*_err) << _("Lines joined to the range were also formatted: ")
+			        << replaceLine + 1 << ':' << range.firstLine << endl;
+		}
+		formattedRanges.push_back(range);
+	}
+
+	size_t outPos = 0;
+	for (size_t i = 0; i < formattedRanges.size(); i++)
+	{
+		cout.write(data + outPos, formattedRanges[i].replaceStart - outPos);
+		cout << formattedRanges[i].text;
+		outPos = lineStart[formattedRanges[i].lastLine + 1];
+	}
+	cout.write(data + outPos, dataSize - outPos);
+	cout.flush();
+	lineEndsMixed = result.lineEndsMixed;
+}
+
+/**
+ * Format one range for formatLineRanges().
+ * The lines from the sync line to the range are formatted twice, alone and
+ * followed by the range. If the output is the same, the remaining output is
+ * the range. Otherwise the formatter has joined the lines at the start of
+ * the range and the range is started one line higher.
+ *
+ * @param data          The input buffer.
+ * @param lineStart     The start positions of the input lines.
+ * @param isSyncLine    The lines where the formatting can start.
+ * @param firstLine     The first line of the range, zero based.
+ * @param lastLine      The last line of the range, zero based.
+ * @param documentEOL   The line end used until the range has a line end.
+ * @param text          Receives the formatted range.
+ * @param result        Receives the output line ends.
+ * @return              The start of the input replaced by text.
+ */
+size_t ASConsole::formatLineRange(const char* data, const vector<size_t> &lineStart,
+                                  const vector<bool> &isSyncLine, size_t firstLine,
+                                  size_t lastLine, const char* documentEOL, string &text,
+                                  ASFileResult &result)
+{
+	size_t syncLine = firstLine;
+	while (syncLine > 0 && !isSyncLine[syncLine])
+		syncLine--;
+
+	vector<string> rangeLines;
+	vector<string> rangeEOLs;
+	size_t rangeEnd = getLineEnd(data, lineStart, lastLine);
+	formatLines(data + lineStart[syncLine], rangeEnd - lineStart[syncLine], documentEOL,
+	            rangeLines, rangeEOLs, result);
+
+	size_t linesBefore = 0;			// output lines before the range
+	if (firstLine > syncLine)
+	{
+		vector<string> syncLines;
+		vector<string> syncEOLs;
+		ASFileResult syncResult;
+		initializeOutputEOL(formatter.getLineEndFormat(), syncResult);
+		for (int retry = 0; ; retry++)
+		{
+			syncLines.clear();
+			syncEOLs.clear();
+			formatLines(data + lineStart[syncLine],
+			            getLineEnd(data, lineStart, firstLine - 1) - lineStart[syncLine],
+			            documentEOL, syncLines, syncEOLs, syncResult);
+			if (syncLines.size() <= rangeLines.size()
+			        && equal(syncLines.begin(), syncLines.end(), rangeLines.begin()))
+			{
+				linesBefore = syncLines.size();
+				break;
+			}
+			// the lines were joined, a few tries then start at the sync line
+			if (retry < 3 && firstLine - 1 > syncLine)
+				firstLine--;
+			else
+			{
+				firstLine = syncLine;
+				break;
+			}
+		}
+	}
+
+	text.clear();
+	for (size_t i = linesBefore; i < rangeLines.size(); i++)
+	{
+		text.append(rangeLines[i]);
+		text.append(rangeEOLs[i]);
+	}
+	// the last line keeps its line end unless the line end is changed
+	if (rangeEnd < lineStart[lastLine + 1])
+	{
+		if (formatter.getLineEndFormat() != LINEEND_DEFAULT)
+			text.append(result.outputEOL);
+		else
+			text.append(data + rangeEnd, lineStart[lastLine + 1] - rangeEnd);
+	}
+	return lineStart[firstLine];
+}
+
+/**
+ * Get the end of a line without the line end characters.
+ *
+ * @param data          The input buffer.
+ * @param lineStart     The start positions of the input lines.
+ * @param line          The line number, zero based.
+ * @return              The position of the line end characters.
+ */
+size_t ASConsole::getLineEnd(const char* data, const vector<size_t> &lineStart, size_t line) const
+{
+	size_t lineEnd = lineStart[line + 1];
+	if (lineEnd > lineStart[line] && (data[lineEnd - 1] == '\n' || data[lineEnd - 1] == '\r'))
+	{
+		lineEnd--;
+		if (lineEnd > lineStart[line] && data[lineEnd] == '\n' && data[lineEnd - 1] == '\r')
+			lineEnd--;
+	}
+	return lineEnd;
+}
+
+/**
+ * Format a part of the input for the line ranges.
+ *
+ * @param data          The input to format.
+ * @param dataSize      The size of the input.
+ * @param documentEOL   The line end used until the input has a line end.
+ * @param lines         Receives the formatted lines.
+ * @param lineEnds      Receives the line end following each line, empty for the last line.
+ * @param result        Receives the output line ends.
+ */
+void ASConsole::formatLines(const char* data, size_t dataSize, const char* documentEOL,
+                            vector<string> &lines, vector<string> &lineEnds, ASFileResult &result)
+{
+	LineEndFormat lineEndFormat = formatter.getLineEndFormat();
+	TRBufferIterator streamIterator(data, dataSize);
+	formatter.init(&streamIterator);
+
+	while (formatter.hasMoreLines())
+	{
+		lines.push_back(formatter.nextLine());
+		lineEnds.push_back(string());
+		const char* inputEOL = streamIterator.getOutputEOL();
+		if (inputEOL[0] == '\0')
+			inputEOL = documentEOL;
+		if (formatter.hasMoreLines())
+		{
+			setOutputEOL(lineEndFormat, inputEOL, result);
+			lineEnds.back() = result.outputEOL;
+		}
+		else
+		{
+			// this can happen if the file if missing a closing bracket and break-blocks is requested
+			if (formatter.getIsLineReady())
+			{
+				setOutputEOL(lineEndFormat, inputEOL, result);
+				lineEnds.back() = result.outputEOL;
+				lines.push_back(formatter.nextLine());
+				lineEnds.push_back(string());
+			}
+		}
+	}
+	formatter.releaseFileStacks();
+}
+
+/**
+ * Find the start of the lines and the lines where the formatting of a line range
+ * can start. A sync line begins after a complete statement and outside of any
+ * bracket, paren, comment, quote, preprocessor conditional, or formatting-off
+ * region. The formatter has the same state at a sync line as at the start of the
+ * file. An include guard is not counted as a preprocessor conditional.
+ *
+ * @param data          The input buffer.
+ * @param dataSize      The size of the input buffer.
+ * @param lastLine      The last line needed, zero based.
+ * @param lineStart     Receives the start of the lines thru the line after lastLine.
+ *                      The start of the line after the input is dataSize.
+ * @param isSyncLine    Receives true for the sync lines.
+ */
+void ASConsole::findSyncLines(const char* data, size_t dataSize, size_t lastLine,
+                              vector<size_t> &lineStart, vector<bool> &isSyncLine) const
+{
+	int  bracketDepth = 0;
+	int  parenDepth = 0;
+	int  preprocDepth = 0;
+	bool isInComment = false;
+	bool isInRawString = false;           // C++ raw string or C# verbatim string
+	bool isContinued = false;             // the previous line ended with a backslash
+	bool isPreprocLine = false;           // in a preprocessor line or its continuation
+	bool isStatementEnd = true;           // the last code ended a statement
+	bool hasCode = false;                 // code has been found, for the include guard
+	bool isFormattingOff = false;         // in a formatting-off region
+	int  guardState = 0;                  // 1 = #ifndef is first, 2 = in the include guard
+	char quoteChar = ' ';                 // the open quote, a space if none
+	string guardName;
+	string rawEnd;                        // the end of the raw string
+	const string offMarker = "*INDENT-OFF*";
+	const string onMarker = "*INDENT-ON*";
+	// check for a marker as the first text of the comment text from start to end
+	auto hasMarker = [data](const string &marker, size_t start, size_t end)
+	{
+		while (start < end && (data[start] == ' ' || data[start] == '\t'))
+			start++;
+		return (end - start >= marker.length()
+		        && marker.compare(0, string::npos, data + start, marker.length()) == 0);
+	};
+
+	size_t pos = 0;
+	for (size_t lineNum = 0; lineNum <= lastLine + 1; lineNum++)
+	{
+		lineStart.push_back(pos);
+		isSyncLine.push_back(bracketDepth == 0 && parenDepth == 0 && preprocDepth == 0
+		                     && !isInComment && !isInRawString && quoteChar == ' '
+		                     && !isContinued && isStatementEnd && !isFormattingOff);
+		if (pos >= dataSize)
+			break;
+
+		size_t lineEnd = pos;
+		while (lineEnd < dataSize && data[lineEnd] != '\n' && data[lineEnd] != '\r')
+			lineEnd++;
+		size_t next = lineEnd;
+		if (next < dataSize)
+			next++;
+		if (next < dataSize && data[lineEnd] == '\r' && data[next] == '\n')
+			next++;
+
+		if (!isContinued)
+			isPreprocLine = false;
+		bool isLineStart = !isContinued;
+		// the markers are used only at the start of a comment, as by the formatter
+		// the line containing the ON marker is the last line of the region
+		bool isFormattingOffEnd = false;
+		size_t commentStart = pos;            // the start of the comment text on the line
+		for (size_t i = pos; i < lineEnd; i++)
+		{
+			char ch = data[i];
+			if (isInComment)
+			{
+				if (ch == '*' && i + 1 < lineEnd && data[i + 1] == '/')
+				{
+					if (isFormattingOff && hasMarker(onMarker, commentStart, i))
+						isFormattingOffEnd = true;
+					isInComment = false;
+					i++;
+				}
+				continue;
+			}
+			if (isInRawString)
+			{
+				if (data[i] == rawEnd[0] && rawEnd.compare(0, string::npos, data + i,
+				        min(rawEnd.length(), lineEnd - i)) == 0)
+				{
+					isInRawString = false;
+					i += rawEnd.length() - 1;
+				}
+				else if (rawEnd == "\"" && ch == '"')
+					i++;				// escaped quote in a verbatim string
+				continue;
+			}
+			if (quoteChar != ' ')
+			{
+				if (ch == '\\')
+					i++;
+				else if (ch == quoteChar)
+					quoteChar = ' ';
+				continue;
+			}
+			if (ch == ' ' || ch == '\t')
+				continue;
+
+			if (ch == '#' && isLineStart)
+			{
+				// get the directive and the name following it
+				size_t word = i + 1;
+				while (word < lineEnd && (data[word] == ' ' || data[word] == '\t'))
+					word++;
+				size_t wordEnd = word;
+				while (wordEnd < lineEnd && isalpha((unsigned char) data[wordEnd]))
+					wordEnd++;
+				string directive(data + word, wordEnd - word);
+				size_t name = wordEnd;
+				while (name < lineEnd && (data[name] == ' ' || data[name] == '\t'))
+					name++;
+				size_t nameEnd = name;
+				while (nameEnd < lineEnd && (isalnum((unsigned char) data[nameEnd]) || data[nameEnd] == '_'))
+					nameEnd++;
+				string macro(data + name, nameEnd - name);
+
+				if (guardState == 1)
+				{
+					// an #ifndef followed by #define of the same name is an include guard
+					if (directive == "define" && macro == guardName)
+					{
+						guardState = 2;
+						preprocDepth--;
+					}
+					else
+						guardState = 0;
+				}
+				if (directive.compare(0, 2, "if") == 0)
+				{
+					if (directive == "ifndef" && !hasCode && preprocDepth == 0 && guardState == 0)
+					{
+						guardState = 1;
+						guardName = macro;
+					}
+					preprocDepth++;
+				}
+				else if (directive == "endif")
+				{
+					if (preprocDepth == 0 && guardState == 2)
+						guardState = 0;
+					else
+						preprocDepth--;
+				}
+				isPreprocLine = true;
+				i = wordEnd - 1;
+				isLineStart = false;
+				continue;
+			}
+			isLineStart = false;
+
+			// the region begins on the line after a comment containing the OFF marker
+			if (ch == '/' && i + 1 < lineEnd && data[i + 1] == '/')
+			{
+				if (isFormattingOff && hasMarker(onMarker, i + 2, lineEnd))
+					isFormattingOffEnd = true;
+				else if (hasMarker(offMarker, i + 2, lineEnd))
+					isFormattingOff = true;
+				break;
+			}
+			if (ch == '/' && i + 1 < lineEnd && data[i + 1] == '*')
+			{
+				const char* commentEnd = search(data + i + 2, data + lineEnd, "*/", "*/" + 2);
+				if (!isFormattingOff && hasMarker(offMarker, i + 2, commentEnd - data))
+					isFormattingOff = true;
+				isInComment = true;
+				commentStart = i + 2;
+				i++;
+				continue;
+			}
+			if (ch == '"' || ch == '\'')
+			{
+				// a raw string R"delim( is ended by )delim"
+				if (ch == '"' && i > pos && data[i - 1] == 'R')
+				{
+					size_t paren = i + 1;
+					while (paren < lineEnd && data[paren] != '(' && paren - i <= 16)
+						paren++;
+					if (paren < lineEnd && data[paren] == '(')
+					{
+						rawEnd = ")" + string(data + i + 1, paren - i - 1) + "\"";
+						isInRawString = true;
+						i = paren;
+						continue;
+					}
+				}
+				// a C# verbatim string @" is ended by a single "
+				else if (ch == '"' && i > pos && data[i - 1] == '@')
+				{
+					rawEnd = "\"";
+					isInRawString = true;
+					continue;
+				}
+				// a digit separator is not a quote
+				else if (ch == '\'' && i > pos && isdigit((unsigned char) data[i - 1]))
+					continue;
+				quoteChar = ch;
+				continue;
+			}
+			if (isPreprocLine)
+				continue;
+
+			hasCode = true;
+			if (ch == '{')
+				bracketDepth++;
+			else if (ch == '}')
+				bracketDepth--;
+			else if (ch == '(')
+				parenDepth++;
+			else if (ch == ')')
+				parenDepth--;
+			isStatementEnd = (ch == ';' || ch == '}');
+		}
+
+		if (isInComment && isFormattingOff && hasMarker(onMarker, commentStart, lineEnd))
+			isFormattingOffEnd = true;
+		isContinued = (lineEnd > pos && data[lineEnd - 1] == '\\'
+		               && !isInComment && !isInRawString);
+		if (!isContinued)
+			quoteChar = ' ';			// an unterminated quote ends with the line
+		if (isFormattingOffEnd)
+			isFormattingOff = false;
+		pos = next;
+	}
+}
+
+/**
+ * Open input file, format it, and close the output.
+ *
+ * @param fileName_     The path and name of the file to be processed.
+ */
+void ASConsole::formatFile(const string &fileName_)
+{
+	ASFileResult result;
+	result.fileName = fileName_;
+	formatFileResult(formatter, result);
+	reportFileResult(result);
+}
+
+/**
+ * Format a file using the given formatter and write it if it has changed.
+ * No messages are displayed and no ASConsole variables are changed,
+ * so this may be called from a worker thread with its own formatter.
+ *
+ * @param fileFormatter The formatter to use for this file.
+ * @param result        The file to be processed, receives the output and line counts.
+ */
+void ASConsole::formatFileResult(TRFormatter &fileFormatter, ASFileResult &result) const
+{
+	ASFileBuffer in;
+	if (!readFile(in, result))
+		return;
+
+	// a file that was unchanged with the same options is not formatted
+	if (!cacheFileName.empty())
+	{
+		result.fileSize = in.getSize();
+		result.contentHash = ASFileCache::hashData(in.getData(), in.getSize());
+		if (fileCache.findRecord(result.contentHash, result.fileSize, result.linesOut))
+		{
+			result.isCached = true;
+			return;
+		}
+	}
+
+	// Unless a specific language mode has been set, set the language mode
+	// according to the file's suffix.
+	if (!fileFormatter.getModeManuallySet())
+	{
+		fileFormatter.setCStyle();
+	}
+
+	// set line end format
+	string nextLine;				// next output line
+	result.filesAreIdentical = true;
+	LineEndFormat lineEndFormat = fileFormatter.getLineEndFormat();
+	initializeOutputEOL(lineEndFormat, result);
+	// a dry run only compares the lines so there is no output
+	// allow for added indentation so the output is seldom reallocated
+	if (!isDryRun)
+		result.out.reserve(in.getSize() + in.getSize() / 8);
+	// do this AFTER setting the file mode
+	TRBufferIterator streamIterator(in.getData(), in.getSize());
+	fileFormatter.init(&streamIterator);
+
+	// format the file
+	while (fileFormatter.hasMoreLines())
+	{
+		nextLine = fileFormatter.nextLine();
+		if (!isDryRun)
+			result.out.appendLine(nextLine);
+		result.linesOut++;
+		if (fileFormatter.hasMoreLines())
+		{
+			setOutputEOL(lineEndFormat, streamIterator.getOutputEOL(), result);
+			if (!isDryRun)
+				result.out.appendEOL(result.outputEOL);
+		}
+		else
+		{
+			streamIterator.saveLastInputLine();     // to compare the last input line
+			// this can happen if the file if missing a closing bracket and break-blocks is requested
+			if (fileFormatter.getIsLineReady())
+			{
+				setOutputEOL(lineEndFormat, streamIterator.getOutputEOL(), result);
+				nextLine = fileFormatter.nextLine();
+				if (!isDryRun)
+				{
+					result.out.appendEOL(result.outputEOL);
+					result.out.appendLine(nextLine);
+				}
+				result.linesOut++;
+				streamIterator.saveLastInputLine();
+			}
+		}
+
+		// a line of a formatting-off region is the input line
+		if (result.filesAreIdentical && !fileFormatter.getIsLineUnformatted())
+		{
+			if (streamIterator.checkForEmptyLine)
+			{
+				if (nextLine.find_first_not_of(" \t") != string::npos)
+					result.filesAreIdentical = false;
+			}
+			else if (!streamIterator.compareToInputBuffer(nextLine))
+				result.filesAreIdentical = false;
+			streamIterator.checkForEmptyLine = false;
+		}
+
+		// a dry run stops at the first change, the rest of the file is not needed
+		if (isDryRun
+		        && (!result.filesAreIdentical || streamIterator.getLineEndChange(lineEndFormat)))
+			break;
+	}
+	// the stacks are released in one reset of the file arena
+	fileFormatter.releaseFileStacks();
+
+	// a dry run reports a changed file as formatted but does not write it
+	if (isDryRun)
+	{
+		result.isFormatted = !result.filesAreIdentical
+		                     || streamIterator.getLineEndChange(lineEndFormat);
+		return;
+	}
+
+	// correct for mixed line ends
+	if (result.lineEndsMixed)
+	{
+		result.out.convertLineEnds(result.outputEOL);
+		result.filesAreIdentical = false;
+	}
+
+	// if file has changed, write the new file
+	if (!result.filesAreIdentical || streamIterator.getLineEndChange(lineEndFormat))
+	{
+		// a memory mapped input must be released before the file is replaced
+		in.unmapFile();
+		if (!writeFile(result))
+			return;
+		result.isFormatted = true;
+	}
+
+	assert(fileFormatter.getChecksumDiff() == 0);
+}
+
+/**
+ * Format the files in the fileName vector.
+ */
+void ASConsole::formatFiles()
+{
+	if (numJobs > 1 && fileName.size() > 1)
+		formatFilesInParallel();
+	else
+	{
+		for (size_t i = 0; i < fileName.size(); i++)
+			formatFile(fileName[i]);
+	}
+}
+
+/**
+ * Format the files in the fileName vector using numJobs worker threads.
+ * Each worker has its own TRFormatter. The results are reported in the
+ * order of the fileName vector so the display and totals are the same
+ * as a single threaded run. A file error is reported on this thread
+ * after the workers have finished the files they started.
+ */
+void ASConsole::formatFilesInParallel()
+{
+	size_t numThreads = min(static_cast<size_t>(numJobs), fileName.size());
+	vector<ASFileResult> results(fileName.size());
+	for (size_t i = 0; i < fileName.size(); i++)
+		results[i].fileName = fileName[i];
+
+	size_t nextFile = 0;			// next file to be formatted by a worker
+	mutex resultMutex;				// guards nextFile and isDone
+	condition_variable resultReady;	// signaled when a file is done
+
+	vector<thread> workers;
+	for (size_t t = 0; t < numThreads; t++)
+	{
+		workers.push_back(thread([&]()
+		{
+			// the formatter is created on the worker thread
+			TRFormatter fileFormatter;
+			configureFormatter(fileFormatter);
+			while (true)
+			{
+				size_t i;
+				{
+					lock_guard<mutex> lock(resultMutex);
+					if (nextFile >= results.size())
+						break;
+					i = nextFile++;
+				}
+				formatFileResult(fileFormatter, results[i]);
+				{
+					lock_guard<mutex> lock(resultMutex);
+					results[i].isDone = true;
+				}
+				resultReady.notify_all();
+			}
+		}));
+	}
+
+	// report the files in order as they are completed
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		{
+			unique_lock<mutex> lock(resultMutex);
+			resultReady.wait(lock, [&]() { return results[i].isDone; });
+			// an error ends the run, so no more files are started
+			if (results[i].errorMsg != NULL)
+				nextFile = results.size();
+		}
+		// the workers are stopped before the error exits from this thread
+		if (results[i].errorMsg != NULL)
+		{
+			for (size_t t = 0; t < workers.size(); t++)
+				workers[t].join();
+			workers.clear();
+		}
+		reportFileResult(results[i]);
+		results[i].out.release();
+	}
+
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+}
+
+// build a vector of argv options
+// the program path argv[0] is excluded
+vector<string> ASConsole::getArgvOptions(int argc, char** argv) const
+{
+	vector<string> argvOptions;
+	for (int i = 1; i < argc; i++)
+	{
+		argvOptions.push_back(string(argv[i]));
+	}
+	return argvOptions;
+}
+
+// for unit testing
+vector<bool> ASConsole::getExcludeHitsVector()
+{ return excludeHitsVector; }
+
+// for unit testing
+vector<string> ASConsole::getExcludeVector()
+{ return excludeVector; }
+
+// for unit testing
+vector<string> ASConsole::getFileName()
+{ return fileName; }
+
+// for unit testing
+vector<string> ASConsole::getFileNameVector()
+{ return fileNameVector; }
+
+// for unit testing
+vector<string> ASConsole::getFileOptionsVector()
+{ return fileOptionsVector; }
+
+int ASConsole::getFilesFormatted()
+{ return filesFormatted; }
+
+// for unit testing
+string ASConsole::getCacheFileName()
+{ return cacheFileName; }
+
+string ASConsole::getServerSocketName()
+{ return serverSocketName; }
+
+bool ASConsole::getIgnoreExcludeErrors()
+{ return ignoreExcludeErrors; }
+
+// for unit testing
+bool ASConsole::getIgnoreExcludeErrorsDisplay()
+{ return ignoreExcludeErrorsDisplay; }
+
+bool ASConsole::getIsDryRun()
+{ return isDryRun; }
+
+// for unit testing
+bool ASConsole::getIsFormattedOnly()
+{ return isFormattedOnly; }
+
+// for unit testing
+string ASConsole::getLanguageID() const
+{ return localizer.getLanguageID(); }
+
+// for unit testing
+bool ASConsole::getIsQuiet()
+{ return isQuiet; }
+
+// for unit testing
+bool ASConsole::getIsStaged()
+{ return isStaged; }
+
+bool ASConsole::getIsRecursive()
+{ return isRecursive; }
+
+// for unit testing
+bool ASConsole::getIsVerbose()
+{ return isVerbose; }
+
+// for unit testing
+bool ASConsole::getLineEndsMixed()
+{ return lineEndsMixed; }
+
+// for unit testing
+bool ASConsole::getNoBackup()
+{ return noBackup; }
+
+// for unit testing
+int ASConsole::getNumJobs()
+{ return numJobs; }
+
+// for unit testing
+string ASConsole::getOptionsFileName()
+{ return optionsFileName; }
+
+// for unit testing
+vector<string> ASConsole::getOptionsVector()
+{ return optionsVector; }
+
+// for unit testing
+string ASConsole::getOrigSuffix()
+{ return origSuffix; }
+
+// for unit testing
+bool ASConsole::getPreserveDate()
+{ return preserveDate; }
+
+string ASConsole::getParam(const string &arg, const char* op)
+{
+	return arg.substr(strlen(op));
+}
+
+// initialize output end of line
+void ASConsole::initializeOutputEOL(LineEndFormat lineEndFormat, ASFileResult &result) const
+{
+	assert(lineEndFormat == LINEEND_DEFAULT
+	       || lineEndFormat == LINEEND_WINDOWS
+	       || lineEndFormat == LINEEND_LINUX
+	       || lineEndFormat == LINEEND_MACOLD);
+
+	result.outputEOL[0] = '\0';		// current line end
+	result.prevEOL[0] = '\0';			// previous line end
+	result.lineEndsMixed = false;		// output has mixed line ends, LINEEND_DEFAULT only
+
+	if (lineEndFormat == LINEEND_WINDOWS)
+		strcpy(result.outputEOL, "\r\n");
+	else if (lineEndFormat == LINEEND_LINUX)
+		strcpy(result.outputEOL, "\n");
+	else if (lineEndFormat == LINEEND_MACOLD)
+		strcpy(result.outputEOL, "\r");
+	else
+		result.outputEOL[0] = '\0';
+}
+
+
+/**
+ * Read the input file.
+ * Files of 64 KB or more are memory mapped and the mapped bytes are
+ * used by the formatter without a copy. Smaller files are read with
+ * a single read, which is faster than mapping them. A utf-16 file is
+ * converted to utf-8 and replaces the input.
+ * This may be called from a worker thread, so an error is saved in the
+ * result and is reported by reportFileResult.
+ *
+ * @param in            Receives the file contents.
+ * @param result        The file to be read, receives the encoding or the error.
+ * @return              true if the file was read.
+ */
+bool ASConsole::readFile(ASFileBuffer &in, ASFileResult &result) const
+{
+	TRProfileTimer profileTimer(PROFILE_READ);
+	const string &fileName_ = result.fileName;
+	const size_t mapMinSize = 65536;	// 64 KB
+	struct stat statbuf;
+	if (stat(fileName_.c_str(), &statbuf) != 0)
+	{
+		result.errorMsg = "Cannot open input file";
+		return false;
+	}
+	size_t fileSize = static_cast<size_t>(statbuf.st_size);
+
+	if (fileSize < mapMinSize || !in.mapFile(fileName_, fileSize))
+	{
+		ifstream fin(fileName_.c_str(), ios::binary);
+		if (!fin)
+		{
+			result.errorMsg = "Cannot open input file";
+			return false;
+		}
+		in.copyData.resize(fileSize);
+		if (fileSize > 0)
+			fin.read(&in.copyData[0], fileSize);
+		if (fin.bad())
+		{
+			result.errorMsg = "Cannot read input file";
+			return false;
+		}
+		in.copyData.resize(static_cast<size_t>(fin.gcount()));
+		fin.close();
+	}
+
+	result.encoding = detectEncoding(in.getData(), in.getSize());
+	if (result.encoding ==  UTF_32BE || result.encoding ==  UTF_32LE)
+	{
+		result.errorMsg = _("Cannot process UTF-32 encoding");
+		return false;
+	}
+	if (result.encoding == UTF_16LE || result.encoding == UTF_16BE)
+	{
+		// convert utf-16 to utf-8
+		string utf8Out;
+		Utf16ToUtf8(in.getData(), in.getSize(), result.encoding, utf8Out);
+		in.unmapFile();
+		in.copyData.swap(utf8Out);
+	}
+	return true;
+}
+
+void ASConsole::setCacheFileName(string name)
+{ cacheFileName = name; }
+
+void ASConsole::setServerSocketName(string name)
+{ serverSocketName = name; }
+
+void ASConsole::setSocketName(string name)
+{ socketName = name; }
+
+void ASConsole::setIgnoreExcludeErrors(bool state)
+{ ignoreExcludeErrors = state; }
+
+void ASConsole::setIgnoreExcludeErrorsAndDisplay(bool state)
+{ ignoreExcludeErrors = state; ignoreExcludeErrorsDisplay = state; }
+
+void ASConsole::setIsDryRun(bool state)
+{ isDryRun = state; }
+
+void ASConsole::setIsFormattedOnly(bool state)
+{ isFormattedOnly = state; }
+
+void ASConsole::setIsQuiet(bool state)
+{ isQuiet = state; }
+
+void ASConsole::setIsStaged(bool state)
+{ isStaged = state; }
+
+void ASConsole::setIsRecursive(bool state)
+{ isRecursive = state; }
+
+void ASConsole::setIsVerbose(bool state)
+{ isVerbose = state; }
+
+void ASConsole::setNoBackup(bool state)
+{ noBackup = state; }
+
+void ASConsole::setNumJobs(int jobs)
+{ numJobs = jobs; }
+
+// the line numbers are one based, they are saved as zero based
+void ASConsole::addLineRange(int firstLine, int lastLine)
+{ lineRanges.push_back(make_pair(firstLine - 1, lastLine - 1)); }
+
+void ASConsole::setOptionsFileName(string name)
+{ optionsFileName = name; }
+
+void ASConsole::setOrigSuffix(string suffix)
+{ origSuffix = suffix; }
+
+void ASConsole::setPreserveDate(bool state)
+{ preserveDate = state; }
+
+void ASConsole::setStatsFileName(string name)
+{ statsFileName = name; }
+
+// set outputEOL variable
+void ASConsole::setOutputEOL(LineEndFormat lineEndFormat, const char* currentEOL, ASFileResult &result) const
+{
+	if (lineEndFormat == LINEEND_DEFAULT)
+	{
+		strcpy(result.outputEOL, currentEOL);
+		if (strlen(result.prevEOL) == 0)
+			strcpy(result.prevEOL, result.outputEOL);
+		if (strcmp(result.prevEOL, result.outputEOL) != 0)
+		{
+			result.lineEndsMixed = true;
+			result.filesAreIdentical = false;
+			strcpy(result.prevEOL, result.outputEOL);
+		}
+	}
+	else
+	{
+		strcpy(result.prevEOL, currentEOL);
+		if (strcmp(result.prevEOL, result.outputEOL) != 0)
+			result.filesAreIdentical = false;
+	}
+}
+
+#ifdef _WIN32  // Windows specific
+
+/**
+ * WINDOWS function to memory map an input file for reading.
+ * The file and mapping handles may be closed while the view is mapped.
+ *
+ * @param fileName      The path and name of the file to be mapped.
+ * @param fileSize      The size of the file.
+ * @return              true if the file is mapped, false to read the file instead.
+ */
+bool ASFileBuffer::mapFile(const string &fileName, size_t fileSize)
+{
+	assert(mapData == NULL);
+	HANDLE hFile = CreateFile(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+	                          OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+	HANDLE hMap = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(hFile);
+	if (hMap == NULL)
+		return false;
+	void* view = MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(hMap);
+	if (view == NULL)
+		return false;
+	mapData = static_cast<const char*>(view);
+	mapSize = fileSize;
+	return true;
+}
+
+/**
+ * WINDOWS function to release a memory mapped input file.
+ */
+void ASFileBuffer::unmapFile()
+{
+	if (mapData == NULL)
+		return;
+	UnmapViewOfFile(mapData);
+	mapData = NULL;
+	mapSize = 0;
+}
+
+/**
+ * WINDOWS function to display the last system error.
+ */
+void ASConsole::displayLastError()
+{
+	LPSTR msgBuf;
+	DWORD lastError = GetLastError();
+	FormatMessage(
+	    FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM,
+	    NULL,
+	    lastError,
+	    MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),  // Default language
+	    (LPSTR) &msgBuf,
+	    0,
+	    NULL
+	);
+	// Display the string.
+	(*_err) << "Error (" << lastError << ") " << msgBuf << endl;
+	// Free the buffer.
+	LocalFree(msgBuf);
+}
+
+/**
+ * WINDOWS function to get the current directory.
+ * NOTE: getenv("CD") does not work for Windows Vista.
+ *        	The Windows function GetCurrentDirectory is used instead.
+ *
+ * @return	The path of the current directory
+ */
+string ASConsole::getCurrentDirectory(const string &fileName_) const
+{
+	char currdir[MAX_PATH];
+	currdir[0] = '\0';
+	if (!GetCurrentDirectory(sizeof(currdir), currdir))
+		error("Cannot find file", fileName_.c_str());
+	return string(currdir);
+}
+
+/**
+ * WINDOWS function to resolve wildcards and recurse into sub directories.
+ * The fileName vector is filled with the path and names of files to process.
+ *
+ * @param directory     The path of the directory to be processed.
+ * @param wildcard      The wildcard to be processed (e.g. *.cpp).
+ */
+void ASConsole::getFileNames(const string &directory, const string &wildcard)
+{
+	vector<string> subDirectory;    // sub directories of directory
+	WIN32_FIND_DATA findFileData;   // for FindFirstFile and FindNextFile
+
+	// Find the first file in the directory
+	// Find will get at least "." and "..".
+	string firstFile = directory + "\\*";
+	HANDLE hFind = FindFirstFile(firstFile.c_str(), &findFileData);
+
+	if (hFind == INVALID_HANDLE_VALUE)
+	{
+		// Error (3) The system cannot find the path specified.
+		// Error (123) The filename, directory name, or volume label syntax is incorrect.
+		// ::FindClose(hFind); before exiting
+		displayLastError();
+		error(_("Cannot open directory"), directory.c_str());
+	}
+
+	// save files and sub directories
+	do
+	{
+		// skip hidden or read only
+		if (findFileData.cFileName[0] == '.'
+		        || (findFileData.dwFileAttributes & FILE_ATTRIBUTE_HIDDEN)
+		        || (findFileData.dwFileAttributes & FILE_ATTRIBUTE_READONLY))
+			continue;
+
+		// is this a sub directory
+		if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		{
+			if (!isRecursive)
+				continue;
+			// if a sub directory and recursive, save sub directory
+			string subDirectoryPath = directory + fileSeparator + findFileData.cFileName;
+			if (isPathExclued(subDirectoryPath))
+				printMsg(_("Exclude  %s\n"), subDirectoryPath.substr(mainDirectoryLength));
+			else
+				subDirectory.push_back(subDirectoryPath);
+			continue;
+		}
+
+		// save the file name
+		string filePathName = directory + fileSeparator + findFileData.cFileName;
+		// check exclude before the wildcard to avoid "unmatched exclude" error
+		bool isExcluded = isPathExclued(filePathName);
+		// save file name if wildcard match
+		if (wildcardMatcher.isMatch(findFileData.cFileName))
+		{
+			if (isExcluded)
+				printMsg(_("Exclude  %s\n"), filePathName.substr(mainDirectoryLength));
+			else
+				fileName.push_back(filePathName);
+		}
+	}
+	while (FindNextFile(hFind, &findFileData) != 0);
+
+	// check for processing error
+	::FindClose(hFind);
+	DWORD dwError = GetLastError();
+	if (dwError != ERROR_NO_MORE_FILES)
+		error("Error processing directory", directory.c_str());
+
+	// recurse into sub directories
+	// if not doing recursive subDirectory is empty
+	for (unsigned i = 0; i < subDirectory.size(); i++)
+		getFileNames(subDirectory[i], wildcard);
+
+	return;
+}
+
+/**
+ * WINDOWS function to format a number according to the current locale.
+ * This formats positive integers only, no float.
+ *
+ * @param num		The number to be formatted.
+ * @param lcid		The LCID of the locale to be used for testing.
+ * @return			The formatted number.
+ */
+string ASConsole::getNumberFormat(int num, size_t lcid) const
+{
+#if defined(_MSC_VER) || defined(__MINGW32__) || defined(__GNUC__)
+	// Compilers that don't support C++ locales should still support this assert.
+	// The C locale should be set but not the C++.
+	// This function is not necessary if the C++ locale is set.
+	// The locale().name() return value is not portable to all compilers.
+	assert(locale().name() == "C");
+#endif
+	// convert num to a string
+	stringstream alphaNum;
+	alphaNum << num;
+	string number = alphaNum.str();
+	if (useAscii)
+		return number;
+
+	// format the number using the Windows API
+	if (lcid == 0)
+		lcid = LOCALE_USER_DEFAULT;
+	int outSize = ::GetNumberFormat(lcid, 0, number.c_str(), NULL, NULL, 0);
+	char* outBuf = new(nothrow) char[outSize];
+	if (outBuf == NULL)
+		return number;
+	::GetNumberFormat(lcid, 0, number.c_str(), NULL, outBuf, outSize);
+	string formattedNum(outBuf);
+	delete [] outBuf;
+	// remove the decimal
+	int decSize = ::GetLocaleInfo(lcid, LOCALE_SDECIMAL, NULL, 0);
+	char* decBuf = new(nothrow) char[decSize];
+	if (decBuf == NULL)
+		return number;
+	::GetLocaleInfo(lcid, LOCALE_SDECIMAL, decBuf, decSize);
+	size_t i = formattedNum.rfind(decBuf);
+	delete [] decBuf;
+	if (i != string::npos)
+		formattedNum.erase(i);
+	if (!formattedNum.length())
+		formattedNum = "0";
+	return formattedNum;
+}
+
+/**
+ * WINDOWS function to format with a server.
+ * The server uses a Unix domain socket so the input is formatted by the client.
+ *
+ * @return              false, the server is not used.
+ */
+bool ASConsole::formatWithServer(const string &, string &) const
+{
+	return false;
+}
+
+/**
+ * WINDOWS function to run as a server.
+ * The server uses a Unix domain socket which is not available.
+ */
+void ASConsole::runServer()
+{
+	error(_("The server= option is not available on Windows"), serverSocketName.c_str());
+}
+
+#else  // Linux specific
+
+/**
+ * LINUX function to memory map an input file for reading.
+ * The file descriptor may be closed while the file is mapped.
+ *
+ * @param fileName      The path and name of the file to be mapped.
+ * @param fileSize      The size of the file.
+ * @return              true if the file is mapped, false to read the file instead.
+ */
+bool ASFileBuffer::mapFile(const string &fileName, size_t fileSize)
+{
+	assert(mapData == NULL);
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	void* view = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (view == MAP_FAILED)
+		return false;
+	madvise(view, fileSize, MADV_SEQUENTIAL);
+	mapData = static_cast<const char*>(view);
+	mapSize = fileSize;
+	return true;
+}
+
+/**
+ * LINUX function to release a memory mapped input file.
+ */
+void ASFileBuffer::unmapFile()
+{
+	if (mapData == NULL)
+		return;
+	munmap(const_cast<char*>(mapData), mapSize);
+	mapData = NULL;
+	mapSize = 0;
+}
+
+/**
+ * LINUX function to display the last system error.
+ */
+void ASConsole::displayLastError()
+{
+	(*_err) << "Error (" << errno << ") " << strerror(errno) << endl;
+}
+
+/**
+ * LINUX function to get the current directory.
+ * This is done if the fileName does not contain a path.
+ * getcwd is used instead of the PWD environment variable
+ * because PWD is not updated for a process started by a script.
+ *
+ * @return	The path of the current directory
+ */
+string ASConsole::getCurrentDirectory(const string &fileName_) const
+{
+	char currdir[PATH_MAX];
+	currdir[0] = '\0';
+	if (getcwd(currdir, sizeof(currdir)) == NULL)
+	{
+		perror("errno message");
+		error("Cannot find file", fileName_.c_str());
+	}
+	return string(currdir);
+}
+
+/**
+ * LINUX function to resolve wildcards and recurse into sub directories.
+ * The fileName vector is filled with the path and names of files to process.
+ *
+ * readdir() reads the directory in large getdents() batches and returns
+ * the entry type in d_type, so a stat() is needed only for the files that
+ * match the wildcard and for file systems that do not return a d_type.
+ * The entries are sorted so the file order does not depend on the file system.
+ *
+ * @param directory     The path of the directory to be processed.
+ * @param wildcard      The wildcard to be processed (e.g. *.cpp).
+ */
+void ASConsole::getFileNames(const string &directory, const string &wildcard)
+{
+	vector<string> subDirectory;    // sub directories of directory
+	struct dirent* entry;           // entry from readdir()
+	struct stat statbuf;            // entry from fstatat()
+
+	DIR* dp = opendir(directory.c_str());
+	if (dp == NULL)
+	{
+		displayLastError();
 		error(_("Cannot open directory"), directory.c_str());
 	}
+	int dirFd = dirfd(dp);
+
+	// save the first fileName entry for this recursion
+	const size_t firstEntry = fileName.size();
 
 	// save files and sub directories
-	do
+	// errno is cleared before each readdir to detect a read error
+	for (errno = 0; (entry = readdir(dp)) != NULL; errno = 0)
 	{
-		// skip hidden or read only
-		if (findFileData.cFileName[0] == '.'
-		        || (findFileData.dwFileAttributes & FILE_ATTRIBUTE_HIDDEN)
-		        || (findFileData.dwFileAttributes & FILE_ATTRIBUTE_READONLY))
+		// skip hidden, including "." and ".."
+		if (entry->d_name[0] == '.')
 			continue;
 
+		bool isDirectory = (entry->d_type == DT_DIR);
+		bool isFile = (entry->d_type == DT_REG);
+		bool haveStat = false;
+		// symbolic links and unknown types need a stat for the type
+		if (entry->d_type == DT_LNK || entry->d_type == DT_UNKNOWN)
+		{
+			if (fstatat(dirFd, entry->d_name, &statbuf, 0) != 0)
+			{
+				if (errno == ENOENT || errno == EOVERFLOW)	// broken link or file over 2 GB is OK
+					continue;
+				perror("errno message");
+				error("Error getting file status in directory", directory.c_str());
+			}
+			haveStat = true;
+			isDirectory = S_ISDIR(statbuf.st_mode);
+			isFile = S_ISREG(statbuf.st_mode);
+		}
+
 		// is this a sub directory
-		if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+		if (isDirectory)
+		{
+			if (!isRecursive)
+				continue;
+			// if a sub directory and recursive, save sub directory
+			string subDirectoryPath = directory + fileSeparator + entry->d_name;
+			if (isPathExclued(subDirectoryPath))
+				printMsg(_("Exclude  %s\n"), subDirectoryPath.substr(mainDirectoryLength));
+			else
+				subDirectory.push_back(subDirectoryPath);
+			continue;
+		}
+
+		if (!isFile)
+			continue;
+
+		// save the file name
+		string filePathName = directory + fileSeparator + entry->d_name;
+		// check exclude before the wildcard to avoid "unmatched exclude" error
+		bool isExcluded = isPathExclued(filePathName);
+		// save file name if wildcard match
+		if (wildcardMatcher.isMatch(entry->d_name))
+		{
+			// skip read only
+			if (!haveStat && fstatat(dirFd, entry->d_name, &statbuf, 0) != 0)
+				continue;
+			if (!(statbuf.st_mode & S_IWUSR))
+				continue;
+			if (isExcluded)
+				printMsg(_("Exclude  %s\n"), filePathName.substr(mainDirectoryLength));
+			else
+				fileName.push_back(filePathName);
+		}
+	}
+
+	// check for processing error
+	if (errno != 0 || closedir(dp) != 0)
+	{
+		perror("errno message");
+		error("Error processing directory", directory.c_str());
+	}
+
+	// sort the current entries for fileName
+	if (firstEntry < fileName.size())
+		sort(fileName.begin() + firstEntry, fileName.end());
+
+	// recurse into sub directories
+	// if not doing recursive subDirectory is empty
+	if (subDirectory.size() > 1)
+		sort(subDirectory.begin(), subDirectory.end());
+	for (unsigned i = 0; i < subDirectory.size(); i++)
+		getFileNames(subDirectory[i], wildcard);
+
+	return;
+}
+
+/**
+ * LINUX function to format a number according to the current locale.
+ * This formats positive integers only, no float.
+ *
+ * @param num		The number to be formatted.
+ * @return			The formatted number.
+ */
+string ASConsole::getNumberFormat(int num, size_t) const
+{
+	// Compilers that don't support C++ locales should still support this assert.
+	// The C locale should be set but not the C++.
+	// This function is not necessary if the C++ locale is set.
+	// The locale().name() return value is not portable to all compilers.
+	assert(locale().name() == "C");
+
+	if (useAscii)
+		return getNumberFormat(num, "", "");
+
+	// get the locale info
+	struct lconv* lc;
+	lc = localeconv();
+
+	// format the number
+	return getNumberFormat(num, lc->grouping, lc->thousands_sep);
+}
+
+/**
+ * LINUX function to format a number according to the current locale.
+ * This formats positive integers only, no float.
+ *
+ * @param num			The number to be formatted.
+ * @param groupingArg	The grouping string from the locale.
+ * @param separator		The thousands group separator from the locale.
+ * @return				The formatted number.
+ */
+string ASConsole::getNumberFormat(int num, const char* groupingArg, const char* separator) const
+{
+	// convert num to a string
+	stringstream alphaNum;
+	alphaNum << num;
+	string number = alphaNum.str();
+	// format the number from right to left
+	string formattedNum;
+	size_t ich = number.length();
+	const char* group = groupingArg;
+	int grouping = *group;
+	while (ich > 0)
+	{
+		// check for no grouping
+		if (grouping == 0 || grouping == CHAR_MAX)
+		{
+			formattedNum.insert(0, number.substr(0, ich));
+			break;
+		}
+		// add the number and separator
+		if (ich > (size_t) grouping)
+		{
+			ich -= grouping;
+			formattedNum.insert(0, number.substr(ich, grouping));
+			formattedNum.insert(0, separator);
+		}
+		else
+		{
+			formattedNum.insert(0, number.substr(0, ich));
+			break;
+		}
+		// advance the group
+		if (*(group + 1) != 0)
+			++group;
+		grouping = *group;
+	}
+	return formattedNum;
+}
+
+/**
+ * LINUX function to format the input with the server at the socket= option.
+ * The request has the hash of the formatter options. If the server does not
+ * have a formatter for the hash, the request is sent again with the options.
+ * A request that is too large or a server that does not reply in time is
+ * not used and the client formats the text.
+ *
+ * @param inData        The text to be formatted.
+ * @param outData       Receives the formatted text.
+ * @return              true if the text was formatted by the server.
+ */
+bool ASConsole::formatWithServer(const string &inData, string &outData) const
+{
+	if (inData.length() > SERVER_MAX_DATA || formatterOptions.length() > SERVER_MAX_OPTIONS)
+		return false;
+	// the second request has the options text
+	for (int request = 0; request < 2; request++)
+	{
+		int fd;
+		if (!openSocket(socketName, fd, false))
+			return false;
+		if (!setSocketTimeout(fd, CLIENT_TIMEOUT))
+		{
+			close(fd);
+			return false;
+		}
+
+		ASServerHeader header;
+		memset(&header, 0, sizeof(header));
+		header.optionsHash = optionsHash;
+		header.optionsLength = (request == 0) ? 0 : formatterOptions.length();
+		header.dataLength = inData.length();
+		bool ok = writeSocket(fd, (const char*) &header, sizeof(header))
+		          && writeSocket(fd, formatterOptions.c_str(), header.optionsLength)
+		          && writeSocket(fd, inData.c_str(), inData.length())
+		          && readSocket(fd, (char*) &header, sizeof(header));
+		if (ok && header.status != SERVER_NEED_OPTIONS)
+		{
+			ok = (header.dataLength <= SERVER_MAX_DATA);
+			if (ok)
+			{
+				outData.resize(header.dataLength);
+				ok = readSocket(fd, &outData[0], header.dataLength);
+			}
+		}
+		close(fd);
+
+		if (!ok || header.status == SERVER_ERROR)
+			return false;
+		if (header.status == SERVER_OK)
+			return true;
+	}
+	return false;
+}
+
+/**
+ * LINUX function to open a Unix domain socket.
+ * A server socket replaces an existing socket file, so check first
+ * that a server is not running.
+ *
+ * @param name          The path and name of the socket.
+ * @param fd            Receives the socket descriptor.
+ * @param isServer      Bind and listen if true, otherwise connect.
+ * @return              true if the socket is open.
+ */
+bool ASConsole::openSocket(const string &name, int &fd, bool isServer) const
+{
+	sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	if (name.length() >= sizeof(address.sun_path))
+		return false;
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, name.c_str());
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return false;
+	bool isOpen;
+	if (isServer)
+	{
+		unlink(name.c_str());
+		isOpen = (bind(fd, (sockaddr*) &address, sizeof(address)) == 0
+		          && listen(fd, SOMAXCONN) == 0);
+	}
+	else
+		isOpen = (connect(fd, (sockaddr*) &address, sizeof(address)) == 0);
+	if (!isOpen)
+		close(fd);
+	return isOpen;
+}
+
+/**
+ * LINUX function to read from a socket until the data is complete.
+ *
+ * @return              false if the socket was closed, has an error, or timed out.
+ */
+bool ASConsole::readSocket(int fd, char* data, size_t dataSize) const
+{
+	while (dataSize > 0)
+	{
+		ssize_t bytesIn = read(fd, data, dataSize);
+		if (bytesIn < 0 && errno == EINTR)
+			continue;
+		if (bytesIn <= 0)
+			return false;
+		data += bytesIn;
+		dataSize -= bytesIn;
+	}
+	return true;
+}
+
+/**
+ * LINUX function to run as a server at the server= option socket.
+ * The formatters are kept by the options hash so a request does not
+ * need to parse the options or build the formatter. The requests are
+ * done one at a time, so a client that does not send or read its request
+ * is closed after a timeout. It runs until the process is stopped.
+ */
+void ASConsole::runServer()
+{
+	int listenFd;
+	// a server that is running is not replaced
+	if (openSocket(serverSocketName, listenFd, false))
+	{
+		close(listenFd);
+		error(_("A server is already running at"), serverSocketName.c_str());
+	}
+	if (!openSocket(serverSocketName, listenFd, true))
+	{
+		displayLastError();
+		error(_("Cannot open the server socket"), serverSocketName.c_str());
+	}
+	// a client that closes the socket must not stop the server
+	signal(SIGPIPE, SIG_IGN);
+
+	unordered_map<uint64_t, TRFormatter*> serverFormatters;
+	unordered_map<uint64_t, size_t> unchangedSizes;
+	while (true)
+	{
+		int fd = accept(listenFd, NULL, NULL);
+		if (fd < 0)
+		{
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			displayLastError();
+			error(_("Cannot open the server socket"), serverSocketName.c_str());
+		}
+		if (setSocketTimeout(fd, SERVER_TIMEOUT))
+			serveRequest(fd, serverFormatters, unchangedSizes);
+		close(fd);
+	}
+}
+
+/**
+ * LINUX function to format a request from a client.
+ * A formatter is created for the options of a new options hash.
+ * A text that was unchanged by a previous request is returned without
+ * formatting, as with the cache= option. The size is a collision check.
+ * The number of entries is limited in case of a changing options file.
+ *
+ * @param fd                The socket of the client.
+ * @param serverFormatters  The formatters by options hash.
+ * @param unchangedSizes    The sizes of the unchanged texts by hash.
+ */
+void ASConsole::serveRequest(int fd, unordered_map<uint64_t, TRFormatter*> &serverFormatters,
+                             unordered_map<uint64_t, size_t> &unchangedSizes) const
+{
+	const size_t maxFormatters = 16;
+	const size_t maxUnchanged = 65536;
+	ASServerHeader header;
+	if (!readSocket(fd, (char*) &header, sizeof(header)))
+		return;
+	// the lengths are checked before the buffers are allocated
+	if (header.optionsLength > SERVER_MAX_OPTIONS || header.dataLength > SERVER_MAX_DATA)
+	{
+		string message = _("The server request is too large");
+		header.status = SERVER_ERROR;
+		header.optionsLength = 0;
+		header.dataLength = message.length();
+		if (writeSocket(fd, (const char*) &header, sizeof(header)))
+			writeSocket(fd, message.c_str(), message.length());
+		return;
+	}
+	string optionsIn(header.optionsLength, '\0');
+	string dataIn(header.dataLength, '\0');
+	if (!readSocket(fd, &optionsIn[0], optionsIn.length())
+	        || !readSocket(fd, &dataIn[0], dataIn.length()))
+		return;
+
+	string dataOut;
+	header.status = SERVER_OK;
+	unordered_map<uint64_t, TRFormatter*>::iterator entry = serverFormatters.find(header.optionsHash);
+	if (entry == serverFormatters.end() && header.optionsLength == 0)
+		header.status = SERVER_NEED_OPTIONS;
+	else if (entry == serverFormatters.end())
+	{
+		TRFormatter* newFormatter = new(nothrow) TRFormatter;
+		if (newFormatter == NULL)
+			return;
+		ASOptions options(*newFormatter);
+		vector<string> serverOptionsVector;
+		istringstream in(optionsIn);
+		options.importOptions(in, serverOptionsVector);
+		if (!options.parseOptions(serverOptionsVector, _("Invalid server options:")))
 		{
-			if (!isRecursive)
-				continue;
-			// if a sub directory and recursive, save sub directory
-			string subDirectoryPath = directory + g_fileSeparator + findFileData.cFileName;
-			if (isPathExclued(subDirectoryPath))
-				printMsg(_("Exclude  %s\n"), subDirectoryPath.substr(mainDirectoryLength));
-			else
-				subDirectory.push_back(subDirectoryPath);
-			continue;
+			header.status = SERVER_ERROR;
+			dataOut = options.getOptionErrors();
+			delete newFormatter;
 		}
-
-		// save the file name
-		string filePathName = directory + g_fileSeparator + findFileData.cFileName;
-		// check exclude before wildcmp to avoid "unmatched exclude" error
-		bool isExcluded = isPathExclued(filePathName);
-		// save file name if wildcard match
-		if (wildcmp(wildcard.c_str(), findFileData.cFileName))
+		else
 		{
-			if (isExcluded)
-				printMsg(_("Exclude  %s\n"), filePathName.substr(mainDirectoryLength));
-			else
-				fileName.push_back(filePathName);
+			if (serverFormatters.size() >= maxFormatters)
+			{
+				for (entry = serverFormatters.begin(); entry != serverFormatters.end(); ++entry)
+					delete entry->second;
+				serverFormatters.clear();
+			}
+			entry = serverFormatters.insert(make_pair(header.optionsHash, newFormatter)).first;
+		}
+	}
+	if (header.status == SERVER_OK)
+	{
+		// the hash includes the options hash so each formatter has its own texts
+		uint64_t textHash = ASFileCache::hashData(dataIn.c_str(), dataIn.length(), header.optionsHash);
+		unordered_map<uint64_t, size_t>::iterator unchanged = unchangedSizes.find(textHash);
+		if (unchanged != unchangedSizes.end() && unchanged->second == dataIn.length())
+			dataOut.swap(dataIn);
+		else
+		{
+			formatBuffer(*entry->second, dataIn.c_str(), dataIn.length(), dataOut);
+			if (dataOut == dataIn)
+			{
+				if (unchangedSizes.size() >= maxUnchanged)
+					unchangedSizes.clear();
+				unchangedSizes[textHash] = dataIn.length();
+			}
 		}
 	}
-	while (FindNextFile(hFind, &findFileData) != 0);
-
-	// check for processing error
-	::FindClose(hFind);
-	DWORD dwError = GetLastError();
-	if (dwError != ERROR_NO_MORE_FILES)
-		error("Error processing directory", directory.c_str());
-
-	// recurse into sub directories
-	// if not doing recursive subDirectory is empty
-	for (unsigned i = 0; i < subDirectory.size(); i++)
-		getFileNames(subDirectory[i], wildcard);
 
-	return;
+	header.optionsLength = 0;
+	header.dataLength = dataOut.length();
+	if (writeSocket(fd, (const char*) &header, sizeof(header)))
+		writeSocket(fd, dataOut.c_str(), dataOut.length());
 }
 
 /**
- * WINDOWS function to format a number according to the current locale.
- * This formats positive integers only, no float.
+ * LINUX function to set the read and write timeout of a socket.
+ * A read or write that is not complete in time fails with EAGAIN.
  *
- * @param num		The number to be formatted.
- * @param lcid		The LCID of the locale to be used for testing.
- * @return			The formatted number.
+ * @param fd            The socket descriptor.
+ * @param seconds       The timeout for each read or write.
+ * @return              true if the timeout is set.
  */
-string ASConsole::getNumberFormat(int num, size_t lcid) const
+bool ASConsole::setSocketTimeout(int fd, int seconds) const
 {
-#if defined(_MSC_VER) || defined(__MINGW32__) || defined(__GNUC__)
-	// Compilers that don't support C++ locales should still support this assert.
-	// The C locale should be set but not the C++.
-	// This function is not necessary if the C++ locale is set.
-	// The locale().name() return value is not portable to all compilers.
-	assert(locale().name() == "C");
-#endif
-	// convert num to a string
-	stringstream alphaNum;
-	alphaNum << num;
-	string number = alphaNum.str();
-	if (useAscii)
-		return number;
+	timeval timeout;
+	timeout.tv_sec = seconds;
+	timeout.tv_usec = 0;
+	return (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == 0
+	        && setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) == 0);
+}
 
-	// format the number using the Windows API
-	if (lcid == 0)
-		lcid = LOCALE_USER_DEFAULT;
-	int outSize = ::GetNumberFormat(lcid, 0, number.c_str(), NULL, NULL, 0);
-	char* outBuf = new(nothrow) char[outSize];
-	if (outBuf == NULL)
-		return number;
-	::GetNumberFormat(lcid, 0, number.c_str(), NULL, outBuf, outSize);
-	string formattedNum(outBuf);
-	delete [] outBuf;
-	// remove the decimal
-	int decSize = ::GetLocaleInfo(lcid, LOCALE_SDECIMAL, NULL, 0);
-	char* decBuf = new(nothrow) char[decSize];
-	if (decBuf == NULL)
-		return number;
-	::GetLocaleInfo(lcid, LOCALE_SDECIMAL, decBuf, decSize);
-	size_t i = formattedNum.rfind(decBuf);
-	delete [] decBuf;
-	if (i != string::npos)
-		formattedNum.erase(i);
-	if (!formattedNum.length())
-		formattedNum = "0";
-	return formattedNum;
+/**
+ * LINUX function to write to a socket until the data is complete.
+ * A closed socket returns an error instead of raising SIGPIPE, so a
+ * client is not stopped when the server closes the socket.
+ *
+ * @return              false if the socket was closed, has an error, or timed out.
+ */
+bool ASConsole::writeSocket(int fd, const char* data, size_t dataSize) const
+{
+	while (dataSize > 0)
+	{
+		ssize_t bytesOut = send(fd, data, dataSize, MSG_NOSIGNAL);
+		if (bytesOut < 0 && errno == EINTR)
+			continue;
+		if (bytesOut <= 0)
+			return false;
+		data += bytesOut;
+		dataSize -= bytesOut;
+	}
+	return true;
 }
 
+#endif  // _WIN32
+
 // get individual file names from the command-line file path
 void ASConsole::getFilePaths(string &filePath)
 {
+	TRProfileTimer profileTimer(PROFILE_DISCOVER);
 	fileName.clear();
 	targetDirectory = string();
 	targetFilename = string();
 
 	// separate directory and file name
-	size_t separator = filePath.find_last_of(g_fileSeparator);
+	size_t separator = filePath.find_last_of(fileSeparator);
 	if (separator == string::npos)
 	{
 		// if no directory is present, use the currently active directory
@@ -912,6 +2776,7 @@ void ASConsole::getFilePaths(string &filePath)
 	hasWildcard = false;
 	if (targetFilename.find_first_of( "*?") != string::npos)
 		hasWildcard = true;
+	wildcardMatcher.compile(targetFilename, isCaseSensitive);
 
 	// clear exclude hits vector
 	for (size_t ix = 0; ix < excludeHitsVector.size(); ix++)
@@ -929,7 +2794,7 @@ void ASConsole::getFilePaths(string &filePath)
 	if (hasWildcard)
 	{
 		printSeparatingLine();
-		printMsg(_("Directory  %s\n"), targetDirectory + g_fileSeparator + targetFilename);
+		printMsg(_("Directory  %s\n"), targetDirectory + fileSeparator + targetFilename);
 	}
 
 	// create a vector of paths and file names to process
@@ -938,7 +2803,7 @@ void ASConsole::getFilePaths(string &filePath)
 	else
 	{
 		// verify a single file is not a directory (needed on Linux)
-		string entryFilepath = targetDirectory + g_fileSeparator + targetFilename;
+		string entryFilepath = targetDirectory + fileSeparator + targetFilename;
 		struct stat statbuf;
 		if (stat(entryFilepath.c_str(), &statbuf) == 0 && (statbuf.st_mode & S_IFREG))
 			fileName.push_back(entryFilepath);
@@ -986,6 +2851,49 @@ void ASConsole::getFilePaths(string &filePath)
 		printSeparatingLine();
 }
 
+/**
+ * Get the file names for the staged option.
+ * The names are from the command line or, if there are none, NUL separated
+ * from cin as written by "git diff --cached --name-only -z". The names are
+ * used as given so the changed files can be added to git again. Excluded
+ * files and names that are not regular files are skipped.
+ */
+void ASConsole::getStagedFilePaths()
+{
+	TRProfileTimer profileTimer(PROFILE_DISCOVER);
+	fileName.clear();
+	hasWildcard = false;
+	isStagedFromCin = fileNameVector.empty();
+	if (isStagedFromCin)
+	{
+		string stagedName;
+		while (getline(cin, stagedName, '\0'))
+		{
+			if (stagedName.length() == 0)
+				continue;
+			standardizePath(stagedName);
+			fileNameVector.push_back(stagedName);
+		}
+	}
+
+	for (size_t i = 0; i < fileNameVector.size(); i++)
+	{
+		// check the directories and the file name for an exclude
+		bool isExcluded = false;
+		size_t separator = 0;
+		while (!isExcluded && separator != string::npos)
+		{
+			separator = fileNameVector[i].find(fileSeparator, separator + 1);
+			isExcluded = isPathExclued(fileNameVector[i].substr(0, separator));
+		}
+		if (isExcluded)
+			continue;
+		struct stat statbuf;
+		if (stat(fileNameVector[i].c_str(), &statbuf) == 0 && (statbuf.st_mode & S_IFREG))
+			fileName.push_back(fileNameVector[i]);
+	}
+}
+
 bool ASConsole::fileNameVectorIsEmpty()
 {
 	return fileNameVector.empty();
@@ -1017,43 +2925,11 @@ bool ASConsole::isParamOption(const string &arg, const char* option)
 // return true if a match
 bool ASConsole::isPathExclued(const string &subPath)
 {
-	bool retVal = false;
-
-	// read the exclude vector checking for a match
-	for (size_t i = 0; i < excludeVector.size(); i++)
-	{
-		string exclude = excludeVector[i];
-
-		if (subPath.length() < exclude.length())
-			continue;
-
-		size_t compareStart = subPath.length() - exclude.length();
-		// subPath compare must start with a directory name
-		if (compareStart > 0)
-		{
-			char lastPathChar = subPath[compareStart - 1];
-			if (lastPathChar != g_fileSeparator)
-				continue;
-		}
-
-		string compare = subPath.substr(compareStart);
-		if (!g_isCaseSensitive)
-		{
-			// make it case insensitive for Windows
-			for (size_t j = 0; j < compare.length(); j++)
-				compare[j] = (char)tolower(compare[j]);
-			for (size_t j = 0; j < exclude.length(); j++)
-				exclude[j] = (char)tolower(exclude[j]);
-		}
-		// compare sub directory to exclude data - must check them all
-		if (compare == exclude)
-		{
-			excludeHitsVector[i] = true;
-			retVal = true;
-			break;
-		}
-	}
-	return retVal;
+	int excludeIndex = excludeMatcher.findExclude(subPath);
+	if (excludeIndex < 0)
+		return false;
+	excludeHitsVector[excludeIndex] = true;
+	return true;
 }
 
 void ASConsole::printHelp() const
@@ -1386,6 +3262,31 @@ void ASConsole::printHelp() const
 	(*_err) << "    --recursive  OR  -r  OR  -R\n";
 	(*_err) << "    Process subdirectories recursively.\n";
 	(*_err) << endl;
+	(*_err) << "    --jobs  OR  --jobs=#\n";
+	(*_err) << "    Format the files using # worker threads. If # is not given\n";
+	(*_err) << "    the number of processors is used. The valid values are 1 thru 256.\n";
+	(*_err) << "    The display and totals are the same as a single thread.\n";
+	(*_err) << endl;
+	(*_err) << "    --lines=#:#\n";
+	(*_err) << "    Format only the lines in the range first:last from standard\n";
+	(*_err) << "    input. The other lines are output unchanged. The option may\n";
+	(*_err) << "    be used more than once. This is for editor integration.\n";
+	(*_err) << endl;
+	(*_err) << "    --server=####\n";
+	(*_err) << "    Run as a server that formats the requests from the socket ####.\n";
+	(*_err) << "    The formatters for each set of options are kept between the\n";
+	(*_err) << "    requests. It runs until it is stopped.\n";
+	(*_err) << endl;
+	(*_err) << "    --socket=####\n";
+	(*_err) << "    Format standard input with the server at the socket ####.\n";
+	(*_err) << "    If the server is not running the input is formatted here.\n";
+	(*_err) << endl;
+	(*_err) << "    --cache  OR  --cache=####\n";
+	(*_err) << "    Skip the files that were unchanged by a previous run with the\n";
+	(*_err) << "    same contents and formatting options. The results are kept in\n";
+	(*_err) << "    the cache file ####. The default is .taarrule.cache in the\n";
+	(*_err) << "    current directory.\n";
+	(*_err) << endl;
 	(*_err) << "    --exclude=####\n";
 	(*_err) << "    Specify a file or directory #### to be excluded from processing.\n";
 	(*_err) << endl;
@@ -1407,6 +3308,13 @@ void ASConsole::printHelp() const
 	(*_err) << endl;
 	(*_err) << "    --verbose  OR  -v\n";
 	(*_err) << "    Verbose mode. Extra informational messages will be displayed.\n";
+	(*_err) << "    The time and calls of each processing phase are displayed\n";
+	(*_err) << "    after the statistics.\n";
+	(*_err) << endl;
+	(*_err) << "    --stats=####\n";
+	(*_err) << "    Write the statistics and the time and calls of each processing\n";
+	(*_err) << "    phase to the file #### in JSON format. The phase times are the\n";
+	(*_err) << "    sum of the threads used by the jobs option.\n";
 	(*_err) << endl;
 	(*_err) << "    --formatted  OR  -Q\n";
 	(*_err) << "    Formatted display mode. Display only the files that have been\n";
@@ -1415,6 +3323,18 @@ void ASConsole::printHelp() const
 	(*_err) << "    --quiet  OR  -q\n";
 	(*_err) << "    Quiet mode. Suppress all output except error messages.\n";
 	(*_err) << endl;
+	(*_err) << "    --dry-run  OR  --check\n";
+	(*_err) << "    Report the files that would be formatted without changing them.\n";
+	(*_err) << "    A file stops formatting at the first change. The exit status\n";
+	(*_err) << "    is 1 if any file would be changed.\n";
+	(*_err) << endl;
+	(*_err) << "    --staged\n";
+	(*_err) << "    Format the files staged for a git commit in one run and display\n";
+	(*_err) << "    only the names of the files that were changed. The file names\n";
+	(*_err) << "    are from the command line or, if none are given, NUL separated\n";
+	(*_err) << "    from standard input. The changed names are then NUL separated.\n";
+	(*_err) << "    This is for a git pre-commit hook.\n";
+	(*_err) << endl;
 	(*_err) << "    --lineend=windows  OR  -z1\n";
 	(*_err) << "    --lineend=linux    OR  -z2\n";
 	(*_err) << "    --lineend=macold   OR  -z3\n";
@@ -1450,21 +3370,43 @@ void ASConsole::processFiles()
 	if (isVerbose)
 		printVerboseHeader();
 
+	// the phases are profiled for the verbose and stats output
+	if (isVerbose || !statsFileName.empty())
+		TRProfile::enable();
+
 	clock_t startTime = clock();     // start time of file formatting
+	chrono::steady_clock::time_point wallStart = chrono::steady_clock::now();
 
-	// loop thru input fileNameVector and process the files
-	for (size_t i = 0; i < fileNameVector.size(); i++)
-	{
-		getFilePaths(fileNameVector[i]);
+	if (!cacheFileName.empty())
+		fileCache.load(cacheFileName, optionsHash);
 
-		// loop thru fileName vector formatting the files
-		for (size_t j = 0; j < fileName.size(); j++)
-			formatFile(fileName[j]);
+	if (isStaged)
+	{
+		// the staged files are formatted together
+		getStagedFilePaths();
+		formatFiles();
+	}
+	else
+	{
+		// loop thru input fileNameVector and process the files
+		for (size_t i = 0; i < fileNameVector.size(); i++)
+		{
+			getFilePaths(fileNameVector[i]);
+			formatFiles();
+		}
 	}
 
+	if (!cacheFileName.empty() && !fileCache.save())
+		(*_err) << "*********  Cannot write cache file " << cacheFileName << endl;
+
 	// files are processed, display stats
 	if (isVerbose)
+	{
 		printVerboseStats(startTime);
+		printVerboseProfile();
+	}
+	if (!statsFileName.empty())
+		writeStatsFile(startTime, chrono::duration<double>(chrono::steady_clock::now() - wallStart).count());
 }
 
 // process options from the command line and options file
@@ -1547,7 +3489,7 @@ void ASConsole::processOptions(vector<string> &argvOptions)
 	}
 
 	// create the options file vector and parse the options for errors
-	ASOptions options(formatter);
+	ASOptions options(formatter, this);
 	if (optionsFileName.compare("") != 0)
 	{
 		ifstream optionsIn(optionsFileName.c_str());
@@ -1581,25 +3523,48 @@ void ASConsole::processOptions(vector<string> &argvOptions)
 		(*_err) << _("For help on options type 'TaaRRule -h'") << endl;
 		error();
 	}
+
+	// the cache key includes the build so a new formatter invalidates the cache
+	const char buildStamp[] = __DATE__ " " __TIME__ "\n";
+	optionsHash = ASFileCache::hashData(buildStamp, strlen(buildStamp));
+	formatterOptions = options.getFormatterOptions();
+	optionsHash = ASFileCache::hashData(formatterOptions.c_str(), formatterOptions.length(), optionsHash);
+
+	// the line ranges are for an editor buffer from cin
+	if (!lineRanges.empty() && !fileNameVector.empty())
+		error(_("The lines= option cannot be used with the file"), fileNameVector[0].c_str());
+	// the server formats only the requests from the socket
+	if (!serverSocketName.empty() && !fileNameVector.empty())
+		error(_("The server= option cannot be used with the file"), fileNameVector[0].c_str());
+	// the staged option output is only the changed file names
+	if (isStaged)
+	{
+		if (isVerbose)
+			error(_("The staged option cannot be used with the option"), "verbose");
+		if (!lineRanges.empty() || !serverSocketName.empty())
+			error(_("The staged option cannot be used with the option"),
+			      lineRanges.empty() ? "server=" : "lines=");
+		isQuiet = true;
+	}
 }
 
 // remove a file and check for an error
-void ASConsole::removeFile(const char* fileName_, const char* errMsg) const
+// return false with errno set if the file exists and cannot be removed
+bool ASConsole::removeFile(const char* fileName_) const
 {
 	if (remove(fileName_))
 	{
 		if (errno == ENOENT)        // no file is OK
 			errno = 0;
 		if (errno)
-		{
-			perror("errno message");
-			error(errMsg, fileName_);
-		}
+			return false;
 	}
+	return true;
 }
 
 // rename a file and check for an error
-void ASConsole::renameFile(const char* oldFileName, const char* newFileName, const char* errMsg) const
+// return false with errno set if the file cannot be renamed
+bool ASConsole::renameFile(const char* oldFileName, const char* newFileName) const
 {
 	int result = rename(oldFileName, newFileName);
 	if (result != 0)
@@ -1611,11 +3576,49 @@ void ASConsole::renameFile(const char* oldFileName, const char* newFileName, con
 			waitForRemove(newFileName);
 			result = rename(oldFileName, newFileName);
 		}
-		if (result != 0)
-		{
-			perror("errno message");
-			error(errMsg, oldFileName);
-		}
+	}
+	return (result == 0);
+}
+
+// display the result of a formatted file and update the totals
+// this must be called in the same order the files were found
+void ASConsole::reportFileResult(const ASFileResult &result)
+{
+	// the errors of the worker threads are reported here, in file order
+	if (result.errorNumber != 0)
+		(*_err) << "errno message: " << strerror(result.errorNumber) << endl;
+	if (result.errorMsg != NULL)
+		error(result.errorMsg, result.errorFileName.empty() ? result.fileName.c_str()
+		      : result.errorFileName.c_str());
+	if (result.isDateError)
+		(*_err) << "*********  Cannot preserve file date" << endl;
+
+	// remove targetDirectory from filename if required by print
+	string displayName;
+	if (hasWildcard)
+		displayName = result.fileName.substr(targetDirectory.length() + 1);
+	else
+		displayName = result.fileName;
+
+	linesOut += result.linesOut;
+	lineEndsMixed = result.lineEndsMixed;
+	if (result.isFormatted)
+	{
+		// the staged option displays only the names of the changed files
+		if (isStaged)
+			printf("%s%c", displayName.c_str(), isStagedFromCin ? '\0' : '\n');
+		printMsg(_("Formatted  %s\n"), displayName);
+		filesFormatted++;
+	}
+	else
+	{
+		if (!isFormattedOnly)
+			printMsg(_("Unchanged  %s\n"), displayName);
+		filesUnchanged++;
+		if (result.isCached)
+			filesCached++;
+		else if (!cacheFileName.empty())
+			fileCache.addRecord(result.contentHash, result.fileSize, result.linesOut);
 	}
 }
 
@@ -1630,9 +3633,9 @@ void ASConsole::standardizePath(string &path, bool removeBeginningSeparator /*fa
 		i = path.find_first_of("/\\", i);
 		if (i == string::npos)
 			break;
-		path[i] = g_fileSeparator;
+		path[i] = fileSeparator;
 	}
-	if (removeBeginningSeparator && (path[0] == g_fileSeparator))
+	if (removeBeginningSeparator && (path[0] == fileSeparator))
 	{
 		path.erase(0, 1);
 	}
@@ -1681,6 +3684,11 @@ void ASConsole::printVerboseStats(clock_t startTime) const
 	string formatted = getNumberFormat(filesFormatted);
 	string unchanged = getNumberFormat(filesUnchanged);
 	printf(_(" %s formatted   %s unchanged   "), formatted.c_str(), unchanged.c_str());
+	if (!cacheFileName.empty())
+	{
+		string cached = getNumberFormat(filesCached);
+		printf(_("%s cached   "), cached.c_str());
+	}
 
 	// show processing time
 	clock_t stopTime = clock();
@@ -1708,6 +3716,74 @@ void ASConsole::printVerboseStats(clock_t startTime) const
 	printf(_("%s lines\n"), lines.c_str());
 }
 
+// display the time and calls of each phase
+// the format phase includes the beautify and enhance phases
+void ASConsole::printVerboseProfile() const
+{
+	assert(isVerbose);
+	if (isQuiet)
+		return;
+	for (int i = 0; i < PROFILE_PHASES; i++)
+	{
+		ProfilePhase phase = static_cast<ProfilePhase>(i);
+		string calls = getNumberFormat(static_cast<int>(TRProfile::getPhaseCalls(phase)));
+		printf(" %-9s %12s calls %10.3f seconds\n", TRProfile::getPhaseName(phase), calls.c_str(),
+		       TRProfile::getPhaseSeconds(phase));
+	}
+	string clones = getNumberFormat(static_cast<int>(TRProfile::getClones()));
+	string allocations = getNumberFormat(static_cast<int>(TRProfile::getAllocations()));
+	printf(" %s beautifier clones   %s allocations\n", clones.c_str(), allocations.c_str());
+}
+
+/**
+ * Write the statistics and the phase profile as a JSON object.
+ * The format self time is the format time minus the beautify and enhance times.
+ *
+ * @param startTime     The processor time when the processing started.
+ * @param wallSeconds   The elapsed time of the processing.
+ */
+void ASConsole::writeStatsFile(clock_t startTime, double wallSeconds) const
+{
+	ofstream fout(statsFileName.c_str(), ios::trunc);
+	if (!fout)
+	{
+		(*_err) << "*********  Cannot write stats file " << statsFileName << endl;
+		return;
+	}
+	double cpuSeconds = (clock() - startTime) / double (CLOCKS_PER_SEC);
+	double formatSelf = TRProfile::getPhaseSeconds(PROFILE_FORMAT)
+	                    - TRProfile::getPhaseSeconds(PROFILE_BEAUTIFY)
+	                    - TRProfile::getPhaseSeconds(PROFILE_ENHANCE);
+	char buf[256];
+	fout << "{\n";
+	snprintf(buf, sizeof(buf),
+	         "  \"files_formatted\": %d,\n  \"files_unchanged\": %d,\n  \"files_cached\": %d,\n"
+	         "  \"lines\": %d,\n  \"jobs\": %d,\n"
+	         "  \"wall_seconds\": %.6f,\n  \"cpu_seconds\": %.6f,\n",
+	         filesFormatted, filesUnchanged, filesCached, linesOut, numJobs, wallSeconds, cpuSeconds);
+	fout << buf;
+	fout << "  \"phases\": {\n";
+	for (int i = 0; i < PROFILE_PHASES; i++)
+	{
+		ProfilePhase phase = static_cast<ProfilePhase>(i);
+		snprintf(buf, sizeof(buf), "    \"%s\": {\"calls\": %llu, \"seconds\": %.6f",
+		         TRProfile::getPhaseName(phase), TRProfile::getPhaseCalls(phase),
+		         TRProfile::getPhaseSeconds(phase));
+		fout << buf;
+		if (phase == PROFILE_FORMAT)
+		{
+			snprintf(buf, sizeof(buf), ", \"self_seconds\": %.6f", formatSelf);
+			fout << buf;
+		}
+		fout << (i + 1 < PROFILE_PHASES ? "},\n" : "}\n");
+	}
+	fout << "  },\n";
+	snprintf(buf, sizeof(buf), "  \"beautifier_clones\": %llu,\n  \"allocations\": %llu\n",
+	         TRProfile::getClones(), TRProfile::getAllocations());
+	fout << buf;
+	fout << "}\n";
+}
+
 void ASConsole::sleep(int seconds) const
 {
 	clock_t endwait;
@@ -1734,63 +3810,12 @@ bool ASConsole::stringEndsWith(const string &str, const string &suffix) const
 	return true;
 }
 
-// Swap the two low order bytes of an integer value
-// and convert 8 bit encoding to 16 bit.
-int ASConsole::swap8to16bit(int value) const
-{
-	return ( ((value & 0xFF) << 8) + (value >> 8) );
-}
-
-// Swap the two low order bytes of a 16 bit integer value.
-int ASConsole::swap16bit(int value) const
-{
-	return ( ((value & 0xff) << 8) | ((value & 0xff00) >> 8) );
-}
-
 void ASConsole::updateExcludeVector(string suffixParam)
 {
 	excludeVector.push_back(suffixParam);
 	standardizePath(excludeVector.back(), true);
 	excludeHitsVector.push_back(false);
-}
-
-// Adapted from SciTE UniConversion.cxx.
-// Copyright 1998-2001 by Neil Hodgson <neilh@scintilla.org>
-// Modified for Artistic Style by Jim Pattee.
-//
-// Compute the length of an output utf-8 file given a utf-16 file.
-// Input tlen is the size in BYTES (not wchar_t).
-size_t ASConsole::Utf8LengthFromUtf16(const char* data, size_t tlen, FileEncoding encoding) const
-{
-	enum { SURROGATE_LEAD_FIRST = 0xD800 };
-	enum { SURROGATE_TRAIL_LAST = 0xDFFF };
-
-	size_t len = 0;
-	size_t wcharLen = tlen / 2;
-	const short* uptr = reinterpret_cast<const short*>(data);
-	for (size_t i = 0; i < wcharLen && uptr[i];)
-	{
-		size_t uch = encoding == UTF_16BE ? swap16bit(uptr[i]) : uptr[i];
-		if (uch < 0x80)
-		{
-			len++;
-		}
-		else if (uch < 0x800)
-		{
-			len += 2;
-		}
-		else if ((uch >= SURROGATE_LEAD_FIRST) && (uch <= SURROGATE_TRAIL_LAST))
-		{
-			len += 4;
-			i++;
-		}
-		else
-		{
-			len += 3;
-		}
-		i++;
-	}
-	return len;
+	excludeMatcher.addExclude(excludeVector.back(), excludeVector.size() - 1);
 }
 
 // Adapted from SciTE Utf8_16.cxx.
@@ -1798,121 +3823,87 @@ size_t ASConsole::Utf8LengthFromUtf16(const char* data, size_t tlen, FileEncodin
 // Modified for Artistic Style by Jim Pattee.
 //
 // Convert a utf-8 file to utf-16.
-size_t ASConsole::Utf8ToUtf16(char* utf8In, size_t inLen, FileEncoding encoding, char* utf16Out) const
+// The output is sized and converted in one pass. The ascii characters are
+// converted 16 at a time with SSE2 if it is available. The other characters
+// are converted as before: the sequences are not validated and an incomplete
+// sequence at the end of the input is not converted.
+void ASConsole::Utf8ToUtf16(const char* utf8In, size_t inLen, FileEncoding encoding, string &utf16Out) const
 {
-	typedef unsigned short utf16;	// 16 bits
 	typedef unsigned char  ubyte;	// 8 bits
 	enum { SURROGATE_LEAD_FIRST = 0xD800 };
-	enum { SURROGATE_LEAD_LAST = 0xDBFF };
 	enum { SURROGATE_TRAIL_FIRST = 0xDC00 };
-	enum { SURROGATE_TRAIL_LAST = 0xDFFF };
 	enum { SURROGATE_FIRST_VALUE = 0x10000 };
-	enum eState { eStart, eSecondOf4Bytes, ePenultimate, eFinal };
 
-	int nCur = 0;
-	ubyte* pRead = reinterpret_cast<ubyte*>(utf8In);
-	utf16* pCur = reinterpret_cast<utf16*>(utf16Out);
+	// each input byte is at most one utf-16 character
+	utf16Out.resize(inLen * 2);
+	const ubyte* pRead = reinterpret_cast<const ubyte*>(utf8In);
 	const ubyte* pEnd = pRead + inLen;
-	const utf16* pCurStart = pCur;
-	eState eState = eStart;
+	ubyte* pCur = reinterpret_cast<ubyte*>(&utf16Out[0]);
+	const ubyte* pCurStart = pCur;
+	bool isBigEndian = (encoding == UTF_16BE);
 
 	// the BOM will automatically be converted to utf-16
 	while (pRead < pEnd)
 	{
-		switch (eState)
+#ifdef TR_USE_SSE2
+		// convert a block of ascii characters
+		if (pEnd - pRead >= 16)
 		{
-		case eStart:
-			if ((0xF0 & *pRead) == 0xF0)
-			{
-				nCur = (0x7 & *pRead) << 18;
-				eState = eSecondOf4Bytes;
-			}
-			else if ((0xE0 & *pRead) == 0xE0)
-			{
-				nCur = (~0xE0 & *pRead) << 12;
-				eState = ePenultimate;
-			}
-			else if ((0xC0 & *pRead) == 0xC0)
-			{
-				nCur = (~0xC0 & *pRead) << 6;
-				eState = eFinal;
-			}
-			else
+			__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRead));
+			if (_mm_movemask_epi8(block) == 0)
 			{
-				nCur = *pRead;
-				eState = eStart;
+				__m128i zero = _mm_setzero_si128();
+				__m128i low = isBigEndian ? _mm_unpacklo_epi8(zero, block) : _mm_unpacklo_epi8(block, zero);
+				__m128i high = isBigEndian ? _mm_unpackhi_epi8(zero, block) : _mm_unpackhi_epi8(block, zero);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pCur), low);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pCur + 16), high);
+				pRead += 16;
+				pCur += 32;
+				continue;
 			}
-			break;
-		case eSecondOf4Bytes:
-			nCur |= (0x3F & *pRead) << 12;
-			eState = ePenultimate;
-			break;
-		case ePenultimate:
-			nCur |= (0x3F & *pRead) << 6;
-			eState = eFinal;
-			break;
-		case eFinal:
-			nCur |= (0x3F & *pRead);
-			eState = eStart;
-			break;
-		default:
-			error("Bad eState value", "Utf8ToUtf16()");
 		}
-		++pRead;
-
-		if (eState == eStart)
+#endif
+		// the lead byte gives the length of the sequence
+		int codePoint = *pRead;
+		size_t seqLen = 1;
+		if ((0xF0 & codePoint) == 0xF0)
 		{
-			int codePoint = nCur;
-			if (codePoint >= SURROGATE_FIRST_VALUE)
-			{
-				codePoint -= SURROGATE_FIRST_VALUE;
-				int lead = (codePoint >> 10) + SURROGATE_LEAD_FIRST;
-				*pCur++ = static_cast<utf16>((encoding == UTF_16BE) ?
-				                             swap8to16bit(lead) : lead);
-				int trail = (codePoint & 0x3ff) + SURROGATE_TRAIL_FIRST;
-				*pCur++ = static_cast<utf16>((encoding == UTF_16BE) ?
-				                             swap8to16bit(trail) : trail);
-			}
-			else
-			{
-				*pCur++ = static_cast<utf16>((encoding == UTF_16BE) ?
-				                             swap8to16bit(codePoint) : codePoint);
-			}
+			codePoint = (0x7 & codePoint) << 18;
+			seqLen = 4;
 		}
-	}
-	// return value is the output length in BYTES (not wchar_t)
-	return (pCur - pCurStart) * 2;
-}
-
-// Adapted from SciTE UniConversion.cxx.
-// Copyright 1998-2001 by Neil Hodgson <neilh@scintilla.org>
-// Modified for Artistic Style by Jim Pattee.
-//
-// Compute the length of an output utf-16 file given a utf-8 file.
-// Return value is the size in BYTES (not wchar_t).
-size_t ASConsole::Utf16LengthFromUtf8(const char* data, size_t len) const
-{
-	size_t ulen = 0;
-	size_t charLen;
-	for (size_t i = 0; i < len;)
-	{
-		unsigned char ch = static_cast<unsigned char>(data[i]);
-		if (ch < 0x80)
-			charLen = 1;
-		else if (ch < 0x80 + 0x40 + 0x20)
-			charLen = 2;
-		else if (ch < 0x80 + 0x40 + 0x20 + 0x10)
-			charLen = 3;
-		else
+		else if ((0xE0 & codePoint) == 0xE0)
+		{
+			codePoint = (~0xE0 & codePoint) << 12;
+			seqLen = 3;
+		}
+		else if ((0xC0 & codePoint) == 0xC0)
+		{
+			codePoint = (~0xC0 & codePoint) << 6;
+			seqLen = 2;
+		}
+		if (static_cast<size_t>(pEnd - pRead) < seqLen)
+			break;
+		if (seqLen == 4)
+			codePoint |= (0x3F & pRead[1]) << 12;
+		if (seqLen >= 3)
+			codePoint |= (0x3F & pRead[seqLen - 2]) << 6;
+		if (seqLen >= 2)
+			codePoint |= (0x3F & pRead[seqLen - 1]);
+		pRead += seqLen;
+
+		int unit = codePoint;
+		if (codePoint >= SURROGATE_FIRST_VALUE)
 		{
-			charLen = 4;
-			ulen++;
+			codePoint -= SURROGATE_FIRST_VALUE;
+			int lead = (codePoint >> 10) + SURROGATE_LEAD_FIRST;
+			*pCur++ = static_cast<ubyte>(isBigEndian ? lead >> 8 : lead);
+			*pCur++ = static_cast<ubyte>(isBigEndian ? lead : lead >> 8);
+			unit = (codePoint & 0x3ff) + SURROGATE_TRAIL_FIRST;
 		}
-		i += charLen;
-		ulen++;
+		*pCur++ = static_cast<ubyte>(isBigEndian ? unit >> 8 : unit);
+		*pCur++ = static_cast<ubyte>(isBigEndian ? unit : unit >> 8);
 	}
-	// return value is the length in bytes (not wchar_t)
-	return ulen * 2;
+	utf16Out.resize(pCur - pCurStart);
 }
 
 // Adapted from SciTE Utf8_16.cxx.
@@ -1920,106 +3911,94 @@ size_t ASConsole::Utf16LengthFromUtf8(const char* data, size_t len) const
 // Modified for Artistic Style by Jim Pattee.
 //
 // Convert a utf-16 file to utf-8.
-size_t ASConsole::Utf16ToUtf8(char* utf16In, size_t inLen, FileEncoding encoding,
-                              bool firstBlock, char* utf8Out) const
+// The output is sized and converted in one pass. The ascii characters are
+// converted 16 at a time with SSE2 if it is available. The other characters
+// are converted as before: the surrogates are not validated, a byte past the
+// end of the input is read as zero, and only the first byte of the last
+// character is output.
+void ASConsole::Utf16ToUtf8(const char* utf16In, size_t inLen, FileEncoding encoding, string &utf8Out) const
 {
-	typedef unsigned short utf16;	// 16 bits
 	typedef unsigned char  ubyte;	// 8 bits
 	enum { SURROGATE_LEAD_FIRST = 0xD800 };
 	enum { SURROGATE_LEAD_LAST = 0xDBFF };
-	enum { SURROGATE_TRAIL_FIRST = 0xDC00 };
-	enum { SURROGATE_TRAIL_LAST = 0xDFFF };
 	enum { SURROGATE_FIRST_VALUE = 0x10000 };
-	enum eState { eStart, eSecondOf4Bytes, ePenultimate, eFinal };
 
-	int nCur16 = 0;
-	int nCur = 0;
-	ubyte* pRead = reinterpret_cast<ubyte*>(utf16In);
-	ubyte* pCur = reinterpret_cast<ubyte*>(utf8Out);
+	// each utf-16 character is at most three bytes, a surrogate pair is four
+	utf8Out.resize((inLen / 2 + 1) * 3);
+	const ubyte* pRead = reinterpret_cast<const ubyte*>(utf16In);
 	const ubyte* pEnd = pRead + inLen;
+	ubyte* pCur = reinterpret_cast<ubyte*>(&utf8Out[0]);
 	const ubyte* pCurStart = pCur;
-	static eState eState = eStart;	// eState is retained for subsequent blocks
-	if (firstBlock)
-		eState = eStart;
+	bool isBigEndian = (encoding == UTF_16BE);
 
 	// the BOM will automatically be converted to utf-8
 	while (pRead < pEnd)
 	{
-		switch (eState)
+#ifdef TR_USE_SSE2
+		// convert a block of ascii characters
+		if (pEnd - pRead >= 32)
 		{
-		case eStart:
-			if (pRead >= pEnd)
-			{
-				++pRead;
-				break;
-			}
-			if (encoding == UTF_16LE)
-			{
-				nCur16 = *pRead++;
-				nCur16 |= static_cast<utf16>(*pRead << 8);
-			}
-			else
+			__m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRead));
+			__m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pRead + 16));
+			if (isBigEndian)
 			{
-				nCur16 = static_cast<utf16>(*pRead++ << 8);
-				nCur16 |= static_cast<utf16>(*pRead);
+				first = _mm_or_si128(_mm_slli_epi16(first, 8), _mm_srli_epi16(first, 8));
+				second = _mm_or_si128(_mm_slli_epi16(second, 8), _mm_srli_epi16(second, 8));
 			}
-			if (nCur16 >= SURROGATE_LEAD_FIRST && nCur16 <= SURROGATE_LEAD_LAST)
+			__m128i nonAscii = _mm_and_si128(_mm_or_si128(first, second), _mm_set1_epi16(-0x80));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi16(nonAscii, _mm_setzero_si128())) == 0xFFFF)
 			{
-				++pRead;
-				int trail;
-				if (encoding == UTF_16LE)
-				{
-					trail = *pRead++;
-					trail |= static_cast<utf16>(*pRead << 8);
-				}
-				else
-				{
-					trail = static_cast<utf16>(*pRead++ << 8);
-					trail |= static_cast<utf16>(*pRead);
-				}
-				nCur16 = (((nCur16 & 0x3ff) << 10) | (trail & 0x3ff)) + SURROGATE_FIRST_VALUE;
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(pCur), _mm_packus_epi16(first, second));
+				pRead += 32;
+				pCur += 16;
+				continue;
 			}
-			++pRead;
+		}
+#endif
+		// a byte past the end of the input is zero
+		int byte1 = (pRead + 1 < pEnd) ? pRead[1] : 0;
+		int unit = isBigEndian ? (pRead[0] << 8 | byte1) : (pRead[0] | byte1 << 8);
+		pRead += 2;
+		if (unit >= SURROGATE_LEAD_FIRST && unit <= SURROGATE_LEAD_LAST)
+		{
+			int byte0 = (pRead < pEnd) ? pRead[0] : 0;
+			byte1 = (pRead + 1 < pEnd) ? pRead[1] : 0;
+			int trail = isBigEndian ? (byte0 << 8 | byte1) : (byte0 | byte1 << 8);
+			pRead += 2;
+			unit = (((unit & 0x3ff) << 10) | (trail & 0x3ff)) + SURROGATE_FIRST_VALUE;
+		}
 
-			if (nCur16 < 0x80)
-			{
-				nCur = static_cast<ubyte>(nCur16 & 0xFF);
-				eState = eStart;
-			}
-			else if (nCur16 < 0x800)
-			{
-				nCur = static_cast<ubyte>(0xC0 | (nCur16 >> 6));
-				eState = eFinal;
-			}
-			else if (nCur16 < SURROGATE_FIRST_VALUE)
+		// the last character is not completed
+		bool isLast = (pRead >= pEnd);
+		if (unit < 0x80)
+			*pCur++ = static_cast<ubyte>(unit);
+		else if (unit < 0x800)
+		{
+			*pCur++ = static_cast<ubyte>(0xC0 | (unit >> 6));
+			if (!isLast)
+				*pCur++ = static_cast<ubyte>(0x80 | (unit & 0x3F));
+		}
+		else if (unit < SURROGATE_FIRST_VALUE)
+		{
+			*pCur++ = static_cast<ubyte>(0xE0 | (unit >> 12));
+			if (!isLast)
 			{
-				nCur = static_cast<ubyte>(0xE0 | (nCur16 >> 12));
-				eState = ePenultimate;
+				*pCur++ = static_cast<ubyte>(0x80 | ((unit >> 6) & 0x3F));
+				*pCur++ = static_cast<ubyte>(0x80 | (unit & 0x3F));
 			}
-			else
+		}
+		else
+		{
+			*pCur++ = static_cast<ubyte>(0xF0 | (unit >> 18));
+			if (!isLast)
 			{
-				nCur = static_cast<ubyte>(0xF0 | (nCur16 >> 18));
-				eState = eSecondOf4Bytes;
+				*pCur++ = static_cast<ubyte>(0x80 | ((unit >> 12) & 0x3F));
+				*pCur++ = static_cast<ubyte>(0x80 | ((unit >> 6) & 0x3F));
+				*pCur++ = static_cast<ubyte>(0x80 | (unit & 0x3F));
 			}
-			break;
-		case eSecondOf4Bytes:
-			nCur = static_cast<ubyte>(0x80 | ((nCur16 >> 12) & 0x3F));
-			eState = ePenultimate;
-			break;
-		case ePenultimate:
-			nCur = static_cast<ubyte>(0x80 | ((nCur16 >> 6) & 0x3F));
-			eState = eFinal;
-			break;
-		case eFinal:
-			nCur = static_cast<ubyte>(0x80 | (nCur16 & 0x3F));
-			eState = eStart;
-			break;
-		default:
-			error("Bad eState value", "Utf16ToUtf8()");
 		}
-		*pCur++ = static_cast<ubyte>(nCur);
 	}
-	return pCur - pCurStart;
+	utf8Out.resize(pCur - pCurStart);
 }
 
 int ASConsole::waitForRemove(const char* newFileName) const
@@ -2037,69 +4016,16 @@ int ASConsole::waitForRemove(const char* newFileName) const
 	return seconds;
 }
 
-// From The Code Project http://www.codeproject.com/string/wildcmp.asp
-// Written by Jack Handy - jakkhandy@hotmail.com
-// Modified to compare case insensitive for Windows
-int ASConsole::wildcmp(const char* wild, const char* data) const
-{
-	const char* cp = NULL, *mp = NULL;
-	bool cmpval;
-
-	while ((*data) && (*wild != '*'))
-	{
-		if (!g_isCaseSensitive)
-			cmpval = (tolower(*wild) != tolower(*data)) && (*wild != '?');
-		else
-			cmpval = (*wild != *data) && (*wild != '?');
-
-		if (cmpval)
-		{
-			return 0;
-		}
-		wild++;
-		data++;
-	}
-
-	while (*data)
-	{
-		if (*wild == '*')
-		{
-			if (!*++wild)
-			{
-				return 1;
-			}
-			mp = wild;
-			cp = data + 1;
-		}
-		else
-		{
-			if (!g_isCaseSensitive)
-				cmpval = (tolower(*wild) == tolower(*data) || (*wild == '?'));
-			else
-				cmpval = (*wild == *data) || (*wild == '?');
-
-			if (cmpval)
-			{
-				wild++;
-				data++;
-			}
-			else
-			{
-				wild = mp;
-				data = cp++;
-			}
-		}
-	}
-
-	while (*wild == '*')
-	{
-		wild++;
-	}
-	return !*wild;
-}
-
-void ASConsole::writeFile(const string &fileName_, FileEncoding encoding, ostringstream &out) const
+// write the formatted output of a file
+// this may be called from a worker thread, so an error is saved in the
+// result and is reported by reportFileResult
+// return false if the file was not written
+bool ASConsole::writeFile(ASFileResult &result) const
 {
+	TRProfileTimer profileTimer(PROFILE_WRITE);
+	const string &fileName_ = result.fileName;
+	FileEncoding encoding = result.encoding;
+	const ASOutputBuffer &out = result.out;
 	// save date accessed and date modified of original file
 	struct stat stBuf;
 	bool statErr = false;
@@ -2110,26 +4036,37 @@ void ASConsole::writeFile(const string &fileName_, FileEncoding encoding, ostrin
 	if (!noBackup)
 	{
 		string origFileName = fileName_ + origSuffix;
-		removeFile(origFileName.c_str(), "Cannot remove pre-existing backup file");
-		renameFile(fileName_.c_str(), origFileName.c_str(), "Cannot create backup file");
+		if (!removeFile(origFileName.c_str()))
+		{
+			result.errorMsg = "Cannot remove pre-existing backup file";
+			result.errorFileName = origFileName;
+			result.errorNumber = errno;
+			return false;
+		}
+		if (!renameFile(fileName_.c_str(), origFileName.c_str()))
+		{
+			result.errorMsg = "Cannot create backup file";
+			result.errorNumber = errno;
+			return false;
+		}
 	}
 
 	// write the output file
 	ofstream fout(fileName_.c_str(), ios::binary | ios::trunc);
 	if (!fout)
-		error("Cannot open output file", fileName_.c_str());
+	{
+		result.errorMsg = "Cannot open output file";
+		return false;
+	}
 	if (encoding == UTF_16LE || encoding == UTF_16BE)
 	{
 		// convert utf-8 to utf-16
-		size_t utf16Size = Utf16LengthFromUtf8(out.str().c_str(), out.str().length());
-		char* utf16Out = new char[utf16Size];
-		size_t utf16Len = Utf8ToUtf16(const_cast<char*>(out.str().c_str()), out.str().length(), encoding, utf16Out);
-		assert(utf16Len == utf16Size);
-		fout << string(utf16Out, utf16Len);
-		delete []utf16Out;
+		string utf16Out;
+		Utf8ToUtf16(out.getData(), out.getSize(), encoding, utf16Out);
+		fout.write(utf16Out.data(), utf16Out.size());
 	}
 	else
-		fout << out.str();
+		fout.write(out.getData(), out.getSize());
 
 	fout.close();
 
@@ -2149,10 +4086,11 @@ void ASConsole::writeFile(const string &fileName_, FileEncoding encoding, ostrin
 		}
 		if (statErr)
 		{
-			perror("errno message");
-			(*_err) << "*********  Cannot preserve file date" << endl;
+			result.isDateError = true;
+			result.errorNumber = errno;
 		}
 	}
+	return true;
 }
 
 //-----------------------------------------------------------------------------
@@ -2210,8 +4148,166 @@ bool ASOptions::parseOptions(vector<string> &optionsVector, const string &errorI
 	return true;
 }
 
+/**
+ * Parse an option that is used only by the console.
+ * These options do not change the formatting.
+ *
+ * @return        true if arg is a console option.
+ */
+bool ASOptions::parseConsoleOption(const string &arg, const string &errorInfo)
+{
+	if ( isOption(arg, "n", "suffix=none") )
+	{
+		if (console)
+			console->setNoBackup(true);
+	}
+	else if ( isParamOption(arg, "suffix=") )
+	{
+		string suffixParam = getParam(arg, "suffix=");
+		if (suffixParam.length() > 0)
+		{
+			if (console)
+				console->setOrigSuffix(suffixParam);
+		}
+	}
+	else if ( isParamOption(arg, "exclude=") )
+	{
+		string suffixParam = getParam(arg, "exclude=");
+		if (suffixParam.length() > 0 && console)
+			console->updateExcludeVector(suffixParam);
+	}
+	else if ( isOption(arg, "r", "R") || isOption(arg, "recursive") )
+	{
+		if (console)
+			console->setIsRecursive(true);
+	}
+	else if ( isOption(arg, "Z", "preserve-date") )
+	{
+		if (console)
+			console->setPreserveDate(true);
+	}
+	else if ( isOption(arg, "v", "verbose") )
+	{
+		if (console)
+			console->setIsVerbose(true);
+	}
+	else if ( isOption(arg, "Q", "formatted") )
+	{
+		if (console)
+			console->setIsFormattedOnly(true);
+	}
+	else if ( isOption(arg, "q", "quiet") )
+	{
+		if (console)
+			console->setIsQuiet(true);
+	}
+	else if ( isOption(arg, "dry-run", "check") )
+	{
+		if (console)
+			console->setIsDryRun(true);
+	}
+	else if ( isOption(arg, "staged") )
+	{
+		if (console)
+			console->setIsStaged(true);
+	}
+	else if ( isOption(arg, "i", "ignore-exclude-errors") )
+	{
+		if (console)
+			console->setIgnoreExcludeErrors(true);
+	}
+	else if ( isOption(arg, "xi", "ignore-exclude-errors-x") )
+	{
+		if (console)
+			console->setIgnoreExcludeErrorsAndDisplay(true);
+	}
+	else if ( isParamOption(arg, "jobs=") )
+	{
+		int jobs = 0;
+		string jobsParam = getParam(arg, "jobs=");
+		if (jobsParam.length() > 0)
+			jobs = atoi(jobsParam.c_str());
+		if (jobs < 1 || jobs > 256)
+			isOptionError(arg, errorInfo);
+		else if (console)
+			console->setNumJobs(jobs);
+	}
+	else if ( isOption(arg, "jobs") )
+	{
+		int jobs = static_cast<int>(thread::hardware_concurrency());
+		if (console)
+			console->setNumJobs(jobs > 0 ? jobs : 1);
+	}
+	else if ( isOption(arg, "X", "errors-to-stdout") )
+	{
+		if (console)
+			_err = &cout;
+	}
+	else if ( isParamOption(arg, "cache=") )
+	{
+		string cacheParam = getParam(arg, "cache=");
+		if (cacheParam.length() == 0)
+			isOptionError(arg, errorInfo);
+		else if (console)
+			console->setCacheFileName(cacheParam);
+	}
+	else if ( isOption(arg, "cache") )
+	{
+		if (console)
+			console->setCacheFileName(".taarrule.cache");
+	}
+	else if ( isParamOption(arg, "stats=") )
+	{
+		string statsParam = getParam(arg, "stats=");
+		if (statsParam.length() == 0)
+			isOptionError(arg, errorInfo);
+		else if (console)
+			console->setStatsFileName(statsParam);
+	}
+	else if ( isParamOption(arg, "server=") )
+	{
+		string serverParam = getParam(arg, "server=");
+		if (serverParam.length() == 0)
+			isOptionError(arg, errorInfo);
+		else if (console)
+			console->setServerSocketName(serverParam);
+	}
+	else if ( isParamOption(arg, "socket=") )
+	{
+		string socketParam = getParam(arg, "socket=");
+		if (socketParam.length() == 0)
+			isOptionError(arg, errorInfo);
+		else if (console)
+			console->setSocketName(socketParam);
+	}
+	else if ( isParamOption(arg, "lines=") )
+	{
+		int firstLine = 0;
+		int lastLine = 0;
+		string linesParam = getParam(arg, "lines=");
+		size_t colon = linesParam.find(':');
+		if (colon != string::npos
+		        && linesParam.find_first_not_of("0123456789:") == string::npos)
+		{
+			firstLine = atoi(linesParam.substr(0, colon).c_str());
+			lastLine = atoi(linesParam.substr(colon + 1).c_str());
+		}
+		if (firstLine < 1 || lastLine < firstLine)
+			isOptionError(arg, errorInfo);
+		else if (console)
+			console->addLineRange(firstLine, lastLine);
+	}
+	else
+		return false;
+	return true;
+}
+
 void ASOptions::parseOption(const string &arg, const string &errorInfo)
 {
+	if (parseConsoleOption(arg, errorInfo))
+		return;
+	formatterOptions.append(arg).append(1, '\n');
+
 	if ( isOption(arg, "style=allman") || isOption(arg, "style=ansi")
 	        || isOption(arg, "style=bsd") || isOption(arg, "style=break") )
 	{
@@ -2655,56 +4751,6 @@ void ASOptions::parseOption(const string &arg, const string &errorInfo)
 	{
 		formatter.setPreprocDefineIndent(true);
 	}
-	else if ( isOption(arg, "n", "suffix=none") )
-	{
-		g_console->setNoBackup(true);
-	}
-	else if ( isParamOption(arg, "suffix=") )
-	{
-		string suffixParam = getParam(arg, "suffix=");
-		if (suffixParam.length() > 0)
-		{
-			g_console->setOrigSuffix(suffixParam);
-		}
-	}
-	else if ( isParamOption(arg, "exclude=") )
-	{
-		string suffixParam = getParam(arg, "exclude=");
-		if (suffixParam.length() > 0)
-			g_console->updateExcludeVector(suffixParam);
-	}
-	else if ( isOption(arg, "r", "R") || isOption(arg, "recursive") )
-	{
-		g_console->setIsRecursive(true);
-	}
-	else if ( isOption(arg, "Z", "preserve-date") )
-	{
-		g_console->setPreserveDate(true);
-	}
-	else if ( isOption(arg, "v", "verbose") )
-	{
-		g_console->setIsVerbose(true);
-	}
-	else if ( isOption(arg, "Q", "formatted") )
-	{
-		g_console->setIsFormattedOnly(true);
-	}
-	else if ( isOption(arg, "q", "quiet") )
-	{
-		g_console->setIsQuiet(true);
-	}
-	else if ( isOption(arg, "i", "ignore-exclude-errors") )
-	{
-		g_console->setIgnoreExcludeErrors(true);
-	}
-	else if ( isOption(arg, "xi", "ignore-exclude-errors-x") )
-	{
-		g_console->setIgnoreExcludeErrorsAndDisplay(true);
-	}
-	else if ( isOption(arg, "X", "errors-to-stdout") )
-	{
-		_err = &cout;
-	}
 	else if ( isOption(arg, "lineend=windows") )
 	{
 		formatter.setLineEndFormat(LINEEND_WINDOWS);
@@ -2772,6 +4818,11 @@ void ASOptions::importOptions(istream &in, vector<string> &optionsVector)
 	}
 }
 
+string ASOptions::getFormatterOptions() const
+{
+	return formatterOptions;
+}
+
 string ASOptions::getOptionErrors()
 {
 	return optionErrors.str();
@@ -2827,31 +4878,183 @@ bool ASOptions::isParamOption(const string &arg, const char* option1, const char
 
 using namespace TaaRRule;
 
+//----------------------------------------------------------------------------
+// AStyleMain function for library build
+//----------------------------------------------------------------------------
+
+/**
+ * Format a source text for an application that embeds the formatter.
+ * The formatter, options, and file arena are local to the call and no
+ * global variables are used, so it may be called from several threads
+ * at the same time. The callback functions must also be thread safe.
+ *
+ * @param pSourceIn         The source text to be formatted, NULL terminated.
+ * @param pOptions          The formatting options, in options file format.
+ * @param fpErrorHandler    Called with an error number and message.
+ * @param fpMemoryAlloc     Allocates the memory for the formatted text.
+ * @return                  The formatted text, or NULL if there is an error.
+ */
+extern "C" EXPORT char* STDCALL AStyleMain(const char* pSourceIn,		// the source to be formatted
+                                           const char* pOptions,		// TaaRRule options
+                                           fpError fpErrorHandler,		// error handler function
+                                           fpAlloc fpMemoryAlloc)		// memory allocation function
+{
+	if (fpErrorHandler == NULL)         // cannot display a message if no error handler
+		return NULL;
+
+	if (pSourceIn == NULL)
+	{
+		fpErrorHandler(101, "No pointer to source input.");
+		return NULL;
+	}
+	if (pOptions == NULL)
+	{
+		fpErrorHandler(102, "No pointer to TaaRRule options.");
+		return NULL;
+	}
+	if (fpMemoryAlloc == NULL)
+	{
+		fpErrorHandler(103, "No pointer to memory allocation function.");
+		return NULL;
+	}
+
+	TRFormatter formatter;
+	ASOptions options(formatter);
+
+	vector<string> optionsVector;
+	istringstream opt(pOptions);
+	options.importOptions(opt, optionsVector);
+
+	bool ok = options.parseOptions(optionsVector, "Invalid TaaRRule options:");
+	if (!ok)
+		fpErrorHandler(130, options.getOptionErrors().c_str());
+
+	LineEndFormat lineEndFormat = formatter.getLineEndFormat();
+	const char* fixedEOL = NULL;
+	if (lineEndFormat == LINEEND_WINDOWS)
+		fixedEOL = "\r\n";
+	else if (lineEndFormat == LINEEND_LINUX)
+		fixedEOL = "\n";
+	else if (lineEndFormat == LINEEND_MACOLD)
+		fixedEOL = "\r";
+
+	TRBufferIterator streamIterator(pSourceIn, strlen(pSourceIn));
+	formatter.init(&streamIterator);
+	string out;
+	out.reserve(strlen(pSourceIn) + strlen(pSourceIn) / 8);
+
+	while (formatter.hasMoreLines())
+	{
+		out.append(formatter.nextLine());
+		if (formatter.hasMoreLines())
+			out.append(fixedEOL != NULL ? fixedEOL : streamIterator.getOutputEOL());
+		else
+		{
+			// this can happen if the file if missing a closing bracket and break-blocks is requested
+			if (formatter.getIsLineReady())
+			{
+				out.append(fixedEOL != NULL ? fixedEOL : streamIterator.getOutputEOL());
+				out.append(formatter.nextLine());
+			}
+		}
+	}
+	formatter.releaseFileStacks();
+
+	unsigned long textSizeOut = out.length();
+	char* pTextOut = fpMemoryAlloc(textSizeOut + 1);     // call memory allocation function
+	if (pTextOut == NULL)
+	{
+		fpErrorHandler(120, "Allocation failure on output.");
+		return NULL;
+	}
+
+	memcpy(pTextOut, out.c_str(), textSizeOut);
+	pTextOut[textSizeOut] = '\0';
+	return pTextOut;
+}
+
 //----------------------------------------------------------------------------
 // main function functions for Console build
+// TAARRULE_LIB is defined to link the formatter into another program
 //----------------------------------------------------------------------------
+#ifndef TAARRULE_LIB
+
+// the global allocation functions count the allocations for the profile
+// there are no exceptions so a failed allocation calls the new handler
+// or aborts, the nothrow versions return NULL
+void* operator new(size_t size)
+{
+	TRProfile::countAllocation();
+	void* memory;
+	while ((memory = malloc(size > 0 ? size : 1)) == NULL)
+	{
+		new_handler handler = get_new_handler();
+		if (handler == NULL)
+			abort();
+		handler();
+	}
+	return memory;
+}
+
+void* operator new(size_t size, const nothrow_t &) noexcept
+{
+	TRProfile::countAllocation();
+	return malloc(size > 0 ? size : 1);
+}
+
+void* operator new[](size_t size)
+{ return operator new(size); }
+
+void* operator new[](size_t size, const nothrow_t &) noexcept
+{ return operator new(size, nothrow); }
+
+void operator delete(void* memory) noexcept
+{ free(memory); }
+
+void operator delete(void* memory, size_t) noexcept
+{ free(memory); }
+
+void operator delete[](void* memory) noexcept
+{ free(memory); }
+
+void operator delete[](void* memory, size_t) noexcept
+{ free(memory); }
+
 int main(int argc, char** argv)
 {
 	// create objects
 	TRFormatter formatter;
-	g_console = new ASConsole(formatter);
+	ASConsole console(formatter);
 
 	// process command line and options file
 	// build the vectors fileNameVector, optionsVector, and fileOptionsVector
 	vector<string> argvOptions;
-	argvOptions = g_console->getArgvOptions(argc, argv);
-	g_console->processOptions(argvOptions);
+	argvOptions = console.getArgvOptions(argc, argv);
+	console.processOptions(argvOptions);
+
+	// the server formats the requests until it is stopped
+	if (!console.getServerSocketName().empty())
+	{
+		console.runServer();
+		return EXIT_SUCCESS;
+	}
 
 	// if no files have been given, use cin for input and cout for output
-	if (g_console->fileNameVectorIsEmpty())
+	// the staged option reads the file names from cin instead
+	if (console.fileNameVectorIsEmpty() && !console.getIsStaged())
 	{
-		g_console->formatCinToCout();
+		console.formatCinToCout();
 		return EXIT_SUCCESS;
 	}
 
 	// process entries in the fileNameVector
-	g_console->processFiles();
+	console.processFiles();
+
+	// a dry run fails if a file would be changed
+	if (console.getIsDryRun() && console.getFilesFormatted() > 0)
+		return EXIT_FAILURE;
 
-	delete g_console;
 	return EXIT_SUCCESS;
 }
+
+#endif  // TAARRULE_LIB
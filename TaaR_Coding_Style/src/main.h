@@ -15,6 +15,9 @@
 #include "TaaRRule.h"
 #include <sstream>
 #include <ctime>
+#include <deque>
+#include <stdint.h>
+#include <unordered_map>
 #ifdef _MSC_VER
 	#include <sys/utime.h>
 	#include <sys/stat.h>
@@ -27,6 +30,9 @@
 //----------------------------------------------------------------------------
 // TRStreamIterator class
 // typename will be istringstream for GUI and istream otherwise
+// the stream is read once, the lines read by peekNextLine are kept in a
+// look-ahead window until nextLine uses them, so tellg and seekg are not
+// needed and the input does not have to be copied before formatting
 // TRSourceIterator is an abstract class defined in TaaRRule.h
 //----------------------------------------------------------------------------
 namespace TaaRRule {
@@ -46,25 +52,305 @@ class TRStreamIterator : public TRSourceIterator
 		void saveLastInputLine();
 
 	private:
+		// an input line and the end of line characters that followed it
+		struct StreamLine
+		{
+			string text;        // the line minus the end of line characters
+			string eol;         // the end of line characters, empty at the end of input
+			bool isLastEol;     // the end of line is the last character of the input
+		};
+
 		TRStreamIterator(const TRStreamIterator &copy);       // copy constructor not to be imlpemented
 		TRStreamIterator &operator=(TRStreamIterator &);      // assignment operator not to be implemented
+		void readLine(StreamLine &line);
 		T* inStream;           // pointer to the input stream
 		string buffer;         // current input line
 		string prevBuffer;     // previous input line
+		deque<StreamLine> peekWindow;  // lines read by peekNextLine and not by nextLine
+		size_t peekIndex;      // index in peekWindow of the next peeked line
 		int eolWindows;        // number of Windows line endings, CRLF
 		int eolLinux;          // number of Linux line endings, LF
 		int eolMacOld;         // number of old Mac line endings. CR
 		char outputEOL[4];     // next output end of line char
-		streamoff peekStart;   // starting position for peekNextLine
+		bool isPeeking;        // peekNextLine has been called
+		bool isEndOfInput;     // the end of input has been read, also by peekNextLine
 		bool prevLineDeleted;  // the previous input line was deleted
 
 	public:	// inline functions
 		bool compareToInputBuffer(const string &nextLine_) const
 		{ return (nextLine_ == prevBuffer); }
 		const char* getOutputEOL() const { return outputEOL; }
-		bool hasMoreLines() const { return !inStream->eof(); }
+		bool hasMoreLines() const { return !isEndOfInput; }
+};
+
+//----------------------------------------------------------------------------
+// TRBufferIterator class
+// reads the lines from a single contiguous buffer that is not owned
+// the line ends are found with memchr, the previous line is kept as a view
+// TRSourceIterator is an abstract class defined in TaaRRule.h
+//----------------------------------------------------------------------------
+class TRBufferIterator : public TRSourceIterator
+{
+	public:
+		bool checkForEmptyLine;
+
+		// function declarations
+		TRBufferIterator(const char* data, size_t dataSize);
+		virtual ~TRBufferIterator();
+		bool getLineEndChange(int lineEndFormat) const;
+		string nextLine(bool emptyLineWasDeleted);
+		string peekNextLine();
+		void peekReset();
+		void saveLastInputLine();
+
+	private:
+		TRBufferIterator(const TRBufferIterator &copy);       // copy constructor not to be imlpemented
+		TRBufferIterator &operator=(TRBufferIterator &);      // assignment operator not to be implemented
+		size_t findLineEnd(size_t start, size_t &nextCR, size_t &nextLF) const;
+		const char* inData;    // pointer to the input buffer
+		size_t inSize;         // size of the input buffer
+		size_t inPos;          // start of the next input line
+		size_t lineStart;      // start of the current input line
+		size_t lineLength;     // length of the current input line
+		size_t prevStart;      // start of the previous input line
+		size_t prevLength;     // length of the previous input line
+		size_t nextCR;         // position of the next CR at or after inPos
+		size_t nextLF;         // position of the next LF at or after inPos
+		size_t peekPos;        // start of the next peeked line
+		size_t peekCR;         // position of the next CR at or after peekPos
+		size_t peekLF;         // position of the next LF at or after peekPos
+		int eolWindows;        // number of Windows line endings, CRLF
+		int eolLinux;          // number of Linux line endings, LF
+		int eolMacOld;         // number of old Mac line endings. CR
+		char outputEOL[4];     // next output end of line char
+		bool isPeeking;        // peekNextLine has been called
+		bool isEndOfInput;     // the end of input has been read, also by peekNextLine
+		bool prevLineDeleted;  // the previous input line was deleted
+
+	public:	// inline functions
+		bool compareToInputBuffer(const string &nextLine_) const
+		{ return (nextLine_.compare(0, string::npos, inData + prevStart, prevLength) == 0); }
+		const char* getOutputEOL() const { return outputEOL; }
+		bool hasMoreLines() const { return !isEndOfInput; }
+};
+
+//----------------------------------------------------------------------------
+// ASFileBuffer class
+// the contents of an input file
+// large files are memory mapped and given to the formatter without a copy
+// small files and converted utf-16 files are in copyData
+//----------------------------------------------------------------------------
+class ASFileBuffer
+{
+	public:
+		ASFileBuffer() : mapData(NULL), mapSize(0) {}
+		~ASFileBuffer() { unmapFile(); }
+		bool mapFile(const string &fileName, size_t fileSize);
+		void unmapFile();
+		string copyData;        // the input if it is not memory mapped
+
+	private:
+		ASFileBuffer(const ASFileBuffer &copy);       // copy constructor not to be imlpemented
+		ASFileBuffer &operator=(ASFileBuffer &);      // assignment operator not to be implemented
+		const char* mapData;    // the memory mapped input file
+		size_t mapSize;         // size of the memory mapped input file
+
+	public:	// inline functions
+		const char* getData() const { return (mapData != NULL ? mapData : copyData.data()); }
+		size_t getSize() const { return (mapData != NULL ? mapSize : copyData.length()); }
+		bool isMapped() const { return (mapData != NULL); }
+};
+
+//----------------------------------------------------------------------------
+// ASOutputBuffer class
+// the formatted output of a file
+// the lines and line ends are appended to a single contiguous buffer
+// that is written to the output file without a copy
+//----------------------------------------------------------------------------
+class ASOutputBuffer
+{
+	public:
+		ASOutputBuffer() {}
+		void appendEOL(const char* eol);
+		void convertLineEnds(const char* eol);
+		void release();
+
+	private:
+		ASOutputBuffer(const ASOutputBuffer &copy);       // copy constructor not to be imlpemented
+		ASOutputBuffer &operator=(ASOutputBuffer &);      // assignment operator not to be implemented
+		string buffer;                          // the formatted output
+		vector<pair<size_t, size_t> > lineEnds; // position and length of each line end in buffer
+
+	public:	// inline functions
+		void appendLine(const string &line) { buffer.append(line); }
+		void reserve(size_t size) { buffer.reserve(size); }
+		const char* getData() const { return buffer.data(); }
+		size_t getSize() const { return buffer.length(); }
 };
 
+//----------------------------------------------------------------------------
+// ASFileCache class
+// an on-disk cache of the files that were unchanged by the formatter
+// a record is keyed by the hash of the file contents and the hash of the
+// formatter options, so a file with a matching record is not formatted
+// the cache file is an 8 byte header followed by fixed size records,
+// new records are appended at the end of a run
+//----------------------------------------------------------------------------
+struct ASCacheRecord
+{
+	uint64_t contentHash;				// hash of the file contents
+	uint64_t optionsHash;				// hash of the formatter options
+	uint32_t fileSize;					// low 32 bits of the file size, a collision check
+	uint32_t linesOut;					// number of output lines, for the stats
+};
+
+class ASFileCache
+{
+	public:
+		ASFileCache() : optionsHash(0), numFileRecords(0) {}
+		void addRecord(uint64_t contentHash, size_t fileSize, int linesOut);
+		bool findRecord(uint64_t contentHash, size_t fileSize, int &linesOut) const;
+		static uint64_t hashData(const char* data, size_t dataSize, uint64_t hash = 14695981039346656037ULL);
+		void load(const string &fileName, uint64_t optionsHash_);
+		bool save() const;
+
+	private:
+		ASFileCache(const ASFileCache &copy);       // copy constructor not to be imlpemented
+		ASFileCache &operator=(ASFileCache &);      // assignment operator not to be implemented
+		string cacheFileName;                       // file path and name of the cache
+		uint64_t optionsHash;                       // hash of the formatter options for this run
+		size_t numFileRecords;                      // number of records in the cache file
+		unordered_map<uint64_t, ASCacheRecord> records;	// records for optionsHash by contentHash
+		vector<ASCacheRecord> newRecords;           // records to be appended to the cache file
+};
+
+//----------------------------------------------------------------------------
+// ASExcludeMatcher class
+// the exclude= options compiled to a trie of the reversed excludes
+// a path is matched from its last character back, so all of the excludes
+// that end the path are found in one pass whatever the number of excludes
+// the excludes are folded to lower case when they are added if the
+// file names are not case sensitive
+//----------------------------------------------------------------------------
+class ASExcludeMatcher
+{
+	public:
+		ASExcludeMatcher() : fileSeparator('/'), isCaseSensitive(true) { nodes.resize(1); }
+		void addExclude(const string &exclude, size_t excludeIndex);
+		int  findExclude(const string &path) const;
+		void setFileSystem(char fileSeparator_, bool isCaseSensitive_);
+
+	private:
+		ASExcludeMatcher(const ASExcludeMatcher &copy);     // copy constructor not to be imlpemented
+		ASExcludeMatcher &operator=(ASExcludeMatcher &);    // assignment operator not to be implemented
+		struct TrieNode
+		{
+			TrieNode() : excludeIndex(-1) {}
+			int excludeIndex;                   // first exclude that ends at this node, -1 if none
+			vector<pair<char, int> > children;  // the next character back and its node index
+		};
+		vector<TrieNode> nodes;                 // the trie, nodes[0] is the root
+		char fileSeparator;                     // directory separator for the platform
+		bool isCaseSensitive;                   // file names are case sensitive on the platform
+};
+
+//----------------------------------------------------------------------------
+// ASWildcardMatcher class
+// a file name wildcard compiled to the parts between the '*' characters
+// the first part must begin the name and the last part must end it,
+// the other parts are found in order so there is no backtracking
+// the parts are folded to lower case if the file names are not case sensitive
+//----------------------------------------------------------------------------
+class ASWildcardMatcher
+{
+	public:
+		ASWildcardMatcher() : hasStar(false), isCaseSensitive(true) {}
+		void compile(const string &wildcard, bool isCaseSensitive_);
+		bool isMatch(const char* name) const;
+
+	private:
+		ASWildcardMatcher(const ASWildcardMatcher &copy);   // copy constructor not to be imlpemented
+		ASWildcardMatcher &operator=(ASWildcardMatcher &);  // assignment operator not to be implemented
+		bool isPartMatch(const char* name, const string &part) const;
+		vector<string> parts;                   // the parts of the wildcard between the '*'
+		bool hasStar;                           // the wildcard has a '*'
+		bool isCaseSensitive;                   // file names are case sensitive on the platform
+};
+
+//----------------------------------------------------------------------------
+// ASServerHeader struct
+// the header of a request to the server= socket and of the reply
+// a request is the header, the options text, and the source text
+// a reply is the header and the formatted text or an error message
+//----------------------------------------------------------------------------
+
+enum ServerStatus
+{
+	SERVER_OK,              // the text is formatted
+	SERVER_NEED_OPTIONS,    // the options hash is unknown, send the options text
+	SERVER_ERROR            // the text is an error message
+};
+
+struct ASServerHeader
+{
+	uint64_t optionsHash;   // hash of the formatter options
+	uint32_t status;        // ServerStatus of a reply, zero for a request
+	uint32_t optionsLength; // length of the options text, zero if the hash is known
+	uint32_t dataLength;    // length of the source text or the reply text
+};
+
+// the limits of a request, a larger request is formatted by the client
+const uint32_t SERVER_MAX_OPTIONS = 1024 * 1024;        // options text length
+const uint32_t SERVER_MAX_DATA = 64 * 1024 * 1024;      // source or reply text length
+const int SERVER_TIMEOUT = 2;                           // seconds the server waits for a client
+const int CLIENT_TIMEOUT = 5;                           // seconds a client waits for the server
+
+//----------------------------------------------------------------------------
+// ASFileResult struct
+// the per-file state and output of a formatted file
+// each file has its own so files can be formatted on worker threads
+//----------------------------------------------------------------------------
+
+struct ASFileResult
+{
+	ASFileResult() {
+		encoding = ENCODING_8BIT;
+		filesAreIdentical = true;
+		lineEndsMixed = false;
+		isFormatted = false;
+		isDone = false;
+		isCached = false;
+		isDateError = false;
+		errorMsg = NULL;
+		errorNumber = 0;
+		linesOut = 0;
+		contentHash = 0;
+		fileSize = 0;
+		outputEOL[0] = '\0';
+		prevEOL[0] = '\0';
+	}
+
+	string fileName;					// file path and name being processed
+	ASOutputBuffer out;					// formatted output
+	FileEncoding encoding;				// encoding of the input file
+	bool filesAreIdentical;				// input and output files are identical
+	bool lineEndsMixed;					// output has mixed line ends
+	bool isFormatted;					// the file was changed and written
+	bool isDone;						// formatting is complete, set by the worker thread
+	bool isCached;						// the file was unchanged in the cache and not formatted
+	bool isDateError;					// the date of the written file could not be preserved
+	const char* errorMsg;				// the error that ends the run, reported in file order
+	string errorFileName;				// the file of the error if it is not fileName
+	int  errorNumber;					// errno of the error, zero if none
+	int  linesOut;						// number of output lines
+	uint64_t contentHash;				// hash of the input, set if the cache is used
+	size_t fileSize;					// size of the input, set if the cache is used
+	char outputEOL[4];					// current line end
+	char prevEOL[4];					// previous line end
+};
+
+class ASConsole;
+
 //----------------------------------------------------------------------------
 // ASOptions class for options processing
 // used by both console and library builds
@@ -73,7 +359,9 @@ class TRStreamIterator : public TRSourceIterator
 class ASOptions
 {
 	public:
-		ASOptions(TRFormatter &formatterArg) : formatter(formatterArg) {}
+		ASOptions(TRFormatter &formatterArg, ASConsole* consoleArg = NULL)
+			: formatter(formatterArg), console(consoleArg) {}
+		string getFormatterOptions() const;
 		string getOptionErrors();
 		void importOptions(istream &in, vector<string> &optionsVector);
 		bool parseOptions(vector<string> &optionsVector, const string &errorInfo);
@@ -81,7 +369,9 @@ class ASOptions
 	private:
 		// variables
 		TRFormatter &formatter;			// reference to the TRFormatter object
+		ASConsole* console;				// console options are ignored if NULL
 		stringstream optionErrors;		// option error messages
+		string formatterOptions;		// options that change the formatting, one per line
 
 		// functions
 		ASOptions &operator=(ASOptions &);         // not to be implemented
@@ -92,6 +382,7 @@ class ASOptions
 		void isOptionError(const string &arg, const string &errorInfo);
 		bool isParamOption(const string &arg, const char* option);
 		bool isParamOption(const string &arg, const char* option1, const char* option2);
+		bool parseConsoleOption(const string &arg, const string &errorInfo);
 		void parseOption(const string &arg, const string &errorInfo);
 };
 
@@ -112,20 +403,34 @@ class ASConsole
 		bool isVerbose;                     // verbose option
 		bool isQuiet;                       // quiet option
 		bool isFormattedOnly;               // formatted lines only option
+		bool isDryRun;                      // dry-run option, files are not written
+		bool isStaged;                      // staged option, display only the changed file names
+		bool isStagedFromCin;               // staged file names are NUL separated from cin
 		bool ignoreExcludeErrors;           // don't abort on unmatched excludes
 		bool ignoreExcludeErrorsDisplay;    // don't display unmatched excludes
 		bool optionsFileRequired;           // options= option
 		bool useAscii;                      // ascii option
+		int  numJobs;                       // jobs= option
+		string cacheFileName;               // cache= option, empty if the cache is not used
+		vector<pair<size_t, size_t> > lineRanges;  // lines= option, zero based first and last lines
+		string serverSocketName;            // server= option, empty if not a server
+		string socketName;                  // socket= option, empty if the server is not used
+		string statsFileName;               // stats= option, the JSON profile of the run
 		// other variables
+		char fileSeparator;                 // directory separator for the platform
+		bool isCaseSensitive;               // file names are case sensitive on the platform
 		bool hasWildcard;                   // file name includes a wildcard
+		bool lineEndsMixed;					// last file output has mixed line ends
 		size_t mainDirectoryLength;         // directory length to be excluded in displays
-		bool filesAreIdentical;				// input and output files are identical
-		bool lineEndsMixed;					// output has mixed line ends
 		int  linesOut;                      // number of output lines
 		int  filesFormatted;                // number of files formatted
 		int  filesUnchanged;                // number of files unchanged
-		char outputEOL[4];					// current line end
-		char prevEOL[4];					// previous line end
+		int  filesCached;                   // number of unchanged files found in the cache
+		uint64_t optionsHash;               // hash of the formatter options for the cache and server
+		string formatterOptions;            // the formatter options, sent to the server
+		ASFileCache fileCache;              // cache of unchanged files
+		ASExcludeMatcher excludeMatcher;    // the compiled excludeVector
+		ASWildcardMatcher wildcardMatcher;  // the compiled wildcard of the file path
 
 		string optionsFileName;             // file path and name of the options file to use
 		string targetDirectory;             // path to the directory being processed
@@ -148,64 +453,86 @@ class ASConsole
 			isVerbose = false;
 			isQuiet = false;
 			isFormattedOnly = false;
+			isDryRun = false;
+			isStaged = false;
+			isStagedFromCin = false;
 			ignoreExcludeErrors = false;
 			ignoreExcludeErrorsDisplay = false;
 			optionsFileRequired = false;
 			useAscii = false;
+			numJobs = 1;
 			// other variables
+#ifdef _WIN32
+			fileSeparator = '\\';
+			isCaseSensitive = false;
+#else
+			fileSeparator = '/';
+			isCaseSensitive = true;
+#endif
+			excludeMatcher.setFileSystem(fileSeparator, isCaseSensitive);
 			hasWildcard = false;
-			filesAreIdentical = true;
 			lineEndsMixed = false;
-			outputEOL[0] = '\0';
-			prevEOL[0] = '\0';
 			mainDirectoryLength = 0;
 			filesFormatted = 0;
 			filesUnchanged = 0;
+			filesCached = 0;
+			optionsHash = 0;
 			linesOut = 0;
 		}
 
 		// public functions
-		void convertLineEnds(ostringstream &out, int lineEnd);
+		void addLineRange(int firstLine, int lastLine);
 		FileEncoding detectEncoding(const char* data, size_t dataSize) const;
 		void error() const;
 		void error(const char* why, const char* what) const;
 		void formatCinToCout();
 		vector<string> getArgvOptions(int argc, char** argv) const;
 		bool fileNameVectorIsEmpty();
+		string getCacheFileName();
 		int  getFilesFormatted();
 		bool getIgnoreExcludeErrors();
 		bool getIgnoreExcludeErrorsDisplay();
+		bool getIsDryRun();
 		bool getIsFormattedOnly();
 		bool getIsQuiet();
 		bool getIsRecursive();
+		bool getIsStaged();
 		bool getIsVerbose();
 		bool getLineEndsMixed();
 		bool getNoBackup();
+		int  getNumJobs();
 		string getLanguageID() const;
 		string getNumberFormat(int num, size_t = 0) const ;
 		string getNumberFormat(int num, const char* groupingArg, const char* separator) const;
 		string getOptionsFileName();
 		string getOrigSuffix();
 		bool getPreserveDate();
+		string getServerSocketName();
 		void processFiles();
 		void processOptions(vector<string> &argvOptions);
+		void runServer();
+		void setCacheFileName(string name);
 		void setIgnoreExcludeErrors(bool state);
 		void setIgnoreExcludeErrorsAndDisplay(bool state);
+		void setIsDryRun(bool state);
 		void setIsFormattedOnly(bool state);
 		void setIsQuiet(bool state);
 		void setIsRecursive(bool state);
+		void setIsStaged(bool state);
 		void setIsVerbose(bool state);
 		void setNoBackup(bool state);
+		void setNumJobs(int jobs);
 		void setOptionsFileName(string name);
 		void setOrigSuffix(string suffix);
 		void setPreserveDate(bool state);
+		void setServerSocketName(string name);
+		void setSocketName(string name);
+		void setStatsFileName(string name);
 		void standardizePath(string &path, bool removeBeginningSeparator = false) const;
 		bool stringEndsWith(const string &str, const string &suffix) const;
 		void updateExcludeVector(string suffixParam);
-		size_t Utf8LengthFromUtf16(const char* data, size_t len, FileEncoding encoding) const;
-		size_t Utf8ToUtf16(char* utf8In, size_t inLen, FileEncoding encoding, char* utf16Out) const;
-		size_t Utf16LengthFromUtf8(const char* data, size_t len) const;
-		size_t Utf16ToUtf8(char* utf16In, size_t inLen, FileEncoding encoding, bool firstBlock, char* utf8Out) const;
+		void Utf8ToUtf16(const char* utf8In, size_t inLen, FileEncoding encoding, string &utf16Out) const;
+		void Utf16ToUtf8(const char* utf16In, size_t inLen, FileEncoding encoding, string &utf8Out) const;
 
 		// for unit testing
 		vector<string> getExcludeVector();
@@ -217,32 +544,55 @@ class ASConsole
 
 	private:	// functions
 		ASConsole &operator=(ASConsole &);         // not to be implemented
-		void correctMixedLineEnds(ostringstream &out);
+		void configureFormatter(TRFormatter &fileFormatter);
+		void findSyncLines(const char* data, size_t dataSize, size_t lastLine,
+		                   vector<size_t> &lineStart, vector<bool> &isSyncLine) const;
+		void formatBuffer(TRFormatter &bufferFormatter, const char* data, size_t dataSize,
+		                  string &out) const;
 		void formatFile(const string &fileName_);
+		void formatFileResult(TRFormatter &fileFormatter, ASFileResult &result) const;
+		void formatFiles();
+		void formatFilesInParallel();
+		size_t formatLineRange(const char* data, const vector<size_t> &lineStart,
+		                       const vector<bool> &isSyncLine, size_t firstLine,
+		                       size_t lastLine, const char* documentEOL, string &text,
+		                       ASFileResult &result);
+		void formatLineRanges(const char* data, size_t dataSize);
+		void formatLines(const char* data, size_t dataSize, const char* documentEOL,
+		                 vector<string> &lines, vector<string> &lineEnds, ASFileResult &result);
+		bool formatWithServer(const string &inData, string &outData) const;
 		string getCurrentDirectory(const string &fileName_) const;
+		size_t getLineEnd(const char* data, const vector<size_t> &lineStart, size_t line) const;
 		void getFileNames(const string &directory, const string &wildcard);
 		void getFilePaths(string &filePath);
+		void getStagedFilePaths();
 		string getParam(const string &arg, const char* op);
-		void initializeOutputEOL(LineEndFormat lineEndFormat);
+		void initializeOutputEOL(LineEndFormat lineEndFormat, ASFileResult &result) const;
 		bool isOption(const string &arg, const char* op);
 		bool isOption(const string &arg, const char* op1, const char* op2);
 		bool isParamOption(const string &arg, const char* option);
 		bool isPathExclued(const string &subPath);
+		bool openSocket(const string &name, int &fd, bool isServer) const;
 		void printHelp() const;
 		void printMsg(const char* msg, const string &data) const;
 		void printSeparatingLine() const;
 		void printVerboseHeader() const;
+		void printVerboseProfile() const;
 		void printVerboseStats(clock_t startTime) const;
-		FileEncoding readFile(const string &fileName, stringstream &in) const;
-		void removeFile(const char* fileName_, const char* errMsg) const;
-		void renameFile(const char* oldFileName, const char* newFileName, const char* errMsg) const;
-		void setOutputEOL(LineEndFormat lineEndFormat, const char* currentEOL);
+		bool readFile(ASFileBuffer &in, ASFileResult &result) const;
+		bool readSocket(int fd, char* data, size_t dataSize) const;
+		bool removeFile(const char* fileName_) const;
+		bool renameFile(const char* oldFileName, const char* newFileName) const;
+		void reportFileResult(const ASFileResult &result);
+		void serveRequest(int fd, unordered_map<uint64_t, TRFormatter*> &serverFormatters,
+		                  unordered_map<uint64_t, size_t> &unchangedSizes) const;
+		void setOutputEOL(LineEndFormat lineEndFormat, const char* currentEOL, ASFileResult &result) const;
+		bool setSocketTimeout(int fd, int seconds) const;
 		void sleep(int seconds) const;
-		int  swap8to16bit(int value) const;
-		int  swap16bit(int value) const;
 		int  waitForRemove(const char* oldFileName) const;
-		int  wildcmp(const char* wild, const char* data) const;
-		void writeFile(const string &fileName_, FileEncoding encoding, ostringstream &out) const;
+		bool writeFile(ASFileResult &result) const;
+		bool writeSocket(int fd, const char* data, size_t dataSize) const;
+		void writeStatsFile(clock_t startTime, double wallSeconds) const;
 		void displayLastError();
 };
 